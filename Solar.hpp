@@ -16,6 +16,7 @@
  */
 #include <GL/glut.h>
 void OpenGLInit(void);
+void LoadTextures(void);
 
 static void Animate(void );
 static void Key_r(void );
@@ -23,6 +24,12 @@ static void Key_s(void );
 static void Key_up(void );
 static void Key_down(void );
 static void ResizeWindow(int w, int h);
+static void PrintStats(void );
+static int SphereSlices(int full );
+static bool ReloadChangedImages(void );
+static void StartFrameTimer(bool drawing );
+static void FrameTimer(int generation );
+static void SetSwapInterval(int interval );
 
 static void KeyPressFunc( unsigned char Key, int x, int y );
 static void SpecialKeyFunc( int Key, int x, int y );
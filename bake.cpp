@@ -0,0 +1,253 @@
+/*
+ * bake.cpp
+ *
+ * solaire-bake: convert source images (BMP, JPEG or PNG) into a texture pack
+ * that the viewer maps at startup and uploads without any decoding, and the
+ * other files it reads in place of slower sources: tile files, binary scenes
+ * and ephemerides. Runs that write what a scene does, rather than files for
+ * the viewer, are solaire-sim's (see simulate.cpp).
+ *
+ * USAGE:
+ *    solaire-bake [-o textures.pak] [-f rgba|bc1|bc3] [-j threads] image...
+ *
+ *    -f selects the texel format: uncompressed RGBA (default), BC1 for
+ *       opaque maps (1/8 the size) or BC3 when alpha matters (1/4).
+ *    -j sets the number of decoding and compression threads (default: one per core).
+ *
+ *    solaire-bake -t [-s tileSize] image...
+ *
+ *    Cuts each image into a virtual texture tile file next to it, with the
+ *    extension replaced by .vtx (e.g. images/earth.vtx). The viewer uses
+ *    the tile file instead of the image when it finds one.
+ *
+ *    solaire-bake -c scene...
+ *
+ *    Writes the compact binary form of each scene file next to it, with the
+ *    extension replaced by .scb (e.g. scenes/solar.scb). The viewer reads
+ *    either form.
+ *
+ *    solaire-bake -e firstDay lastDay [-i intervalDays] scene...
+ *
+ *    Fits the positions of every body of each scene from firstDay to lastDay
+ *    into an ephemeris file next to it, with the extension replaced by .eph.
+ *    Intervals default to an eighth of the shortest orbital period. The
+ *    viewer takes positions from the ephemeris file, when it finds one, for
+ *    the times it covers.
+ *
+ * Options apply to every file, wherever they are given; at most one of -t,
+ * -c and -e may be. Each image is stored under the path given on the command line, which is
+ * the name the viewer looks it up by (e.g. images/earth.bmp).
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "bcn.h"
+#include "ephfile.h"
+#include "getImage.h"
+#include "mipmap.h"
+#include "scene.h"
+#include "texpack.h"
+#include "vtfile.h"
+
+// Store a mip chain in the requested texture pack format.
+static void encodeChain(mipChain &chain, uint32_t format, int threads, texPackSource *source)
+{
+	source->format = format;
+	source->width = chain.levels[0].width;
+	source->height = chain.levels[0].height;
+	source->levels = (uint32_t)chain.levels.size();
+
+	if (format == TEXPACK_RGBA8)
+	{
+		source->data.swap(chain.storage);
+		return;
+	}
+
+	bcFormat bc = format == TEXPACK_BC1 ? BC1 : BC3;
+	size_t total = 0;
+	for (size_t i = 0; i < chain.levels.size(); i++)
+		total += bcImageSize(bc, chain.levels[i].width, chain.levels[i].height);
+	source->data.resize(total);
+
+	size_t offset = 0;
+	for (size_t i = 0; i < chain.levels.size(); i++)
+	{
+		encodeBC(bc, &chain.levels[i], &source->data[offset], threads);
+		offset += bcImageSize(bc, chain.levels[i].width, chain.levels[i].height);
+	}
+}
+
+static bool convertScene(std::string sceneName)
+{
+	std::string binaryName = sceneSiblingName(sceneName, ".scb");
+	scene s;
+	if (!loadScene(sceneName, s) || !writeSceneBinary(binaryName, s))
+		return false;
+	std::cout << sceneName << ": " << s.count << " bodies -> " << binaryName << std::endl;
+	return true;
+}
+
+static bool fitScene(std::string sceneName, double firstDay, double lastDay, double intervalDays)
+{
+	std::string ephName = ephFileName(sceneName);
+	scene s;
+	if (!loadScene(sceneName, s))
+		return false;
+	double interval = intervalDays;
+	for (int b = 0; b < s.count && intervalDays <= 0; b++)
+		if (s.period[b] > 0 && (interval <= 0 || s.period[b] / 8 < interval))
+			interval = s.period[b] / 8;
+	if (interval <= 0)
+		interval = lastDay - firstDay; // Nothing moves.
+	if (!writeEphFile(ephName, s, firstDay, lastDay, interval))
+		return false;
+	std::cout << sceneName << ": " << s.count << " bodies, days " << firstDay << " to " << lastDay << " in intervals of "
+			  << interval << " -> " << ephName << std::endl;
+	return true;
+}
+
+static int usage(void)
+{
+	std::cerr << "usage: solaire-bake [-o textures.pak] [-f rgba|bc1|bc3] [-j threads] image..." << std::endl;
+	std::cerr << "       solaire-bake -t [-s tileSize] image..." << std::endl;
+	std::cerr << "       solaire-bake -c scene..." << std::endl;
+	std::cerr << "       solaire-bake -e firstDay lastDay [-i intervalDays] scene..." << std::endl;
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	std::string outName = "textures.pak";
+	uint32_t format = TEXPACK_RGBA8;
+	int threads = 0;
+	bool tiles = false;
+	bool scenes = false;
+	bool ephemerides = false;
+	double firstDay = 0, lastDay = 0, intervalDays = 0;
+	uint32_t tileSize = 128;
+	std::vector<std::string> files;
+	std::vector<std::string> inputs;
+	std::vector<texPackSource *> sources;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			outName = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0)
+			tiles = true;
+		else if (strcmp(argv[i], "-e") == 0 && i + 2 < argc)
+		{
+			ephemerides = true;
+			firstDay = atof(argv[++i]);
+			lastDay = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+			intervalDays = atof(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0)
+			scenes = true;
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			tileSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "rgba") == 0)
+				format = TEXPACK_RGBA8;
+			else if (strcmp(argv[i], "bc1") == 0)
+				format = TEXPACK_BC1;
+			else if (strcmp(argv[i], "bc3") == 0)
+				format = TEXPACK_BC3;
+			else
+			{
+				std::cerr << argv[i] << ": unknown texel format" << std::endl;
+				return 1;
+			}
+		}
+		else if (argv[i][0] == '-')
+		{
+			std::cerr << argv[i] << ": unknown option or missing values" << std::endl;
+			return usage();
+		}
+		else
+			files.push_back(argv[i]);
+	}
+
+	if ((int)tiles + (int)scenes + (int)ephemerides > 1)
+	{
+		std::cerr << "solaire-bake: -t, -c and -e cannot be combined" << std::endl;
+		return usage();
+	}
+	if (files.empty())
+		return usage();
+
+	if (scenes || ephemerides)
+	{
+		for (size_t i = 0; i < files.size(); i++)
+			if (!(scenes ? convertScene(files[i]) : fitScene(files[i], firstDay, lastDay, intervalDays)))
+				return 1;
+		return 0;
+	}
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (isImageFile(files[i]))
+			inputs.push_back(files[i]);
+		else
+			std::cerr << files[i] << ": unsupported image format, skipped" << std::endl;
+	}
+
+	// Decode a batch of files at a time in parallel, bounding how many decoded images are held at once.
+	int tileFiles = 0;
+	size_t batch = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	for (size_t first = 0; first < inputs.size(); first += batch)
+	{
+		std::vector<std::string> names(inputs.begin() + first, inputs.begin() + std::min(first + batch, inputs.size()));
+		std::vector<imageFile *> images;
+		getImages(names, images, threads);
+
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			imageFile *image = images[i];
+			if (!image)
+				continue;
+			if (tiles)
+			{
+				std::string tileName = vtFileName(names[i]);
+				if (!writeVTFile(tileName, image, tileSize))
+					return 1;
+				std::cout << names[i] << ": " << image->width << "x" << image->height << " -> " << tileName << std::endl;
+				delete[] image->data;
+				delete image;
+				tileFiles++;
+				continue;
+			}
+
+			texPackSource *source = new texPackSource;
+			source->name = names[i];
+			mipChain chain;
+			buildMipChain(image, chain);
+			delete[] image->data;
+			delete image;
+			encodeChain(chain, format, threads, source);
+
+			std::cout << names[i] << ": " << source->width << "x" << source->height << ", " << source->levels
+					  << " levels, " << source->data.size() << " bytes" << std::endl;
+			sources.push_back(source);
+		}
+	}
+
+	if (tiles)
+		return tileFiles > 0 ? 0 : 1;
+	if (sources.empty())
+		return usage();
+
+	bool written = writeTexPack(outName, sources);
+	for (size_t i = 0; i < sources.size(); i++)
+		delete sources[i];
+	return written ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// BC1/BC3 block compression.
+//
+// The encoder is the bounding box method: the endpoints are the (slightly inset)
+// per-channel minimum and maximum of the block and every texel is assigned the
+// palette entry nearest to its projection on the line between them. It is far
+// from the best achievable quality but fast enough to run over full mip chains.
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "bcn.h"
+
+size_t bcImageSize(bcFormat format, int width, int height)
+{
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == BC1 ? 8 : 16);
+}
+
+// Copy a 4x4 block of texels, clamping at the image edges.
+static void fetchBlock(const imageFile *image, int bx, int by, unsigned char block[64])
+{
+	for (int y = 0; y < 4; y++)
+	{
+		int sy = std::min(4 * by + y, image->height - 1);
+		const unsigned char *row = image->data + 4 * (size_t)image->width * sy;
+		for (int x = 0; x < 4; x++)
+		{
+			int sx = std::min(4 * bx + x, image->width - 1);
+			for (int c = 0; c < 4; c++)
+				block[16 * y + 4 * x + c] = row[4 * sx + c];
+		}
+	}
+}
+
+// Per-channel minimum and maximum of the sixteen texels of a block.
+static void blockBounds(const unsigned char block[64], unsigned char mn[4], unsigned char mx[4])
+{
+#ifdef __SSE2__
+	__m128i r0 = _mm_loadu_si128((const __m128i *)block);
+	__m128i r1 = _mm_loadu_si128((const __m128i *)(block + 16));
+	__m128i r2 = _mm_loadu_si128((const __m128i *)(block + 32));
+	__m128i r3 = _mm_loadu_si128((const __m128i *)(block + 48));
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+	lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+	lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+	hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+	hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+	unsigned int l = _mm_cvtsi128_si32(lo), h = _mm_cvtsi128_si32(hi);
+	for (int c = 0; c < 4; c++)
+	{
+		mn[c] = (unsigned char)(l >> (8 * c));
+		mx[c] = (unsigned char)(h >> (8 * c));
+	}
+#else
+	for (int c = 0; c < 4; c++)
+	{
+		mn[c] = 255;
+		mx[c] = 0;
+	}
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 4; c++)
+		{
+			mn[c] = std::min(mn[c], block[4 * i + c]);
+			mx[c] = std::max(mx[c], block[4 * i + c]);
+		}
+#endif
+}
+
+// 5:6:5 packing and its expansion back to eight bits per channel.
+static unsigned short packColor(const int c[3])
+{
+	return (unsigned short)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+static void unpackColor(unsigned short v, int c[3])
+{
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+static void encodeColorBlock(const unsigned char block[64], const unsigned char mn[4], const unsigned char mx[4], unsigned char *out)
+{
+	// Inset the bounding box by 1/16 of its extent to reduce the error at the ends.
+	int lo[3], hi[3];
+	for (int c = 0; c < 3; c++)
+	{
+		int inset = (mx[c] - mn[c]) >> 4;
+		lo[c] = mn[c] + inset;
+		hi[c] = mx[c] - inset;
+	}
+	unsigned short c0 = packColor(hi), c1 = packColor(lo);
+
+	unsigned int bits = 0;
+	if (c0 != c1)
+	{
+		int e0[3], e1[3], d[3];
+		unpackColor(c0, e0);
+		unpackColor(c1, e1);
+		for (int c = 0; c < 3; c++)
+			d[c] = e0[c] - e1[c];
+		int dd = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+
+		// Quantize each texel's position along e1 -> e0 to one of four steps.
+		static const unsigned int stepIndex[4] = {1, 3, 2, 0};
+		for (int i = 0; i < 16; i++)
+		{
+			const unsigned char *p = block + 4 * i;
+			int t = (p[0] - e1[0]) * d[0] + (p[1] - e1[1]) * d[1] + (p[2] - e1[2]) * d[2];
+			t = std::min(std::max(t, 0), dd);
+			int step = (6 * t + dd) / (2 * dd);
+			bits |= stepIndex[step] << (2 * i);
+		}
+	}
+
+	out[0] = (unsigned char)c0;
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)c1;
+	out[3] = (unsigned char)(c1 >> 8);
+	out[4] = (unsigned char)bits;
+	out[5] = (unsigned char)(bits >> 8);
+	out[6] = (unsigned char)(bits >> 16);
+	out[7] = (unsigned char)(bits >> 24);
+}
+
+static void encodeAlphaBlock(const unsigned char block[64], int a1, int a0, unsigned char *out)
+{
+	unsigned long long bits = 0;
+	if (a0 != a1)
+	{
+		// Eight interpolated values from a0 (index 0) to a1 (index 1).
+		static const unsigned long long stepIndex[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+		int range = a0 - a1;
+		for (int i = 0; i < 16; i++)
+		{
+			int step = (14 * (block[4 * i + 3] - a1) + range) / (2 * range);
+			bits |= stepIndex[step] << (3 * i);
+		}
+	}
+
+	out[0] = (unsigned char)a0;
+	out[1] = (unsigned char)a1;
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// Encode the rows of blocks [firstRow, lastRow).
+static void encodeRows(bcFormat format, const imageFile *image, unsigned char *out, int firstRow, int lastRow)
+{
+	int blocksWide = (image->width + 3) / 4;
+	size_t blockSize = format == BC1 ? 8 : 16;
+	unsigned char block[64], mn[4], mx[4];
+
+	for (int by = firstRow; by < lastRow; by++)
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			unsigned char *dst = out + blockSize * ((size_t)by * blocksWide + bx);
+			fetchBlock(image, bx, by, block);
+			blockBounds(block, mn, mx);
+			if (format == BC3)
+			{
+				encodeAlphaBlock(block, mn[3], mx[3], dst);
+				dst += 8;
+			}
+			encodeColorBlock(block, mn, mx, dst);
+		}
+}
+
+void encodeBC(bcFormat format, const imageFile *image, unsigned char *out, int threads)
+{
+	int blocksHigh = (image->height + 3) / 4;
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min(threads, blocksHigh);
+
+	if (threads <= 1)
+	{
+		encodeRows(format, image, out, 0, blocksHigh);
+		return;
+	}
+
+	// Blocks are independent, so each thread takes a contiguous band of block rows.
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.push_back(std::thread(encodeRows, format, image, out, blocksHigh * t / threads, blocksHigh * (t + 1) / threads));
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+void decodeBC(bcFormat format, const unsigned char *in, imageFile *image)
+{
+	int blocksWide = (image->width + 3) / 4, blocksHigh = (image->height + 3) / 4;
+
+	for (int by = 0; by < blocksHigh; by++)
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			int alpha[8];
+			unsigned long long alphaBits = 0;
+			if (format == BC3)
+			{
+				alpha[0] = in[0];
+				alpha[1] = in[1];
+				if (alpha[0] > alpha[1])
+					for (int i = 1; i < 7; i++)
+						alpha[1 + i] = ((7 - i) * alpha[0] + i * alpha[1]) / 7;
+				else
+				{
+					for (int i = 1; i < 5; i++)
+						alpha[1 + i] = ((5 - i) * alpha[0] + i * alpha[1]) / 5;
+					alpha[6] = 0;
+					alpha[7] = 255;
+				}
+				for (int i = 0; i < 6; i++)
+					alphaBits |= (unsigned long long)in[2 + i] << (8 * i);
+				in += 8;
+			}
+
+			unsigned short c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+			unsigned int bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+			int palette[4][4];
+			unpackColor(c0, palette[0]);
+			unpackColor(c1, palette[1]);
+			palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+			for (int c = 0; c < 3; c++)
+			{
+				if (c0 > c1 || format == BC3)
+				{
+					palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+					palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+				}
+				else
+				{
+					palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+					palette[3][c] = 0;
+				}
+			}
+			if (c0 <= c1 && format == BC1)
+				palette[3][3] = 0;
+			in += 8;
+
+			for (int y = 0; y < 4 && 4 * by + y < image->height; y++)
+				for (int x = 0; x < 4 && 4 * bx + x < image->width; x++)
+				{
+					int i = 4 * y + x;
+					const int *color = palette[(bits >> (2 * i)) & 3];
+					unsigned char *dst = image->data + 4 * ((size_t)(4 * by + y) * image->width + 4 * bx + x);
+					dst[0] = (unsigned char)color[0];
+					dst[1] = (unsigned char)color[1];
+					dst[2] = (unsigned char)color[2];
+					dst[3] = (unsigned char)(format == BC3 ? alpha[(alphaBits >> (3 * i)) & 7] : color[3]);
+				}
+		}
+}
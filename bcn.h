@@ -0,0 +1,27 @@
+#ifndef BCN_H
+#define BCN_H
+
+// Block compression of RGBA images to BC1 (DXT1, opaque, 8 bytes per 4x4 block)
+// and BC3 (DXT5, 16 bytes per 4x4 block), and decoding back to RGBA.
+
+#include <stddef.h>
+
+#include "getBMP.h"
+
+enum bcFormat
+{
+	BC1,
+	BC3
+};
+
+// Bytes of an image of the given size once compressed.
+size_t bcImageSize(bcFormat format, int width, int height);
+
+// Compress an RGBA image, splitting the rows of blocks across threads (0 = one per core).
+// Edge blocks of images that are not a multiple of four texels are padded by clamping.
+void encodeBC(bcFormat format, const imageFile *image, unsigned char *out, int threads);
+
+// Decompress to RGBA, for when the GL cannot sample compressed textures itself.
+void decodeBC(bcFormat format, const unsigned char *in, imageFile *image);
+
+#endif
@@ -0,0 +1,373 @@
+// Ephemeris cache: Hermite knots per body, rebuilt on worker threads.
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#include "ephemeris.h"
+
+// Knots per circular orbit. Cubic Hermite interpolation at this spacing strays
+// from the orbit by about 4e-6 of its radius.
+#define EPHEMERIS_KNOTS_PER_ORBIT 32
+
+// Knots held per body: at least the segment under the cursor and one either
+// side, and as many more as cover EPHEMERIS_LEAD_FRAMES frames of travel.
+#define EPHEMERIS_MIN_KNOTS 4
+#define EPHEMERIS_MAX_KNOTS 256
+#define EPHEMERIS_LEAD_FRAMES 16
+
+// Knots per frame beyond which a body's knots would not last long enough to be worth computing: it is evaluated
+// exactly instead.
+#define EPHEMERIS_MAX_KNOTS_PER_FRAME (EPHEMERIS_MAX_KNOTS / 4)
+
+// Knots per worker job.
+#define EPHEMERIS_JOB_KNOTS 16384
+
+// Bodies below which evaluation is not worth splitting across threads.
+#define EPHEMERIS_BAND_BODIES 65536
+
+// Floats per knot: position and velocity.
+#define KNOT_FLOATS 6
+
+struct ephemerisJob
+{
+	std::vector<int> bodies;
+	std::vector<int64_t> first; // First knot of each body's new set.
+	std::vector<int> count; // Knots in each body's new set.
+	std::vector<size_t> offset; // Of each body's set in knots.
+	std::vector<float> knots;
+	std::atomic<bool> done;
+};
+
+// Bands of one evaluation, shared with the workers that help with it. A worker that only gets to it once every band
+// is taken finds nothing left to do, so the evaluation never waits on workers busy with knots.
+struct ephemerisBands
+{
+	double days, pace;
+	float *positions;
+	char *status;
+	int bands;
+	std::atomic<int> next, done;
+};
+
+struct ephemerisCache
+{
+	const scene *s;
+	std::vector<double> step; // Days between knots, 0 for bodies that do not move.
+	std::vector<double> perStep; // 1 / step, or 0.
+	std::vector<int64_t> first; // Index of the first knot held, LLONG_MIN for none.
+	std::vector<int> count; // Knots held per body.
+	std::vector<float> knots; // EPHEMERIS_MIN_KNOTS knots per body, for sets no longer than that.
+	std::vector<std::vector<float> > longKnots; // Longer sets, kept apart so the others stay packed.
+	std::vector<char> queued; // A job is computing new knots for the body.
+	std::vector<char> status; // knotStatus of each body in the last evaluation.
+	std::list<ephemerisJob *> jobs; // Owned by the calling thread.
+	ephemerisJob *filling; // Job collecting bodies this evaluation, NULL when none.
+	double lastDays; // Time of the last evaluation.
+	double pace; // Days the cursor moved in the last evaluation.
+	ephemerisStats stats;
+
+	// Worker pool.
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable bandsDone; // An evaluation's bands are all done.
+	bool stopping;
+};
+
+static void runWorker(ephemerisCache *cache)
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(cache->mutex);
+			cache->wake.wait(lock, [cache] { return cache->stopping || !cache->tasks.empty(); });
+			if (cache->stopping)
+				return;
+			task = cache->tasks.front();
+			cache->tasks.pop_front();
+		}
+		task();
+	}
+}
+
+ephemerisCache *createEphemerisCache(const scene &s, int workers)
+{
+	ephemerisCache *cache = new ephemerisCache;
+	cache->s = &s;
+	cache->step.resize(s.count);
+	cache->perStep.resize(s.count);
+	for (int b = 0; b < s.count; b++)
+	{
+		// An eccentric orbit sweeps periapsis in a fraction of its period that shrinks as (1 - e)^1.5, so its knots are closer.
+		double sharpness = pow(1.0 - s.eccentricity[b], 1.5);
+		cache->step[b] = s.period[b] > 0 && s.semiMajorAxis[b] > 0 ? s.period[b] * sharpness / EPHEMERIS_KNOTS_PER_ORBIT : 0;
+		cache->perStep[b] = cache->step[b] > 0 ? 1.0 / cache->step[b] : 0;
+	}
+	cache->first.assign(s.count, LLONG_MIN);
+	cache->count.assign(s.count, 0);
+	cache->knots.resize((size_t)s.count * EPHEMERIS_MIN_KNOTS * KNOT_FLOATS);
+	cache->longKnots.resize(s.count);
+	cache->queued.assign(s.count, 0);
+	cache->filling = NULL;
+	cache->lastDays = 0;
+	cache->pace = 0;
+	cache->stats.bodies = s.count;
+	cache->stats.hits = cache->stats.misses = cache->stats.rebuilds = 0;
+	cache->stats.pendingJobs = 0;
+
+	cache->stopping = false;
+	if (workers <= 0)
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < workers; i++)
+		cache->workers.push_back(std::thread(runWorker, cache));
+	return cache;
+}
+
+void destroyEphemerisCache(ephemerisCache *cache)
+{
+	{
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->stopping = true;
+	}
+	cache->wake.notify_all();
+	for (size_t i = 0; i < cache->workers.size(); i++)
+		cache->workers[i].join();
+	for (std::list<ephemerisJob *>::iterator it = cache->jobs.begin(); it != cache->jobs.end(); ++it)
+		delete *it;
+	delete cache->filling;
+	delete cache;
+}
+
+static void queueJob(ephemerisCache *cache)
+{
+	ephemerisJob *job = cache->filling;
+	cache->filling = NULL;
+	job->done = false;
+	cache->jobs.push_back(job);
+
+	const scene *s = cache->s;
+	const double *step = cache->step.data();
+	{
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->tasks.push_back([job, s, step] {
+			for (size_t i = 0; i < job->bodies.size(); i++)
+			{
+				int b = job->bodies[i];
+				float *knot = &job->knots[job->offset[i]];
+				for (int k = 0; k < job->count[i]; k++, knot += KNOT_FLOATS)
+					orbitState(*s, b, (job->first[i] + k) * step[b], knot, knot + 3);
+			}
+			job->done = true;
+		});
+	}
+	cache->wake.notify_one();
+}
+
+// Knots the cursor passes over a body's lead, given how many it moves per frame.
+static double leadKnots(double knotsPerFrame)
+{
+	return fabs(knotsPerFrame) * EPHEMERIS_LEAD_FRAMES;
+}
+
+// Ask the workers for knots of a body around the cursor: mostly ahead of it in the direction of travel, enough for
+// EPHEMERIS_LEAD_FRAMES frames, and centred on it while it stands still.
+static void requestKnots(ephemerisCache *cache, int body, double days)
+{
+	double knotsPerFrame = cache->pace * cache->perStep[body];
+	int count = std::min(EPHEMERIS_MAX_KNOTS, std::max(EPHEMERIS_MIN_KNOTS, (int)ceil(leadKnots(knotsPerFrame)) + 3));
+	int behind = knotsPerFrame > 0 ? 1 : (knotsPerFrame < 0 ? count - 2 : (count - 1) / 2);
+
+	if (!cache->filling)
+		cache->filling = new ephemerisJob;
+	ephemerisJob *job = cache->filling;
+	job->bodies.push_back(body);
+	job->first.push_back((int64_t)floor(days * cache->perStep[body]) - behind);
+	job->count.push_back(count);
+	job->offset.push_back(job->knots.size());
+	job->knots.resize(job->knots.size() + (size_t)count * KNOT_FLOATS);
+	cache->queued[body] = 1;
+	if (job->knots.size() >= EPHEMERIS_JOB_KNOTS * KNOT_FLOATS)
+		queueJob(cache);
+}
+
+// Take in the knots of every finished job.
+static void collectJobs(ephemerisCache *cache)
+{
+	for (std::list<ephemerisJob *>::iterator it = cache->jobs.begin(); it != cache->jobs.end();)
+	{
+		ephemerisJob *job = *it;
+		if (!job->done)
+		{
+			++it;
+			continue;
+		}
+		for (size_t i = 0; i < job->bodies.size(); i++)
+		{
+			int b = job->bodies[i];
+			const float *knots = &job->knots[job->offset[i]];
+			cache->first[b] = job->first[i];
+			cache->count[b] = job->count[i];
+			if (job->count[i] <= EPHEMERIS_MIN_KNOTS)
+			{
+				std::copy(knots, knots + job->count[i] * KNOT_FLOATS, &cache->knots[(size_t)b * EPHEMERIS_MIN_KNOTS * KNOT_FLOATS]);
+				std::vector<float>().swap(cache->longKnots[b]);
+			}
+			else
+				cache->longKnots[b].assign(knots, knots + job->count[i] * KNOT_FLOATS);
+			cache->queued[b] = 0;
+		}
+		cache->stats.rebuilds += job->bodies.size();
+		delete job;
+		it = cache->jobs.erase(it);
+	}
+}
+
+enum knotStatus
+{
+	KNOTS_AHEAD, // Interpolated, with knots enough ahead of the cursor.
+	KNOTS_RUNNING_OUT, // Interpolated, but the cursor is nearing the end it travels towards.
+	KNOTS_MISSING, // Evaluated exactly.
+	KNOTS_NONE // The body does not move.
+};
+
+// Positions relative to the parent of bodies begin to end, and how their knots fared. Pace is the days the cursor
+// moves per frame.
+static void evaluateBand(const ephemerisCache *cache, double days, double pace, float *positions, char *status,
+						 int begin, int end)
+{
+	const scene &s = *cache->s;
+	for (int b = begin; b < end; b++)
+	{
+		float *p = &positions[3 * b];
+		float v[3];
+		double step = cache->step[b];
+		if (step == 0)
+		{
+			orbitState(s, b, days, p, v);
+			status[b] = KNOTS_NONE;
+			continue;
+		}
+
+		double t = days * cache->perStep[b];
+		int64_t k = (int64_t)floor(t);
+		int64_t offset = k - cache->first[b];
+		int64_t count = cache->count[b];
+		if (cache->first[b] == LLONG_MIN || offset < 0 || offset + 1 >= count)
+		{
+			orbitState(s, b, days, p, v);
+			status[b] = KNOTS_MISSING;
+			continue;
+		}
+
+		// Cubic Hermite between knots k and k + 1, velocities scaled to the segment.
+		const float *k0 = (count <= EPHEMERIS_MIN_KNOTS ? &cache->knots[(size_t)b * EPHEMERIS_MIN_KNOTS * KNOT_FLOATS]
+																: cache->longKnots[b].data()) + offset * KNOT_FLOATS;
+		const float *k1 = k0 + KNOT_FLOATS;
+		float u = (float)(t - k), u2 = u * u, u3 = u2 * u;
+		float h00 = 2 * u3 - 3 * u2 + 1, h10 = (float)step * (u3 - 2 * u2 + u);
+		float h01 = -2 * u3 + 3 * u2, h11 = (float)step * (u3 - u2);
+		for (int c = 0; c < 3; c++)
+			p[c] = h00 * k0[c] + h10 * k0[3 + c] + h01 * k1[c] + h11 * k1[3 + c];
+
+		// Ask for more once half the lead is used up, so the new knots are ready before these run out. Standing still,
+		// keep a segment either side.
+		double knotsPerFrame = pace * cache->perStep[b];
+		int64_t ahead = knotsPerFrame > 0 ? count - 2 - offset : (knotsPerFrame < 0 ? offset : std::min(offset, count - 2 - offset));
+		status[b] = ahead < std::max(1.0, leadKnots(knotsPerFrame) / 2) ? KNOTS_RUNNING_OUT : KNOTS_AHEAD;
+	}
+}
+
+static void runBands(ephemerisCache *cache, std::shared_ptr<ephemerisBands> work)
+{
+	int count = cache->s->count;
+	for (int i; (i = work->next++) < work->bands;)
+	{
+		evaluateBand(cache, work->days, work->pace, work->positions, work->status,
+					 (int)((int64_t)count * i / work->bands), (int)((int64_t)count * (i + 1) / work->bands));
+		if (++work->done == work->bands)
+		{
+			std::lock_guard<std::mutex> lock(cache->mutex);
+			cache->bandsDone.notify_all();
+		}
+	}
+}
+
+int evaluateEphemeris(ephemerisCache *cache, double days, std::vector<float> &positions)
+{
+	collectJobs(cache);
+	cache->pace = days - cache->lastDays;
+	cache->lastDays = days;
+
+	// Bodies are independent until they are placed around their parents, so the pool's workers help with bands,
+	// ahead of any knots they have queued.
+	const scene &s = *cache->s;
+	positions.resize(3 * s.count);
+	cache->status.resize(s.count);
+	int threads = std::min((int)cache->workers.size() + 1, s.count / EPHEMERIS_BAND_BODIES);
+	if (threads <= 1)
+		evaluateBand(cache, days, cache->pace, positions.data(), cache->status.data(), 0, s.count);
+	else
+	{
+		std::shared_ptr<ephemerisBands> work(new ephemerisBands);
+		work->days = days;
+		work->pace = cache->pace;
+		work->positions = positions.data();
+		work->status = cache->status.data();
+		work->bands = threads;
+		work->next = work->done = 0;
+		{
+			std::lock_guard<std::mutex> lock(cache->mutex);
+			for (int t = 1; t < threads; t++)
+				cache->tasks.push_front([cache, work] { runBands(cache, work); });
+		}
+		cache->wake.notify_all();
+		runBands(cache, work);
+		std::unique_lock<std::mutex> lock(cache->mutex);
+		cache->bandsDone.wait(lock, [&work] { return work->done == work->bands; });
+	}
+
+	// Ask for knots around the cursor where they are missing or nearly run out, and place every body around its parent.
+	int misses = 0, interpolated = 0;
+	for (int b = 0; b < s.count; b++)
+	{
+		char status = cache->status[b];
+		if (status == KNOTS_MISSING)
+			misses++;
+		else if (status != KNOTS_NONE)
+			interpolated++;
+		if ((status == KNOTS_MISSING || status == KNOTS_RUNNING_OUT) && !cache->queued[b] &&
+			fabs(cache->pace * cache->perStep[b]) <= EPHEMERIS_MAX_KNOTS_PER_FRAME)
+			requestKnots(cache, b, days);
+		if (s.parent[b] >= 0)
+		{
+			float *p = &positions[3 * b];
+			const float *parent = &positions[3 * s.parent[b]];
+			for (int c = 0; c < 3; c++)
+				p[c] += parent[c];
+		}
+	}
+	if (cache->filling)
+		queueJob(cache);
+
+	cache->stats.hits += interpolated;
+	cache->stats.misses += misses;
+	cache->stats.pendingJobs = (int)cache->jobs.size();
+	return misses;
+}
+
+void getEphemerisStats(const ephemerisCache *cache, ephemerisStats &stats)
+{
+	stats = cache->stats;
+}
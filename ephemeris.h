@@ -0,0 +1,41 @@
+#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+
+// Ephemeris cache: body positions at any time by interpolation.
+//
+// Each body's position and velocity relative to its parent are held at knots,
+// spaced a fixed fraction of its period apart, around the time cursor.
+// Positions between two knots come from cubic Hermite interpolation, which
+// costs a few multiplies instead of solving Kepler's equation. As the cursor
+// nears the end of a body's knots it is moving towards, worker threads compute
+// a new set reaching ahead of it as far as it travels in several frames at its
+// current pace (a few knots either side while it stands still), so playback
+// at any speed and scrubbing back and forth stay on cached knots. A body whose
+// knots do not cover the time yet (after a jump), or which passes more knots
+// a frame than are worth computing, is evaluated exactly for that frame.
+
+#include <vector>
+
+#include "scene.h"
+
+struct ephemerisCache;
+
+struct ephemerisStats
+{
+	int bodies;
+	long hits, misses; // Body evaluations from the knots, and exact ones while knots were missing.
+	long rebuilds; // Knot sets computed by the workers.
+	int pendingJobs;
+};
+
+// Cache the orbits of a scene, which must outlive the cache and not change. Workers 0 means one per core.
+ephemerisCache *createEphemerisCache(const scene &s, int workers = 0);
+void destroyEphemerisCache(ephemerisCache *cache);
+
+// Position of every body (three floats each) at the given time in days, like scenePositions().
+// Returns the number of bodies evaluated exactly because their knots were not ready.
+int evaluateEphemeris(ephemerisCache *cache, double days, std::vector<float> &positions);
+
+void getEphemerisStats(const ephemerisCache *cache, ephemerisStats &stats);
+
+#endif
@@ -0,0 +1,206 @@
+// Reading, evaluating and writing ephemeris files.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ephfile.h"
+
+// Coefficients fitted per axis. With intervals of an eighth of the shortest
+// period the fit is as accurate as the float positions it is fitted to.
+#define EPHFILE_COEFFICIENTS 12
+
+bool openEphFile(std::string fileName, ephFile &file)
+{
+	memset(&file, 0, sizeof(file));
+
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ephHeader))
+	{
+		std::cerr << fileName << ": not an ephemeris file" << std::endl;
+		close(fd);
+		return false;
+	}
+
+	// Intervals are paged in as time reaches them, so opening costs the same for a year as for millennia.
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		std::cerr << fileName << ": cannot map ephemeris file" << std::endl;
+		return false;
+	}
+
+	file.base = (const unsigned char *)base;
+	file.size = st.st_size;
+	file.header = (const ephHeader *)file.base;
+
+	const ephHeader *h = file.header;
+	bool valid = memcmp(h->magic, EPHFILE_MAGIC, 4) == 0 && h->version == EPHFILE_VERSION && h->bodies > 0 &&
+				 h->coefficients > 0 && h->coefficients <= EPHFILE_MAX_COEFFICIENTS && h->intervalDays > 0 &&
+				 h->intervals > 0 && h->dataOffset >= sizeof(ephHeader) && h->dataOffset <= file.size;
+	if (valid)
+	{
+		file.groups = (h->bodies + EPHFILE_LANES - 1) / EPHFILE_LANES;
+		file.recordBytes = (size_t)h->coefficients * 3 * EPHFILE_LANES * sizeof(double);
+		valid = h->intervals <= (file.size - h->dataOffset) / file.recordBytes / file.groups;
+	}
+	if (!valid)
+	{
+		std::cerr << fileName << ": corrupt ephemeris file" << std::endl;
+		closeEphFile(file);
+		return false;
+	}
+	return true;
+}
+
+void closeEphFile(ephFile &file)
+{
+	if (file.base)
+		munmap((void *)file.base, file.size);
+	memset(&file, 0, sizeof(file));
+}
+
+bool ephFileCovers(const ephFile &file, double days)
+{
+	const ephHeader *h = file.header;
+	return file.base && days >= h->firstDay && days <= h->firstDay + h->intervals * h->intervalDays;
+}
+
+void evaluateEphFile(const ephFile &file, double days, float *positions)
+{
+	const ephHeader *h = file.header;
+	double t = (days - h->firstDay) / h->intervalDays;
+	uint64_t interval = (uint64_t)std::max(0.0, floor(t));
+	if (interval >= h->intervals)
+		interval = h->intervals - 1; // The very end of the last interval.
+
+	// The Chebyshev polynomials at the time, shared by every body of the interval.
+	double x = 2 * (t - interval) - 1;
+	double T[EPHFILE_MAX_COEFFICIENTS];
+	T[0] = 1;
+	T[1] = x;
+	for (uint32_t j = 2; j < h->coefficients; j++)
+		T[j] = 2 * x * T[j - 1] - T[j - 2];
+
+	const double *record = (const double *)(file.base + h->dataOffset + interval * file.groups * file.recordBytes);
+	for (uint32_t g = 0; g < file.groups; g++, record += h->coefficients * 3 * EPHFILE_LANES)
+	{
+		double p[3][EPHFILE_LANES];
+		for (int axis = 0; axis < 3; axis++)
+		{
+#ifdef __SSE2__
+			// Two bodies per register, EPHFILE_LANES / 2 registers.
+			__m128d sum01 = _mm_setzero_pd(), sum23 = _mm_setzero_pd();
+			for (uint32_t j = 0; j < h->coefficients; j++)
+			{
+				const double *c = record + (j * 3 + axis) * EPHFILE_LANES;
+				__m128d tj = _mm_set1_pd(T[j]);
+				sum01 = _mm_add_pd(sum01, _mm_mul_pd(_mm_loadu_pd(c), tj));
+				sum23 = _mm_add_pd(sum23, _mm_mul_pd(_mm_loadu_pd(c + 2), tj));
+			}
+			_mm_storeu_pd(&p[axis][0], sum01);
+			_mm_storeu_pd(&p[axis][2], sum23);
+#else
+			for (int lane = 0; lane < EPHFILE_LANES; lane++)
+				p[axis][lane] = 0;
+			for (uint32_t j = 0; j < h->coefficients; j++)
+			{
+				const double *c = record + (j * 3 + axis) * EPHFILE_LANES;
+				for (int lane = 0; lane < EPHFILE_LANES; lane++)
+					p[axis][lane] += c[lane] * T[j];
+			}
+#endif
+		}
+
+		uint32_t first = g * EPHFILE_LANES;
+		for (uint32_t lane = 0; lane < EPHFILE_LANES && first + lane < h->bodies; lane++)
+			for (int axis = 0; axis < 3; axis++)
+				positions[3 * (first + lane) + axis] = (float)p[axis][lane];
+	}
+}
+
+bool writeEphFile(std::string fileName, const scene &s, double firstDay, double lastDay, double intervalDays)
+{
+	if (s.count <= 0 || intervalDays <= 0 || lastDay <= firstDay)
+	{
+		std::cerr << fileName << ": nothing to fit" << std::endl;
+		return false;
+	}
+
+	ephHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, EPHFILE_MAGIC, 4);
+	header.version = EPHFILE_VERSION;
+	header.bodies = s.count;
+	header.coefficients = EPHFILE_COEFFICIENTS;
+	header.firstDay = firstDay;
+	header.intervalDays = intervalDays;
+	header.intervals = (uint64_t)ceil((lastDay - firstDay) / intervalDays);
+	header.dataOffset = sizeof(ephHeader);
+	header.sceneHash = sceneHash(s, false);
+
+	std::ofstream outFile(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	outFile.write((const char *)&header, sizeof(header));
+
+	const int n = EPHFILE_COEFFICIENTS;
+	int groups = (s.count + EPHFILE_LANES - 1) / EPHFILE_LANES;
+	std::vector<std::vector<float> > samples(n);
+	std::vector<double> records((size_t)groups * n * 3 * EPHFILE_LANES);
+
+	// T_j(x_k) = cos(pi j (k + 1/2) / n) at the nodes, the same for every interval.
+	std::vector<double> chebyshev((size_t)n * n);
+	for (int j = 0; j < n; j++)
+		for (int k = 0; k < n; k++)
+			chebyshev[j * n + k] = cos(M_PI * j * (k + 0.5) / n);
+	for (uint64_t i = 0; i < header.intervals && outFile; i++)
+	{
+		// Sample at the Chebyshev nodes of the interval, x_k = cos(pi (k + 1/2) / n).
+		double start = firstDay + i * intervalDays;
+		for (int k = 0; k < n; k++)
+			scenePositions(s, start + intervalDays * (cos(M_PI * (k + 0.5) / n) + 1) / 2, samples[k]);
+
+		// c_j = 2/n sum_k f(x_k) T_j(x_k), with c_0 halved.
+		std::fill(records.begin(), records.end(), 0.0);
+		for (int b = 0; b < s.count; b++)
+		{
+			double *record = &records[(size_t)(b / EPHFILE_LANES) * n * 3 * EPHFILE_LANES];
+			int lane = b % EPHFILE_LANES;
+			for (int j = 0; j < n; j++)
+				for (int axis = 0; axis < 3; axis++)
+				{
+					double sum = 0;
+					for (int k = 0; k < n; k++)
+						sum += samples[k][3 * b + axis] * chebyshev[j * n + k];
+					record[(j * 3 + axis) * EPHFILE_LANES + lane] = (j == 0 ? 1.0 : 2.0) * sum / n;
+				}
+		}
+		outFile.write((const char *)records.data(), records.size() * sizeof(double));
+	}
+	if (!outFile)
+	{
+		std::cerr << fileName << ": cannot write ephemeris file" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::string ephFileName(std::string sceneName)
+{
+	return sceneSiblingName(sceneName, ".eph");
+}
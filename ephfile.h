@@ -0,0 +1,72 @@
+#ifndef EPHFILE_H
+#define EPHFILE_H
+
+// Ephemeris file: the positions of every body of a scene over a span of time
+// as Chebyshev polynomials, written offline by solaire-bake -e and
+// memory-mapped by the viewer.
+//
+// Layout:
+//   ephHeader
+//   records, from dataOffset: for each interval in turn, one record per group
+//   of EPHFILE_LANES bodies (the last group padded with zeros). Every record is
+//   the same size, so the record of body b in interval i is number
+//   i * groups + b / EPHFILE_LANES, found without any search.
+//
+// A record holds, for each coefficient and axis, that coefficient of the
+// EPHFILE_LANES bodies side by side (doubles), so evaluation runs across
+// bodies in SIMD lanes. Positions are in scene units relative to the scene
+// origin, fitted at Chebyshev nodes of each interval.
+//
+// Opening the file reads only its header; the records of an interval are
+// paged in when a time inside it is first evaluated.
+
+#include <stdint.h>
+#include <string>
+
+#include "scene.h"
+
+#define EPHFILE_MAGIC "SLEP"
+#define EPHFILE_VERSION 2
+#define EPHFILE_LANES 4
+#define EPHFILE_MAX_COEFFICIENTS 32
+
+struct ephHeader
+{
+	char magic[4]; // EPHFILE_MAGIC.
+	uint32_t version; // EPHFILE_VERSION.
+	uint32_t bodies;
+	uint32_t coefficients; // Per axis, per body, per interval.
+	double firstDay; // Start of the first interval.
+	double intervalDays; // Length of every interval.
+	uint64_t intervals;
+	uint64_t dataOffset; // Byte offset of the first record.
+	uint64_t sceneHash; // sceneHash() of the scene fitted, without masses.
+};
+
+// An ephemeris file mapped into memory.
+struct ephFile
+{
+	const unsigned char *base; // Start of the mapping, NULL when not open.
+	size_t size; // Bytes mapped.
+	const ephHeader *header;
+	uint32_t groups; // Records per interval.
+	size_t recordBytes;
+};
+
+// Map an ephemeris file and validate its header. Returns false (leaving file closed) on failure.
+bool openEphFile(std::string fileName, ephFile &file);
+void closeEphFile(ephFile &file);
+
+// Whether the file has positions for the given time in days.
+bool ephFileCovers(const ephFile &file, double days);
+
+// Position of every body (three floats each) at a time the file covers.
+void evaluateEphFile(const ephFile &file, double days, float *positions);
+
+// Fit the bodies of a scene from firstDay to lastDay in intervals of the given length. Returns false on failure.
+bool writeEphFile(std::string fileName, const scene &s, double firstDay, double lastDay, double intervalDays);
+
+// Name of the ephemeris file baked from a scene: the scene's name with its extension replaced by .eph.
+std::string ephFileName(std::string sceneName);
+
+#endif
@@ -0,0 +1,387 @@
+// Event search: sampling in threads, then golden-section search and regula falsi.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#include "events.h"
+#include "solaire.h"
+
+// Samples per orbit of the fastest body involved.
+#define EVENT_SAMPLES_PER_ORBIT 32
+
+// Bound on how fast the gap between two discs closes, as a multiple of the
+// speeds of the bodies across the observer's sky; covers the discs growing.
+#define EVENT_RATE_MARGIN 2.0
+
+// Body positions evaluated per batch of samples.
+#define EVENT_BATCH_QUERIES 65536
+
+// Contacts and greatest separations are found to this many days (about 0.1 s).
+#define EVENT_TOLERANCE 1e-6
+
+struct eventSearch
+{
+	const scene *s;
+	orbitTable *table;
+	const std::vector<eventSpec> *specs;
+	std::vector<int> bodies; // Bodies the specs involve.
+	std::vector<int> slot; // Index of each scene body in bodies, -1 when not involved.
+	double firstDay, lastDay, stepDays;
+	double longestPeriod; // Of the bodies involved and those they orbit.
+	int64_t samples, chunkSamples, chunks;
+	std::atomic<int64_t> nextChunk;
+	std::mutex mutex;
+	std::vector<sceneEvent> *events;
+};
+
+// The angles between the occulter and target and their angular radii, seen from the observer.
+struct eventGeometry
+{
+	double separation, occulterRadius, targetRadius;
+	bool inFront; // The occulter is nearer the observer than the target.
+	double closing; // Bound on how fast the separation and radii change, radians per day.
+};
+
+static double length(const double *v)
+{
+	return sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+// Geometry from positions (and velocities, when given) of the observer, occulter and target.
+static void measure(const scene &s, const eventSpec &spec, const double *p[3], const double *v[3], eventGeometry &g)
+{
+	double a[3], b[3], cross[3];
+	for (int c = 0; c < 3; c++)
+	{
+		a[c] = p[1][c] - p[0][c];
+		b[c] = p[2][c] - p[0][c];
+	}
+	cross[0] = a[1] * b[2] - a[2] * b[1];
+	cross[1] = a[2] * b[0] - a[0] * b[2];
+	cross[2] = a[0] * b[1] - a[1] * b[0];
+	double da = length(a), db = length(b);
+	g.separation = atan2(length(cross), a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+	g.occulterRadius = asin(std::min(1.0, s.radius[spec.occulter] / da));
+	g.targetRadius = asin(std::min(1.0, s.radius[spec.target] / db));
+	g.inFront = da < db;
+	g.closing = 0;
+	if (v)
+	{
+		double va[3], vb[3];
+		for (int c = 0; c < 3; c++)
+		{
+			va[c] = v[1][c] - v[0][c];
+			vb[c] = v[2][c] - v[0][c];
+		}
+		g.closing = EVENT_RATE_MARGIN * (length(va) / da + length(vb) / db);
+	}
+}
+
+// Angle between the edges of the discs: negative while they overlap, pi while the occulter is behind.
+static double gap(const eventGeometry &g)
+{
+	return g.inFront ? g.separation - g.occulterRadius - g.targetRadius : M_PI;
+}
+
+static void measureAt(const eventSearch *search, const eventSpec &spec, double days, eventGeometry &g)
+{
+	int bodies[3] = {spec.observer, spec.occulter, spec.target};
+	double times[3] = {days, days, days};
+	double positions[9];
+	queryBodyStates(search->table, bodies, times, 3, positions, NULL, 1);
+	const double *p[3] = {positions, positions + 3, positions + 6};
+	measure(*search->s, spec, p, NULL, g);
+}
+
+static double gapAt(const eventSearch *search, const eventSpec &spec, double days)
+{
+	eventGeometry g;
+	measureAt(search, spec, days, g);
+	return gap(g);
+}
+
+// Time between inside and outside at which the discs touch, by regula falsi with the Illinois
+// modification (halving the weight of an end that is kept twice), which keeps the bracket of bisection
+// but converges in a handful of steps.
+static double contact(const eventSearch *search, const eventSpec &spec, double inside, double outside)
+{
+	double fIn = gapAt(search, spec, inside), fOut = gapAt(search, spec, outside);
+	int kept = 0; // Positive while inside has been kept, negative while outside has.
+	for (int k = 0; k < 100 && fabs(outside - inside) > EVENT_TOLERANCE; k++)
+	{
+		double t = (inside * fOut - outside * fIn) / (fOut - fIn);
+		if (!(t > std::min(inside, outside) && t < std::max(inside, outside)))
+			t = (inside + outside) / 2;
+		double f = gapAt(search, spec, t);
+		if (f < 0)
+		{
+			inside = t;
+			fIn = f;
+			if (kept < 0)
+				fOut /= 2;
+			kept = std::min(kept, 0) - 1;
+		}
+		else
+		{
+			outside = t;
+			fOut = f;
+			if (kept > 0)
+				fIn /= 2;
+			kept = std::max(kept, 0) + 1;
+		}
+		if (f == 0 || fabs(outside - inside) <= EVENT_TOLERANCE)
+			return t;
+	}
+	return (inside + outside) / 2;
+}
+
+// Golden-section search for the time of the least gap between from and to. With untilTouching, stops at
+// the first time the discs are found to touch.
+static double leastGap(const eventSearch *search, const eventSpec &spec, double from, double to, bool untilTouching)
+{
+	const double ratio = (sqrt(5.0) - 1) / 2;
+	double a = from, b = to;
+	double x1 = b - ratio * (b - a), x2 = a + ratio * (b - a);
+	double f1 = gapAt(search, spec, x1), f2 = gapAt(search, spec, x2);
+	while (b - a > EVENT_TOLERANCE)
+	{
+		if (untilTouching && std::min(f1, f2) < 0)
+			return f1 < f2 ? x1 : x2;
+		if (f1 < f2)
+		{
+			b = x2;
+			x2 = x1;
+			f2 = f1;
+			x1 = b - ratio * (b - a);
+			f1 = gapAt(search, spec, x1);
+		}
+		else
+		{
+			a = x1;
+			x1 = x2;
+			f1 = f2;
+			x2 = a + ratio * (b - a);
+			f2 = gapAt(search, spec, x2);
+		}
+	}
+	return (a + b) / 2;
+}
+
+// Look for an event between two samples whose gap could close. Returns false if the discs do not touch there.
+static bool refine(const eventSearch *search, const eventSpec &spec, double from, double to, sceneEvent &event)
+{
+	double touching = leastGap(search, spec, from, to, true);
+	if (gapAt(search, spec, touching) >= 0)
+		return false;
+
+	// Step out a sample at a time until the discs part, then close in on each contact. Discs still together a whole
+	// period outside the span never part (bodies in step with each other); the event is cut off there.
+	event.spec = spec;
+	double earliest = search->firstDay - search->longestPeriod, latest = search->lastDay + search->longestPeriod;
+	double before = touching - search->stepDays, after = touching + search->stepDays;
+	while (before > earliest && gapAt(search, spec, before) < 0)
+		before -= search->stepDays;
+	while (after < latest && gapAt(search, spec, after) < 0)
+		after += search->stepDays;
+	event.begin = gapAt(search, spec, before) >= 0 ? contact(search, spec, touching, before) : before;
+	event.end = gapAt(search, spec, after) >= 0 ? contact(search, spec, touching, after) : after;
+
+	// The least gap between two samples need not be the least of the whole event.
+	event.greatest = leastGap(search, spec, event.begin, event.end, false);
+	eventGeometry g;
+	measureAt(search, spec, event.greatest, g);
+	event.separation = g.separation;
+	if (g.separation <= g.occulterRadius - g.targetRadius)
+		event.kind = EVENT_TOTAL;
+	else if (g.separation <= g.targetRadius - g.occulterRadius)
+		event.kind = EVENT_CENTRAL;
+	else
+		event.kind = EVENT_PARTIAL;
+	return true;
+}
+
+static void runSearch(eventSearch *search)
+{
+	const std::vector<eventSpec> &specs = *search->specs;
+	size_t n = search->bodies.size();
+	std::vector<int> bodies;
+	std::vector<double> days, positions, velocities;
+	std::vector<eventGeometry> geometry;
+	std::vector<sceneEvent> found;
+	for (;;)
+	{
+		int64_t chunk = search->nextChunk++;
+		if (chunk >= search->chunks)
+			break;
+
+		// Samples first to last of the chunk; the last is also the first of the next.
+		int64_t first = chunk * search->chunkSamples;
+		int64_t count = std::min(search->chunkSamples, search->samples - 1 - first) + 1;
+		bodies.resize(count * n);
+		days.resize(count * n);
+		positions.resize(3 * count * n);
+		velocities.resize(3 * count * n);
+		for (int64_t k = 0; k < count; k++)
+			for (size_t i = 0; i < n; i++)
+			{
+				bodies[k * n + i] = search->bodies[i];
+				days[k * n + i] = search->firstDay + (first + k) * search->stepDays;
+			}
+		queryBodyStates(search->table, bodies.data(), days.data(), bodies.size(), positions.data(), velocities.data(), 1);
+
+		geometry.resize(count);
+		for (size_t e = 0; e < specs.size(); e++)
+		{
+			const eventSpec &spec = specs[e];
+			int slots[3] = {search->slot[spec.observer], search->slot[spec.occulter], search->slot[spec.target]};
+			for (int64_t k = 0; k < count; k++)
+			{
+				const double *p[3], *v[3];
+				for (int j = 0; j < 3; j++)
+				{
+					p[j] = &positions[3 * (k * n + slots[j])];
+					v[j] = &velocities[3 * (k * n + slots[j])];
+				}
+				measure(*search->s, spec, p, v, geometry[k]);
+			}
+
+			// The gap can close at most this far between two samples. Samples within an event already found are skipped.
+			double eventEnd = -INFINITY;
+			for (int64_t k = 0; k + 1 < count; k++)
+			{
+				double closing = std::max(geometry[k].closing, geometry[k + 1].closing) * search->stepDays;
+				sceneEvent event;
+				if (days[(k + 1) * n] > eventEnd && (gap(geometry[k]) + gap(geometry[k + 1]) - closing) / 2 < 0 &&
+					refine(search, spec, days[k * n], days[(k + 1) * n], event))
+				{
+					found.push_back(event);
+					eventEnd = event.end;
+				}
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(search->mutex);
+	search->events->insert(search->events->end(), found.begin(), found.end());
+}
+
+void observerEventSpecs(const scene &s, int observer, std::vector<eventSpec> &specs)
+{
+	std::vector<int> root(s.count);
+	for (int b = 0; b < s.count; b++)
+		root[b] = s.parent[b] >= 0 ? root[s.parent[b]] : b;
+
+	for (int star = 0; star < s.count; star++)
+	{
+		if (s.parent[star] >= 0 || star == observer)
+			continue;
+		for (int b = 0; b < s.count; b++)
+		{
+			if (b == observer || b == star || root[b] != root[observer])
+				continue;
+			eventSpec passing = {observer, b, star};
+			specs.push_back(passing);
+			if (s.parent[b] == observer)
+			{
+				eventSpec shadow = {b, observer, star};
+				specs.push_back(shadow);
+			}
+		}
+	}
+}
+
+void findEvents(const scene &s, const std::vector<eventSpec> &specs, double firstDay, double lastDay,
+				std::vector<sceneEvent> &events, int threads)
+{
+	events.clear();
+	if (specs.empty() || lastDay <= firstDay)
+		return;
+
+	eventSearch search;
+	search.s = &s;
+	search.specs = &specs;
+	search.slot.assign(s.count, -1);
+	search.stepDays = 0;
+	search.longestPeriod = 0;
+	for (size_t e = 0; e < specs.size(); e++)
+	{
+		int involved[3] = {specs[e].observer, specs[e].occulter, specs[e].target};
+		for (int j = 0; j < 3; j++)
+		{
+			int b = involved[j];
+			if (search.slot[b] >= 0)
+				continue;
+			search.slot[b] = (int)search.bodies.size();
+			search.bodies.push_back(b);
+
+			// A body moves across the sky as fast as anything it orbits with.
+			for (; b >= 0; b = s.parent[b])
+				if (s.period[b] > 0)
+				{
+					double step = s.period[b] * pow(1.0 - s.eccentricity[b], 1.5) / EVENT_SAMPLES_PER_ORBIT;
+					if (search.stepDays == 0 || step < search.stepDays)
+						search.stepDays = step;
+					search.longestPeriod = std::max(search.longestPeriod, (double)s.period[b]);
+				}
+		}
+	}
+	if (search.stepDays == 0)
+		return; // Nothing moves, so nothing passes anything.
+
+	search.table = createOrbitTable(s);
+	search.firstDay = firstDay;
+	search.lastDay = lastDay;
+	search.samples = (int64_t)ceil((lastDay - firstDay) / search.stepDays) + 1;
+	search.chunkSamples = std::max((int64_t)1, (int64_t)(EVENT_BATCH_QUERIES / search.bodies.size()));
+	search.chunks = (search.samples - 1 + search.chunkSamples - 1) / search.chunkSamples;
+	search.nextChunk = 0;
+	search.events = &events;
+
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = (int)std::min((int64_t)threads, search.chunks);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.push_back(std::thread(runSearch, &search));
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	destroyOrbitTable(search.table);
+
+	// An event can be found from both sides of a sample or a chunk edge; keep one of each. The events of one spec
+	// kept do not overlap, so the last of them is the one that ends latest.
+	std::sort(events.begin(), events.end(), [](const sceneEvent &a, const sceneEvent &b) { return a.begin < b.begin; });
+	std::vector<sceneEvent> distinct;
+	std::map<std::tuple<int, int, int>, double> lastEnd; // End of the last event found of each spec.
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const eventSpec &spec = events[i].spec;
+		std::tuple<int, int, int> key(spec.observer, spec.occulter, spec.target);
+		std::map<std::tuple<int, int, int>, double>::iterator last = lastEnd.find(key);
+		if (last != lastEnd.end() && last->second >= events[i].begin - EVENT_TOLERANCE)
+			continue;
+		lastEnd[key] = events[i].end;
+		if (events[i].end >= firstDay && events[i].begin <= lastDay)
+			distinct.push_back(events[i]);
+	}
+	events.swap(distinct);
+}
+
+std::string eventName(const scene &s, const sceneEvent &event)
+{
+	const eventSpec &spec = event.spec;
+	std::string name;
+	if (s.parent[spec.occulter] == spec.observer)
+		name = "solar eclipse";
+	else if (s.parent[spec.observer] == spec.occulter)
+		name = "lunar eclipse";
+	else
+		name = "transit";
+	static const char *kinds[] = {"partial", "total", "central"};
+	return std::string(kinds[event.kind]) + " " + name + " (" + s.name[spec.occulter] + " before " +
+		   s.name[spec.target] + ", from " + s.name[spec.observer] + ")";
+}
@@ -0,0 +1,55 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+// Event search: eclipses and transits over long spans of time.
+//
+// Every event is one body (the occulter) passing in front of another (the
+// target) as seen from a third (the observer): the moon before the sun seen
+// from the earth is a solar eclipse, the earth before the sun seen from the
+// moon a lunar one, Venus before the sun seen from the earth a transit.
+//
+// The span is cut into chunks searched by threads. Each chunk is sampled at a
+// fraction of the shortest period involved; where the gap between the discs,
+// less the most it can close between two samples, could reach zero, the least
+// separation is found by golden-section search and, if the discs touch, the
+// first and last contacts by regula falsi.
+
+#include <string>
+#include <vector>
+
+#include "scene.h"
+
+struct eventSpec
+{
+	int observer, occulter, target;
+};
+
+enum eventKind
+{
+	EVENT_PARTIAL, // The discs overlap.
+	EVENT_TOTAL, // The occulter covers the target.
+	EVENT_CENTRAL // The occulter lies wholly within the target's disc, as in a transit or an annular eclipse.
+};
+
+struct sceneEvent
+{
+	eventSpec spec;
+	double begin, end; // First and last contact, days.
+	double greatest; // Least separation of the centres, days.
+	double separation; // Of the centres then, radians.
+	eventKind kind;
+};
+
+// What to search for as seen from a body: the bodies orbiting with it or around it passing before every body
+// without a parent (its stars), and the body itself shadowing its moons.
+void observerEventSpecs(const scene &s, int observer, std::vector<eventSpec> &specs);
+
+// Find the events of the given specs from firstDay to lastDay, in order of their first contact. Threads 0 means
+// one per core.
+void findEvents(const scene &s, const std::vector<eventSpec> &specs, double firstDay, double lastDay,
+				std::vector<sceneEvent> &events, int threads = 0);
+
+// A short description of an event, such as "total solar eclipse (moon before sun, from earth)".
+std::string eventName(const scene &s, const sceneEvent &event);
+
+#endif
@@ -0,0 +1,210 @@
+// Position export in threads, each writing its chunks in place.
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "export.h"
+#include "solaire.h"
+
+// Body positions evaluated and written per chunk.
+#define EXPORT_CHUNK_QUERIES 65536
+
+// Widest number to_chars() writes for a double, with room to spare.
+#define EXPORT_NUMBER_CHARS 32
+
+struct exportTask
+{
+	const scene *s;
+	orbitTable *table;
+	int fd;
+	exportFormat format;
+	double firstDay, stepDays;
+	uint64_t samples, chunkSamples, chunks;
+	uint64_t dataOffset;
+	size_t longestName;
+	std::atomic<uint64_t> nextChunk; // Chunks are taken in order by whichever thread is free.
+	std::atomic<bool> failed;
+
+	// CSV chunks are placed one after another as they are formatted.
+	std::mutex mutex;
+	std::condition_variable placed;
+	uint64_t placedChunks, placedBytes;
+};
+
+static bool writeAt(int fd, const char *data, size_t size, uint64_t offset)
+{
+	while (size > 0)
+	{
+		ssize_t written = pwrite(fd, data, size, (off_t)offset);
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+static char *appendNumber(char *p, double value)
+{
+	return std::to_chars(p, p + EXPORT_NUMBER_CHARS, value).ptr;
+}
+
+static void runExport(exportTask *task)
+{
+	int n = task->s->count;
+	std::vector<int> bodies;
+	std::vector<double> days, positions;
+	std::vector<char> text;
+	for (;;)
+	{
+		uint64_t chunk = task->nextChunk++;
+		if (chunk >= task->chunks)
+			return;
+		uint64_t first = chunk * task->chunkSamples;
+		uint64_t count = std::min(task->chunkSamples, task->samples - first);
+		size_t queries = (size_t)count * n;
+		bodies.resize(queries);
+		days.resize(queries);
+		positions.resize(3 * queries);
+		for (size_t i = 0; i < queries; i++)
+		{
+			bodies[i] = (int)(i % n);
+			days[i] = task->firstDay + (first + i / n) * task->stepDays;
+		}
+		queryBodyStates(task->table, bodies.data(), days.data(), queries, positions.data(), NULL, 1);
+
+		if (task->format == EXPORT_BINARY)
+		{
+			if (!writeAt(task->fd, (const char *)positions.data(), positions.size() * sizeof(double),
+						 task->dataOffset + first * n * 3 * sizeof(double)))
+				task->failed = true;
+			continue;
+		}
+
+		text.resize(queries * (4 * (EXPORT_NUMBER_CHARS + 1) + task->longestName + 1));
+		char *p = text.data();
+		for (size_t i = 0; i < queries; i++)
+		{
+			p = appendNumber(p, days[i]);
+			*p++ = ',';
+			const std::string &name = task->s->name[bodies[i]];
+			memcpy(p, name.data(), name.size());
+			p += name.size();
+			for (int c = 0; c < 3; c++)
+			{
+				*p++ = ',';
+				p = appendNumber(p, positions[3 * i + c]);
+			}
+			*p++ = '\n';
+		}
+		size_t length = p - text.data();
+
+		// Take the bytes after the previous chunk's; only its formatting is waited for, not its write.
+		uint64_t offset;
+		{
+			std::unique_lock<std::mutex> lock(task->mutex);
+			task->placed.wait(lock, [task, chunk] { return task->placedChunks == chunk; });
+			offset = task->placedBytes;
+			task->placedBytes += length;
+			task->placedChunks++;
+		}
+		task->placed.notify_all();
+		if (!writeAt(task->fd, text.data(), length, offset))
+			task->failed = true;
+	}
+}
+
+bool exportPositions(std::string fileName, const scene &s, double firstDay, double lastDay, double stepDays,
+					 exportFormat format, int threads)
+{
+	if (s.count <= 0 || stepDays <= 0 || lastDay < firstDay)
+	{
+		std::cerr << fileName << ": nothing to export" << std::endl;
+		return false;
+	}
+
+	int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		std::cerr << fileName << ": cannot create export file" << std::endl;
+		return false;
+	}
+
+	exportTask task;
+	task.s = &s;
+	task.table = createOrbitTable(s);
+	task.fd = fd;
+	task.format = format;
+	task.firstDay = firstDay;
+	task.stepDays = stepDays;
+	task.samples = (uint64_t)((lastDay - firstDay) / stepDays) + 1;
+	task.chunkSamples = std::max(1, EXPORT_CHUNK_QUERIES / s.count);
+	task.chunks = (task.samples + task.chunkSamples - 1) / task.chunkSamples;
+	task.longestName = 0;
+	for (int b = 0; b < s.count; b++)
+		task.longestName = std::max(task.longestName, s.name[b].size());
+	task.nextChunk = 0;
+	task.failed = false;
+	task.placedChunks = 0;
+
+	bool ready;
+	if (format == EXPORT_BINARY)
+	{
+		exportHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, EXPORT_MAGIC, 4);
+		header.version = EXPORT_VERSION;
+		header.bodies = s.count;
+		header.firstDay = firstDay;
+		header.stepDays = stepDays;
+		header.samples = task.samples;
+		header.dataOffset = sizeof(header);
+		task.dataOffset = header.dataOffset;
+
+		// Reserve the whole file first, so the chunks fill in blocks that are already there.
+		off_t size = (off_t)(header.dataOffset + task.samples * s.count * 3 * sizeof(double));
+		ready = (posix_fallocate(fd, 0, size) == 0 || ftruncate(fd, size) == 0) &&
+				writeAt(fd, (const char *)&header, sizeof(header), 0);
+	}
+	else
+	{
+		const char *columns = "day,body,x,y,z\n";
+		task.placedBytes = strlen(columns);
+		ready = writeAt(fd, columns, task.placedBytes, 0);
+	}
+
+	if (ready)
+	{
+		if (threads <= 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (int)std::min((uint64_t)threads, task.chunks);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+			workers.push_back(std::thread(runExport, &task));
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+	destroyOrbitTable(task.table);
+
+	if (close(fd) != 0 || !ready || task.failed)
+	{
+		std::cerr << fileName << ": cannot write export file" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::string exportFileName(std::string sceneName, exportFormat format)
+{
+	return sceneSiblingName(sceneName, format == EXPORT_CSV ? ".csv" : ".pos");
+}
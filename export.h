@@ -0,0 +1,55 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+// Position export: every body of a scene at evenly spaced times, written for
+// downstream tools by solaire-sim -x.
+//
+// The time range is cut into chunks of samples that threads evaluate in batch
+// (see solaire.h) and write straight into their own region of the output
+// file with pwrite(), so no thread waits on another's disk writes.
+//
+// Binary layout:
+//   exportHeader
+//   from dataOffset, for each sample in time order, for each body, x y z (doubles)
+// A binary file's size is known in advance, so every chunk's place in it is too.
+//
+// CSV: a "day,body,x,y,z" header line, then one line per body per sample, in
+// the same order, numbers in their shortest exact form. A chunk's place is
+// known once the chunk before it has been formatted, which is all the threads
+// wait on.
+
+#include <stdint.h>
+#include <string>
+
+#include "scene.h"
+
+#define EXPORT_MAGIC "SLPX"
+#define EXPORT_VERSION 1
+
+enum exportFormat
+{
+	EXPORT_BINARY,
+	EXPORT_CSV
+};
+
+struct exportHeader
+{
+	char magic[4]; // EXPORT_MAGIC.
+	uint32_t version; // EXPORT_VERSION.
+	uint32_t bodies;
+	uint32_t reserved;
+	double firstDay;
+	double stepDays;
+	uint64_t samples;
+	uint64_t dataOffset; // Byte offset of the first sample.
+};
+
+// Write the positions of every body from firstDay to lastDay, every stepDays. Threads 0 means one per core.
+// Returns false (after reporting why) on failure.
+bool exportPositions(std::string fileName, const scene &s, double firstDay, double lastDay, double stepDays,
+					 exportFormat format, int threads = 0);
+
+// Name of the export of a scene: the scene's name with its extension replaced by .pos or .csv.
+std::string exportFileName(std::string sceneName, exportFormat format);
+
+#endif
@@ -0,0 +1,80 @@
+// Frame timing with GPU timer queries.
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <algorithm>
+#include <chrono>
+#include <GL/glut.h>
+
+#include "frametimer.h"
+#include "texture.h"
+
+// Frames that may be in flight before their query is read. Past this a frame
+// goes untimed rather than waiting for the oldest result.
+#define FRAMETIMER_QUERIES 4
+
+struct frameTimer
+{
+	bool gpu; // ARB_timer_query is available.
+	GLuint queries[FRAMETIMER_QUERIES];
+	double cpuMs[FRAMETIMER_QUERIES]; // CPU time of the frame each query times.
+	int first, count; // Ring of queries waiting for their result.
+	bool timing; // The current frame has a query running.
+	std::chrono::steady_clock::time_point start;
+};
+
+frameTimer *createFrameTimer(void)
+{
+	frameTimer *timer = new frameTimer;
+	timer->gpu = hasExtension("GL_ARB_timer_query");
+	if (timer->gpu)
+		glGenQueries(FRAMETIMER_QUERIES, timer->queries);
+	timer->first = timer->count = 0;
+	timer->timing = false;
+	return timer;
+}
+
+void destroyFrameTimer(frameTimer *timer)
+{
+	if (timer->gpu)
+		glDeleteQueries(FRAMETIMER_QUERIES, timer->queries);
+	delete timer;
+}
+
+void beginFrameTimer(frameTimer *timer)
+{
+	timer->start = std::chrono::steady_clock::now();
+	timer->timing = timer->gpu && timer->count < FRAMETIMER_QUERIES;
+	if (timer->timing)
+		glBeginQuery(GL_TIME_ELAPSED, timer->queries[(timer->first + timer->count) % FRAMETIMER_QUERIES]);
+}
+
+double endFrameTimer(frameTimer *timer)
+{
+	double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timer->start).count();
+	if (!timer->gpu)
+		return cpuMs;
+
+	if (timer->timing)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		timer->cpuMs[(timer->first + timer->count) % FRAMETIMER_QUERIES] = cpuMs;
+		timer->count++;
+		timer->timing = false;
+	}
+
+	// Results arrive in order, so only the oldest query needs asking.
+	if (timer->count == 0)
+		return -1;
+	GLuint query = timer->queries[timer->first];
+	GLint available = 0;
+	glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return -1;
+	GLuint64 gpuNs = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNs);
+	double frameMs = std::max(timer->cpuMs[timer->first], gpuNs / 1e6);
+	timer->first = (timer->first + 1) % FRAMETIMER_QUERIES;
+	timer->count--;
+	return frameMs;
+}
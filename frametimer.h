@@ -0,0 +1,24 @@
+#ifndef FRAMETIMER_H
+#define FRAMETIMER_H
+
+// Frame timing without stalling the pipeline.
+//
+// Each frame is timed on the GPU with a GL_TIME_ELAPSED query and on the CPU
+// from its start to the last command issued; its time is the longer of the two.
+// Query results are read only once available, a frame or two later, so nothing
+// waits on the GPU. Without ARB_timer_query only the CPU time is measured.
+
+struct frameTimer;
+
+frameTimer *createFrameTimer(void);
+void destroyFrameTimer(frameTimer *timer);
+
+// Start timing a frame, before its first GL command.
+void beginFrameTimer(frameTimer *timer);
+
+// Stop timing the frame, before the buffers are swapped. Returns the time in
+// milliseconds of the oldest frame whose time is now known, or a negative value
+// if none has finished since the last call.
+double endFrameTimer(frameTimer *timer);
+
+#endif
@@ -0,0 +1,284 @@
+// Galaxy mode: the star catalog, its grid, and expansion of nearby systems.
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <GL/glut.h>
+
+#include "galaxy.h"
+#include "scene.h"
+
+// Expanded systems are dropped this far beyond the expansion distance, so that
+// a camera hovering at the edge does not load and drop a system every frame.
+#define GALAXY_COLLAPSE_FACTOR 1.25f
+
+// Scene files read per frame, so that flying into a cluster never stalls a frame.
+#define GALAXY_EXPANSIONS_PER_FRAME 1
+
+// Systems held expanded at once, nearest first.
+#define GALAXY_MAX_EXPANDED 16
+
+struct expandedSystem
+{
+	int system; // Index in the catalog.
+	scene bodies;
+	std::vector<float> positions; // Of the bodies, relative to the star, at the last evaluation.
+	unsigned long evaluated; // Frame of the last evaluation.
+};
+
+struct galaxy
+{
+	// The catalog, one entry per system. Positions and colours are three floats each, drawn straight from these arrays.
+	std::vector<std::string> name;
+	std::vector<float> position, color;
+	std::vector<std::string> sceneFile; // Empty for systems drawn only as a point.
+	std::vector<int> expandedSlot; // Index in expanded, -1 when not expanded.
+
+	float expandDistance;
+	std::unordered_map<uint64_t, std::vector<int> > cells; // Systems in each grid cell, expandDistance on a side.
+
+	std::vector<expandedSystem *> expanded;
+	unsigned long frame;
+	galaxyStats stats;
+};
+
+static int64_t cellOf(const galaxy *g, float x)
+{
+	return (int64_t)floorf(x / g->expandDistance);
+}
+
+static uint64_t cellKey(int64_t cx, int64_t cy, int64_t cz)
+{
+	const int64_t mask = (1 << 21) - 1;
+	return ((uint64_t)(cx & mask) << 42) | ((uint64_t)(cy & mask) << 21) | (uint64_t)(cz & mask);
+}
+
+galaxy *createGalaxy(std::string fileName, float expandDistance)
+{
+	std::ifstream inFile(fileName.c_str());
+	if (!inFile)
+	{
+		std::cerr << fileName << ": cannot read catalog" << std::endl;
+		return NULL;
+	}
+
+	galaxy *g = new galaxy;
+	g->expandDistance = expandDistance;
+	g->frame = 0;
+	std::string line;
+	for (int lineNumber = 1; std::getline(inFile, line); lineNumber++)
+	{
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream in(line);
+		std::string key, name, sceneFile;
+		float p[3], c[3];
+		if (!(in >> key))
+			continue;
+		if (key != "system" || !(in >> name >> p[0] >> p[1] >> p[2] >> c[0] >> c[1] >> c[2]))
+		{
+			std::cerr << fileName << ":" << lineNumber << ": expected system <name> <x> <y> <z> <r> <g> <b> [scene]" << std::endl;
+			delete g;
+			return NULL;
+		}
+		in >> sceneFile;
+
+		int system = (int)g->name.size();
+		g->name.push_back(name);
+		g->position.insert(g->position.end(), p, p + 3);
+		g->color.insert(g->color.end(), c, c + 3);
+		g->sceneFile.push_back(sceneFile);
+		g->expandedSlot.push_back(-1);
+		g->cells[cellKey(cellOf(g, p[0]), cellOf(g, p[1]), cellOf(g, p[2]))].push_back(system);
+	}
+
+	g->stats.systems = (int)g->name.size();
+	g->stats.expanded = g->stats.animated = 0;
+	g->stats.expansions = g->stats.collapses = 0;
+	return g;
+}
+
+void destroyGalaxy(galaxy *g)
+{
+	for (size_t i = 0; i < g->expanded.size(); i++)
+		delete g->expanded[i];
+	delete g;
+}
+
+static float distanceTo(const galaxy *g, int system, const float eye[3])
+{
+	const float *p = &g->position[3 * system];
+	float dx = p[0] - eye[0], dy = p[1] - eye[1], dz = p[2] - eye[2];
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static void collapse(galaxy *g, size_t slot)
+{
+	expandedSystem *e = g->expanded[slot];
+	g->expandedSlot[e->system] = -1;
+	delete e;
+	g->expanded[slot] = g->expanded.back();
+	g->expanded.pop_back();
+	if (slot < g->expanded.size())
+		g->expandedSlot[g->expanded[slot]->system] = (int)slot;
+	g->stats.collapses++;
+}
+
+// The expanded system farthest from the eye, and its distance.
+static size_t farthestExpanded(const galaxy *g, const float eye[3], float &distance)
+{
+	size_t farthest = 0;
+	distance = -1;
+	for (size_t slot = 0; slot < g->expanded.size(); slot++)
+	{
+		float d = distanceTo(g, g->expanded[slot]->system, eye);
+		if (d > distance)
+		{
+			distance = d;
+			farthest = slot;
+		}
+	}
+	return farthest;
+}
+
+// Expand the nearest systems within range, a few per frame, in place of farther ones once
+// GALAXY_MAX_EXPANDED are. Returns how many are left to expand.
+static int expandNearby(galaxy *g, const float eye[3])
+{
+	std::vector<std::pair<float, int> > wanted;
+	int64_t cx = cellOf(g, eye[0]), cy = cellOf(g, eye[1]), cz = cellOf(g, eye[2]);
+	for (int64_t x = cx - 1; x <= cx + 1; x++)
+		for (int64_t y = cy - 1; y <= cy + 1; y++)
+			for (int64_t z = cz - 1; z <= cz + 1; z++)
+			{
+				std::unordered_map<uint64_t, std::vector<int> >::const_iterator cell = g->cells.find(cellKey(x, y, z));
+				if (cell == g->cells.end())
+					continue;
+				for (size_t i = 0; i < cell->second.size(); i++)
+				{
+					int system = cell->second[i];
+					if (g->expandedSlot[system] >= 0 || g->sceneFile[system].empty())
+						continue;
+					float distance = distanceTo(g, system, eye);
+					if (distance < g->expandDistance)
+						wanted.push_back(std::make_pair(distance, system));
+				}
+			}
+	std::sort(wanted.begin(), wanted.end());
+
+	size_t next = 0;
+	for (int n = 0; n < GALAXY_EXPANSIONS_PER_FRAME && next < wanted.size(); n++)
+	{
+		// At the cap, a nearer system takes the place of the farthest expanded one.
+		if (g->expanded.size() >= GALAXY_MAX_EXPANDED)
+		{
+			float farthest;
+			size_t slot = farthestExpanded(g, eye, farthest);
+			if (wanted[next].first >= farthest)
+				break;
+			collapse(g, slot);
+		}
+		int system = wanted[next++].second;
+		expandedSystem *e = new expandedSystem;
+		if (!loadScene(g->sceneFile[system], e->bodies))
+		{
+			g->sceneFile[system].clear(); // Reported once; a point from now on.
+			delete e;
+			continue;
+		}
+		e->system = system;
+		e->evaluated = 0;
+		g->expandedSlot[system] = (int)g->expanded.size();
+		g->expanded.push_back(e);
+		g->stats.expansions++;
+	}
+	if (g->expanded.size() < GALAXY_MAX_EXPANDED || next == wanted.size())
+		return (int)(wanted.size() - next);
+	float farthest;
+	farthestExpanded(g, eye, farthest);
+	size_t waiting = next;
+	while (waiting < wanted.size() && wanted[waiting].first < farthest)
+		waiting++;
+	return (int)(waiting - next);
+}
+
+int drawGalaxy(galaxy *g, double days, int slices)
+{
+	g->frame++;
+
+	// The camera is where the modelview takes to the eye-space origin: -R^T t.
+	GLfloat m[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, m);
+	float eye[3];
+	for (int i = 0; i < 3; i++)
+		eye[i] = -(m[4 * i] * m[12] + m[4 * i + 1] * m[13] + m[4 * i + 2] * m[14]);
+
+	for (size_t slot = g->expanded.size(); slot-- > 0;)
+		if (distanceTo(g, g->expanded[slot]->system, eye) > g->expandDistance * GALAXY_COLLAPSE_FACTOR)
+			collapse(g, slot);
+	int waiting = expandNearby(g, eye);
+
+	glPushAttrib(GL_ENABLE_BIT | GL_POINT_BIT | GL_CURRENT_BIT | GL_LIGHTING_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glPointSize(2.0);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, g->position.data());
+	glColorPointer(3, GL_FLOAT, 0, g->color.data());
+	glDrawArrays(GL_POINTS, 0, g->stats.systems);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	GLUquadric *quad = gluNewQuadric();
+	const GLfloat origin[] = {0.0f, 0.0f, 0.0f, 1.0f};
+	g->stats.animated = 0;
+	for (size_t slot = 0; slot < g->expanded.size(); slot++)
+	{
+		expandedSystem *e = g->expanded[slot];
+		const float *p = &g->position[3 * e->system];
+
+		// Orbits are evaluated every frame close by, every 4th and 16th frame farther out, and not at all near the edge.
+		int band = (int)(4 * distanceTo(g, e->system, eye) / g->expandDistance);
+		unsigned long interval = 1ul << (2 * band);
+		if (e->positions.empty() || (band < 3 && g->frame - e->evaluated >= interval))
+		{
+			scenePositions(e->bodies, days, e->positions);
+			e->evaluated = g->frame;
+			g->stats.animated++;
+		}
+
+		glPushMatrix();
+		glTranslatef(p[0], p[1], p[2]);
+		glLightfv(GL_LIGHT0, GL_POSITION, origin); // Lit by its own star.
+		for (int b = 0; b < e->bodies.count; b++)
+		{
+			glPushMatrix();
+			glTranslatef(e->positions[3 * b], e->positions[3 * b + 1], e->positions[3 * b + 2]);
+			glColor3fv(&e->bodies.color[3 * b]);
+			if (e->bodies.parent[b] < 0)
+				glDisable(GL_LIGHTING); // Stars shine.
+			else
+				glEnable(GL_LIGHTING);
+			gluSphere(quad, e->bodies.radius[b], slices, slices);
+			glPopMatrix();
+		}
+		glPopMatrix();
+	}
+	gluDeleteQuadric(quad);
+	glPopAttrib(); // Also puts the light back at the home system.
+
+	g->stats.expanded = (int)g->expanded.size();
+	return waiting;
+}
+
+void getGalaxyStats(const galaxy *g, galaxyStats &stats)
+{
+	stats = g->stats;
+}
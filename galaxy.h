@@ -0,0 +1,45 @@
+#ifndef GALAXY_H
+#define GALAXY_H
+
+// Galaxy mode: a catalog of star systems around the home system.
+//
+// Every system in the catalog is drawn as a single star point. Systems near
+// the camera are expanded into their full body hierarchy, read from their
+// scene file on demand, and dropped again once the camera moves away. The
+// orbits of expanded systems are evaluated less often the farther away they
+// are, and not at all near the edge of the expansion range. Systems are
+// found through a uniform grid, so memory and per-frame work grow with the
+// number of systems near the camera rather than with the size of the catalog.
+//
+// Catalog format: '#' starts a comment, and each other line is one system:
+//
+//    system <name> <x> <y> <z> <r> <g> <b> [scene]
+//
+// position in scene units, star colour, and optionally the scene file of its
+// bodies (see scene.h). Systems without a scene are only ever drawn as a point.
+
+#include <string>
+
+struct galaxy;
+
+struct galaxyStats
+{
+	int systems; // In the catalog.
+	int expanded; // Held with their bodies.
+	int animated; // Expanded systems whose orbits were evaluated this frame.
+	int expansions, collapses; // Since the catalog was loaded.
+};
+
+// Read a catalog. Systems are expanded within expandDistance of the camera. NULL if the catalog cannot be read.
+galaxy *createGalaxy(std::string fileName, float expandDistance);
+void destroyGalaxy(galaxy *g);
+
+// Draw the star points and the expanded systems at the given time in days, with
+// spheres of the given slices and stacks, around the camera of the current
+// modelview. Returns the number of systems still waiting to be expanded, which
+// later frames will do.
+int drawGalaxy(galaxy *g, double days, int slices);
+
+void getGalaxyStats(const galaxy *g, galaxyStats &stats);
+
+#endif
@@ -1,77 +1,253 @@
-// Routine to read an uncompressed 24-bit unindexed color RGB BMP file into a
-// 32-bit color RGBA image file (alpha values all being set to 1).
-
-#include <fstream>
-
-#include "getBMP.h"
-
-imageFile *getBMP(std::string fileName)
-{
-	int offset, // No. of bytes to start of image data in input BMP file.
-		w, // Width in pixels of input BMP file.
-		h; // Height in pixels of input BMP file.
-
-		   // Initialize imageFile objects.
-	imageFile *tempStore = new imageFile; // Temporary storage.
-	imageFile *outRGB = new imageFile; // RGB output file.
-	imageFile *outRGBA = new imageFile; // RGBA output file.
-
-										// Initialize input stream.
-	std::ifstream inFile(fileName.c_str(), std::ios::binary);
-
-	// Get start point of image data in input BMP file.
-	inFile.seekg(10);
-	inFile.read((char *)&offset, 4);
-
-	// Get image width and height.
-	inFile.seekg(18);
-	inFile.read((char *)&w, 4);
-	inFile.read((char *)&h, 4);
-
-	// Determine the length of padding of the pixel rows
-	// (each pixel row of a BMP file is 4-byte aligned by padding with zero bytes).
-	int padding = (3 * w) % 4 ? 4 - (3 * w) % 4 : 0;
-
-	// Allocate storage for temporary input file, read in image data from the BMP file, close input stream.
-	tempStore->data = new unsigned char[(3 * w + padding) * h];
-	inFile.seekg(offset);
-	inFile.read((char *)tempStore->data, (3 * w + padding) * h);
-	inFile.close();
-
-	// Set image width and height and allocate storage for image in output RGB file.
-	outRGB->width = w;
-	outRGB->height = h;
-	outRGB->data = new unsigned char[3 * w * h];
-
-	// Copy data from temporary input file to output RGB file adjusting for padding and performing BGR to RGB conversion.
-	int tempStorePos = 0;
-	int outRGBpos = 0;
-	for (int j = 0; j < h; j++)
-		for (int i = 0; i < 3 * w; i += 3)
-		{
-			tempStorePos = (3 * w + padding) * j + i;
-			outRGBpos = 3 * w * j + i;
-			outRGB->data[outRGBpos] = tempStore->data[tempStorePos + 2];
-			outRGB->data[outRGBpos + 1] = tempStore->data[tempStorePos + 1];
-			outRGB->data[outRGBpos + 2] = tempStore->data[tempStorePos];
-		}
-
-	// Set image width and height and allocate storage for image in output RGBA file.
-	outRGBA->width = w;
-	outRGBA->height = h;
-	outRGBA->data = new unsigned char[4 * w * h];
-
-	// Copy image data from output RGB file to output RGBA file, setting all A values to 1.
-	for (int j = 0; j < 4 * w * h; j += 4)
-	{
-		outRGBA->data[j] = outRGB->data[(j / 4) * 3];
-		outRGBA->data[j + 1] = outRGB->data[(j / 4) * 3 + 1];
-		outRGBA->data[j + 2] = outRGB->data[(j / 4) * 3 + 2];
-		outRGBA->data[j + 3] = 0xFF;
-	}
-
-	// Release temporary storage and the output RGB file and return the RGBA version.
-	delete tempStore;
-	delete outRGB;
-	return outRGBA;
-}
+// Routine to read an uncompressed 8-bit (palette), 24-bit or 32-bit BMP file,
+// bottom-up or top-down, into a 32-bit color RGBA image file (alpha values
+// being set to 1 unless the file carries an alpha channel).
+//
+// The pixel rows are streamed through a bounded buffer straight into the
+// output image, so decoding needs about one output image of memory whatever
+// the size of the file.
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <stdint.h>
+#include <vector>
+
+#include "getBMP.h"
+
+// Bytes of pixel rows read from the file at a time.
+#define BMP_CHUNK_BYTES (1 << 20)
+
+// Compression types of the info header.
+#define BMP_RGB 0
+#define BMP_BITFIELDS 3
+
+static uint32_t readLE32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t readLE16(const unsigned char *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Position of an 8-bit wide channel mask, or -1 if the mask is not one whole byte.
+static int maskShift(uint32_t mask)
+{
+	for (int shift = 0; shift <= 24; shift += 8)
+		if (mask == (uint32_t)0xFF << shift)
+			return shift;
+	return -1;
+}
+
+// Per-format row conversions to RGBA.
+static void convertRow8(const unsigned char *in, unsigned char *out, int w, const uint32_t *palette)
+{
+	uint32_t *out32 = (uint32_t *)out;
+	for (int i = 0; i < w; i++)
+		out32[i] = palette[in[i]];
+}
+
+static void convertRow24(const unsigned char *in, unsigned char *out, int w)
+{
+	for (int i = 0; i < w; i++, in += 3, out += 4)
+	{
+		out[0] = in[2];
+		out[1] = in[1];
+		out[2] = in[0];
+		out[3] = 0xFF;
+	}
+}
+
+static void convertRow32(const unsigned char *in, unsigned char *out, int w, const int shift[4])
+{
+	const uint32_t *in32 = (const uint32_t *)in;
+	for (int i = 0; i < w; i++, out += 4)
+	{
+		uint32_t v = in32[i];
+		out[0] = (unsigned char)(v >> shift[0]);
+		out[1] = (unsigned char)(v >> shift[1]);
+		out[2] = (unsigned char)(v >> shift[2]);
+		out[3] = shift[3] < 0 ? 0xFF : (unsigned char)(v >> shift[3]);
+	}
+}
+
+imageFile *getBMP(std::string fileName)
+{
+	std::ifstream inFile(fileName.c_str(), std::ios::binary | std::ios::ate);
+	if (!inFile)
+	{
+		std::cerr << fileName << ": cannot open" << std::endl;
+		return NULL;
+	}
+	uint64_t fileSize = (uint64_t)inFile.tellg();
+	inFile.seekg(0);
+
+	// File header (14 bytes) and the common part of every info header version (40 bytes),
+	// followed by the bit field masks of BITMAPV4HEADER and later, if present.
+	unsigned char header[70] = {0};
+	inFile.read((char *)header, 54);
+	if (!inFile || header[0] != 'B' || header[1] != 'M')
+	{
+		std::cerr << fileName << ": not a BMP file" << std::endl;
+		return NULL;
+	}
+
+	uint32_t offset = readLE32(header + 10); // No. of bytes to start of image data.
+	uint32_t infoSize = readLE32(header + 14);
+	int32_t w = (int32_t)readLE32(header + 18); // Width in pixels.
+	int32_t h = (int32_t)readLE32(header + 22); // Height in pixels, negative for top-down rows.
+	uint16_t bpp = readLE16(header + 28);
+	uint32_t compression = readLE32(header + 30);
+	uint32_t colorsUsed = readLE32(header + 46);
+
+	bool topDown = h < 0;
+	uint64_t height = topDown ? -(int64_t)h : h;
+	if (infoSize < 40 || w <= 0 || height == 0 || height > 0x7FFFFFFF || (bpp != 8 && bpp != 24 && bpp != 32) ||
+		!(compression == BMP_RGB || (compression == BMP_BITFIELDS && bpp == 32)))
+	{
+		std::cerr << fileName << ": unsupported BMP (" << bpp << " bits per pixel, compression " << compression << ")" << std::endl;
+		return NULL;
+	}
+
+	// Each pixel row of a BMP file is 4-byte aligned by padding with zero bytes.
+	uint64_t rowBytes = ((uint64_t)w * bpp / 8 + 3) & ~(uint64_t)3;
+	if (offset > fileSize || rowBytes * height > fileSize - offset)
+	{
+		std::cerr << fileName << ": truncated BMP" << std::endl;
+		return NULL;
+	}
+
+	// Channel layout of 32-bit pixels: BGRX by default, or as given by the bit field masks.
+	int shift[4] = {16, 8, 0, -1};
+	if (compression == BMP_BITFIELDS)
+	{
+		inFile.read((char *)header + 54, 16);
+		uint32_t alphaMask = infoSize >= 56 ? readLE32(header + 66) : 0;
+		shift[0] = maskShift(readLE32(header + 54));
+		shift[1] = maskShift(readLE32(header + 58));
+		shift[2] = maskShift(readLE32(header + 62));
+		shift[3] = alphaMask ? maskShift(alphaMask) : -1;
+		if (shift[0] < 0 || shift[1] < 0 || shift[2] < 0 || (alphaMask && shift[3] < 0))
+		{
+			std::cerr << fileName << ": unsupported BMP bit fields" << std::endl;
+			return NULL;
+		}
+	}
+
+	// Palette of 8-bit files, expanded to RGBA once.
+	uint32_t palette[256] = {0};
+	if (bpp == 8)
+	{
+		uint32_t colors = colorsUsed ? colorsUsed : 256;
+		if (colors > 256)
+		{
+			std::cerr << fileName << ": corrupt BMP palette" << std::endl;
+			return NULL;
+		}
+		unsigned char entries[4 * 256];
+		inFile.seekg(14 + infoSize);
+		inFile.read((char *)entries, 4 * colors);
+		for (uint32_t i = 0; i < colors; i++)
+		{
+			unsigned char rgba[4] = {entries[4 * i + 2], entries[4 * i + 1], entries[4 * i], 0xFF};
+			memcpy(&palette[i], rgba, 4);
+		}
+	}
+
+	uint64_t outBytes = 4 * (uint64_t)w * height;
+	unsigned char *outData = NULL;
+	if (w > IMAGE_MAX_SIDE || height > IMAGE_MAX_SIDE || !(outData = new (std::nothrow) unsigned char[outBytes]))
+	{
+		std::cerr << fileName << ": image too large" << std::endl;
+		return NULL;
+	}
+
+	imageFile *outRGBA = new imageFile; // RGBA output file.
+	outRGBA->width = w;
+	outRGBA->height = (int)height;
+	outRGBA->data = outData;
+
+	// Stream whole rows through the chunk buffer, writing each one to its bottom-up position in the output.
+	uint64_t rowsPerChunk = rowBytes < BMP_CHUNK_BYTES ? BMP_CHUNK_BYTES / rowBytes : 1;
+	std::vector<unsigned char> chunk(rowsPerChunk * rowBytes);
+	size_t outPitch = 4 * (size_t)w;
+	inFile.seekg(offset);
+	for (uint64_t row = 0; row < height; row += rowsPerChunk)
+	{
+		uint64_t rows = height - row < rowsPerChunk ? height - row : rowsPerChunk;
+		if (!inFile.read((char *)chunk.data(), rows * rowBytes))
+		{
+			std::cerr << fileName << ": read error" << std::endl;
+			delete[] outRGBA->data;
+			delete outRGBA;
+			return NULL;
+		}
+
+		for (uint64_t r = 0; r < rows; r++)
+		{
+			const unsigned char *in = &chunk[r * rowBytes];
+			uint64_t y = topDown ? height - 1 - (row + r) : row + r;
+			unsigned char *out = outRGBA->data + outPitch * y;
+			switch (bpp)
+			{
+			case 8:
+				convertRow8(in, out, w, palette);
+				break;
+			case 24:
+				convertRow24(in, out, w);
+				break;
+			case 32:
+				convertRow32(in, out, w, shift);
+				break;
+			}
+		}
+	}
+
+	return outRGBA;
+}
+
+bool writeBMP(std::string fileName, const imageFile *image)
+{
+	int w = image->width, h = image->height;
+	uint32_t rowBytes = (3 * (uint32_t)w + 3) & ~3u;
+	uint64_t fileBytes = 54 + (uint64_t)rowBytes * h;
+	if (fileBytes > 0xFFFFFFFFu)
+	{
+		std::cerr << fileName << ": image too large for a BMP file" << std::endl;
+		return false;
+	}
+
+	unsigned char header[54];
+	memset(header, 0, sizeof(header));
+	uint32_t fields[][2] = {{2, (uint32_t)fileBytes}, {10, 54}, {14, 40}, {18, (uint32_t)w}, {22, (uint32_t)h}, {34, rowBytes * (uint32_t)h}};
+	header[0] = 'B';
+	header[1] = 'M';
+	for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+		for (int b = 0; b < 4; b++)
+			header[fields[i][0] + b] = (unsigned char)(fields[i][1] >> (8 * b));
+	header[26] = 1; // Planes.
+	header[28] = 24; // Bits per pixel.
+
+	std::ofstream outFile(fileName.c_str(), std::ios::binary);
+	outFile.write((const char *)header, sizeof(header));
+	std::vector<unsigned char> row(rowBytes, 0);
+	for (int y = 0; y < h && outFile; y++)
+	{
+		const unsigned char *in = image->data + 4 * (size_t)w * y;
+		for (int x = 0; x < w; x++, in += 4)
+		{
+			row[3 * x] = in[2];
+			row[3 * x + 1] = in[1];
+			row[3 * x + 2] = in[0];
+		}
+		outFile.write((const char *)row.data(), rowBytes);
+	}
+	if (!outFile)
+	{
+		std::cerr << fileName << ": cannot write BMP file" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -1,15 +1,25 @@
-#ifndef GETBMP_H
-#define GETBMP_H
-
-#include <string>
-
-struct imageFile
-{
-	int width;
-	int height;
-	unsigned char *data;
-};
-
-imageFile *getBMP(std::string fileName);
-
-#endif
+#ifndef GETBMP_H
+#define GETBMP_H
+
+#include <string>
+
+struct imageFile
+{
+	int width;
+	int height;
+	unsigned char *data;
+};
+
+// Largest width or height the decoders accept. Anything bigger is reported as
+// too large rather than attempted, since the output alone would be gigabytes.
+#define IMAGE_MAX_SIDE (1 << 15)
+
+// Read a BMP file into an RGBA image, bottom row first. Returns NULL (after
+// reporting why) if the file cannot be read or is not a supported BMP.
+imageFile *getBMP(std::string fileName);
+
+// Write an RGBA image, bottom row first, as a 24-bit BMP file (dropping alpha).
+// Returns false (after reporting why) if the file cannot be written.
+bool writeBMP(std::string fileName, const imageFile *image);
+
+#endif
@@ -0,0 +1,143 @@
+// Image format dispatch and parallel decoding of several files.
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <thread>
+
+#include "getImage.h"
+#include "getJPEG.h"
+#include "getPNG.h"
+
+enum imageFormat
+{
+	FORMAT_UNKNOWN,
+	FORMAT_BMP,
+	FORMAT_JPEG,
+	FORMAT_PNG
+};
+
+static imageFormat imageFormatOf(std::string fileName)
+{
+	unsigned char magic[4] = {0, 0, 0, 0};
+	std::ifstream inFile(fileName.c_str(), std::ios::binary);
+	inFile.read((char *)magic, 4);
+
+	if (magic[0] == 'B' && magic[1] == 'M')
+		return FORMAT_BMP;
+	if (magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF)
+		return FORMAT_JPEG;
+	if (magic[0] == 0x89 && magic[1] == 'P' && magic[2] == 'N' && magic[3] == 'G')
+		return FORMAT_PNG;
+	return FORMAT_UNKNOWN;
+}
+
+bool isImageFile(std::string fileName)
+{
+	return imageFormatOf(fileName) != FORMAT_UNKNOWN;
+}
+
+static uint32_t readBE16(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+bool getImageSize(std::string fileName, int &width, int &height)
+{
+	std::ifstream inFile(fileName.c_str(), std::ios::binary);
+	unsigned char header[26];
+	imageFormat format = imageFormatOf(fileName);
+	if (format == FORMAT_UNKNOWN || !inFile.read((char *)header, sizeof(header)))
+		return false;
+
+	switch (format)
+	{
+	case FORMAT_BMP:
+	{
+		int32_t w, h;
+		memcpy(&w, header + 18, 4);
+		memcpy(&h, header + 22, 4);
+		width = w;
+		height = h < 0 ? -h : h;
+		return true;
+	}
+	case FORMAT_PNG:
+		width = (int)((readBE16(header + 16) << 16) | readBE16(header + 18));
+		height = (int)((readBE16(header + 20) << 16) | readBE16(header + 22));
+		return true;
+	default:
+		break;
+	}
+
+	// JPEG: walk the marker segments up to the frame header.
+	unsigned char marker[9];
+	inFile.seekg(2);
+	while (inFile.read((char *)marker, 4) && marker[0] == 0xFF)
+	{
+		int type = marker[1];
+		bool frame = type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC;
+		if (frame)
+		{
+			if (!inFile.read((char *)marker + 4, 5))
+				return false;
+			height = (int)readBE16(marker + 5);
+			width = (int)readBE16(marker + 7);
+			return true;
+		}
+		inFile.seekg(readBE16(marker + 2) - 2, std::ios::cur);
+	}
+	return false;
+}
+
+// Decode with the given number of threads inside the image, where the format allows it.
+static imageFile *decodeImage(std::string fileName, int threads)
+{
+	switch (imageFormatOf(fileName))
+	{
+	case FORMAT_BMP:
+		return getBMP(fileName);
+	case FORMAT_JPEG:
+		return getJPEG(fileName, threads);
+	case FORMAT_PNG:
+		return getPNG(fileName);
+	default:
+		std::cerr << fileName << ": unsupported image format" << std::endl;
+		return NULL;
+	}
+}
+
+imageFile *getImage(std::string fileName)
+{
+	return decodeImage(fileName, 0);
+}
+
+void getImages(const std::vector<std::string> &fileNames, std::vector<imageFile *> &images, int threads)
+{
+	images.assign(fileNames.size(), NULL);
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	int workers = std::min(threads, (int)fileNames.size());
+
+	// Files are handed out one at a time; cores beyond one per file are shared out
+	// for decoding inside each image.
+	std::atomic<size_t> next(0);
+	int inner = std::max(1, threads / std::max(1, workers));
+	auto work = [&]() {
+		for (size_t i; (i = next++) < fileNames.size();)
+			images[i] = decodeImage(fileNames[i], inner);
+	};
+
+	if (workers <= 1)
+	{
+		work();
+		return;
+	}
+	std::vector<std::thread> pool;
+	for (int t = 0; t < workers; t++)
+		pool.push_back(std::thread(work));
+	for (int t = 0; t < workers; t++)
+		pool[t].join();
+}
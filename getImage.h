@@ -0,0 +1,24 @@
+#ifndef GETIMAGE_H
+#define GETIMAGE_H
+
+#include <string>
+#include <vector>
+
+#include "getBMP.h"
+
+// Read a BMP, JPEG or PNG file, recognised by its signature, into an RGBA image,
+// bottom row first. Returns NULL (after reporting why) if it cannot be read.
+imageFile *getImage(std::string fileName);
+
+// True if the file starts with the signature of a format getImage() reads.
+bool isImageFile(std::string fileName);
+
+// Read just the size of an image from its header. Returns false if the file is
+// not a readable image.
+bool getImageSize(std::string fileName, int &width, int &height);
+
+// Read many images at once, one file per worker thread (0 = one thread per core).
+// images[i] is the result of getImage(fileNames[i]).
+void getImages(const std::vector<std::string> &fileNames, std::vector<imageFile *> &images, int threads = 0);
+
+#endif
@@ -0,0 +1,661 @@
+// Baseline JPEG decoder.
+//
+// Each scan is entropy decoded into per-component sample planes. When the file
+// has a restart interval, the scan is cut at its restart markers: every segment
+// starts with fresh DC predictions at a known MCU, so runs of segments are
+// decoded on separate threads. The planes are then upsampled and converted to
+// RGBA in parallel bands of rows.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "getJPEG.h"
+
+// Natural order position of each coefficient in zig-zag order.
+static const unsigned char zigzag[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Codes up to this many bits are decoded with a single table lookup.
+#define HUFFMAN_FAST_BITS 9
+
+struct jpegHuffman
+{
+	unsigned char fastLength[1 << HUFFMAN_FAST_BITS]; // 0 when the code is longer.
+	unsigned char fastValue[1 << HUFFMAN_FAST_BITS];
+	int maxCode[18]; // Largest code of each length, -1 if none.
+	int valueIndex[17]; // Index into values of the first code of each length.
+	int minCode[17];
+	unsigned char values[256];
+};
+
+struct jpegComponent
+{
+	int id;
+	int h, v; // Sampling factors.
+	int quant; // Quantization table.
+	int dcTable, acTable; // Huffman tables of the current scan.
+	int blocksX, blocksY; // Blocks in the component when coded on its own.
+	int stride; // Samples per plane row.
+	std::vector<unsigned char> plane; // Decoded samples, padded to whole MCUs.
+};
+
+struct jpegDecoder
+{
+	std::string fileName;
+	const unsigned char *data;
+	size_t size;
+
+	uint16_t quant[4][64]; // Zig-zag order.
+	jpegHuffman dc[4], ac[4];
+	bool defined[2][4]; // Huffman tables given by a DHT, DC then AC.
+	int restartInterval;
+
+	int width, height;
+	int hMax, vMax;
+	int mcusX, mcusY;
+	std::vector<jpegComponent> components;
+	int threads;
+};
+
+// Reads entropy coded bits, removing stuffed zero bytes. At a marker it feeds zeros.
+struct jpegBits
+{
+	const unsigned char *p, *end;
+	uint32_t buffer;
+	int count;
+};
+
+static void fillBits(jpegBits &bits)
+{
+	while (bits.count <= 24)
+	{
+		uint32_t byte = 0;
+		if (bits.p < bits.end)
+		{
+			if (bits.p[0] != 0xFF)
+				byte = *bits.p++;
+			else if (bits.p + 1 < bits.end && bits.p[1] == 0x00)
+			{
+				byte = 0xFF;
+				bits.p += 2;
+			}
+		}
+		bits.buffer |= byte << (24 - bits.count);
+		bits.count += 8;
+	}
+}
+
+static int getBits(jpegBits &bits, int n)
+{
+	if (n == 0)
+		return 0;
+	fillBits(bits);
+	int value = bits.buffer >> (32 - n);
+	bits.buffer <<= n;
+	bits.count -= n;
+	return value;
+}
+
+// Sign-extend an n-bit magnitude category value.
+static int extend(int value, int n)
+{
+	return value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+}
+
+static int decodeHuffman(jpegBits &bits, const jpegHuffman &table)
+{
+	fillBits(bits);
+	int peek = bits.buffer >> (32 - HUFFMAN_FAST_BITS);
+	if (table.fastLength[peek])
+	{
+		int length = table.fastLength[peek];
+		bits.buffer <<= length;
+		bits.count -= length;
+		return table.fastValue[peek];
+	}
+
+	for (int length = HUFFMAN_FAST_BITS + 1; length <= 16; length++)
+	{
+		int code = bits.buffer >> (32 - length);
+		if (code <= table.maxCode[length])
+		{
+			bits.buffer <<= length;
+			bits.count -= length;
+			return table.values[table.valueIndex[length] + code - table.minCode[length]];
+		}
+	}
+	return -1; // Corrupt data.
+}
+
+static bool buildHuffman(const unsigned char counts[16], const unsigned char *values, jpegHuffman &table)
+{
+	int total = 0;
+	for (int i = 0; i < 16; i++)
+		total += counts[i];
+	if (total > 256)
+		return false;
+	memcpy(table.values, values, total);
+	memset(table.fastLength, 0, sizeof(table.fastLength));
+
+	int code = 0, k = 0;
+	for (int length = 1; length <= 16; length++)
+	{
+		table.valueIndex[length] = k;
+		table.minCode[length] = code;
+		for (int i = 0; i < counts[length - 1]; i++, k++, code++)
+		{
+			if (code >= (1 << length))
+				return false; // The counts over-subscribe the code space.
+			if (length <= HUFFMAN_FAST_BITS)
+			{
+				int first = code << (HUFFMAN_FAST_BITS - length), last = (code + 1) << (HUFFMAN_FAST_BITS - length);
+				for (int j = first; j < last; j++)
+				{
+					table.fastLength[j] = (unsigned char)length;
+					table.fastValue[j] = values[k];
+				}
+			}
+		}
+		table.maxCode[length] = counts[length - 1] ? code - 1 : -1;
+		code <<= 1;
+	}
+	table.maxCode[17] = 0x7FFFFFFF;
+	return true;
+}
+
+// Scaled cosines of the inverse DCT, basis[x][u].
+struct dctBasis
+{
+	float basis[8][8];
+
+	dctBasis()
+	{
+		for (int x = 0; x < 8; x++)
+			for (int u = 0; u < 8; u++)
+				basis[x][u] = (u == 0 ? (float)M_SQRT1_2 : 1.0f) * 0.5f * (float)cos((2 * x + 1) * u * M_PI / 16);
+	}
+};
+
+// Separable inverse DCT; rows that are all zero after the DC term are cheap.
+static void inverseDCT(const int coefficients[64], unsigned char *out, int stride)
+{
+	static const dctBasis dct; // Initialized once, safely across decoding threads.
+	const float (*basis)[8] = dct.basis;
+
+	float rows[64];
+	for (int v = 0; v < 8; v++)
+	{
+		const int *in = coefficients + 8 * v;
+		bool acZero = !(in[1] | in[2] | in[3] | in[4] | in[5] | in[6] | in[7]);
+		for (int x = 0; x < 8; x++)
+		{
+			float sum = basis[x][0] * in[0];
+			if (!acZero)
+				for (int u = 1; u < 8; u++)
+					sum += basis[x][u] * in[u];
+			rows[8 * v + x] = sum;
+		}
+	}
+	for (int y = 0; y < 8; y++)
+		for (int x = 0; x < 8; x++)
+		{
+			float sum = 128.0f;
+			for (int v = 0; v < 8; v++)
+				sum += basis[y][v] * rows[8 * v + x];
+			int sample = (int)lrintf(sum);
+			out[y * stride + x] = (unsigned char)(sample < 0 ? 0 : (sample > 255 ? 255 : sample));
+		}
+}
+
+static bool decodeBlock(jpegBits &bits, const jpegDecoder &dec, const jpegComponent &comp, int &dcPrediction, unsigned char *out)
+{
+	int coefficients[64] = {0};
+	const uint16_t *q = dec.quant[comp.quant];
+
+	int t = decodeHuffman(bits, dec.dc[comp.dcTable]);
+	if (t < 0 || t > 11)
+		return false;
+	dcPrediction += t ? extend(getBits(bits, t), t) : 0;
+	coefficients[0] = dcPrediction * q[0];
+
+	for (int k = 1; k < 64;)
+	{
+		int rs = decodeHuffman(bits, dec.ac[comp.acTable]);
+		if (rs < 0)
+			return false;
+		int run = rs >> 4, s = rs & 15;
+		if (s == 0)
+		{
+			if (run != 15)
+				break; // End of block.
+			k += 16;
+			continue;
+		}
+		k += run;
+		if (k > 63)
+			return false;
+		coefficients[zigzag[k]] = extend(getBits(bits, s), s) * q[k];
+		k++;
+	}
+
+	inverseDCT(coefficients, out, comp.stride);
+	return true;
+}
+
+// Decode MCUs [first, last) of a scan from one restart segment onwards.
+static bool decodeMCUs(const jpegDecoder &dec, const std::vector<jpegComponent *> &scan, const unsigned char *begin,
+					   const unsigned char *end, int first, int last)
+{
+	jpegBits bits = {begin, end, 0, 0};
+	int predictions[4] = {0, 0, 0, 0};
+	bool single = scan.size() == 1;
+	int mcusX = single ? scan[0]->blocksX : dec.mcusX;
+
+	for (int mcu = first; mcu < last; mcu++)
+	{
+		int mx = mcu % mcusX, my = mcu / mcusX;
+		for (size_t c = 0; c < scan.size(); c++)
+		{
+			jpegComponent &comp = *scan[c];
+			int h = single ? 1 : comp.h, v = single ? 1 : comp.v;
+			for (int by = 0; by < v; by++)
+				for (int bx = 0; bx < h; bx++)
+				{
+					int x = 8 * (mx * h + bx), y = 8 * (my * v + by);
+					if (!decodeBlock(bits, dec, comp, predictions[c], &comp.plane[(size_t)y * comp.stride + x]))
+						return false;
+				}
+		}
+	}
+	return true;
+}
+
+// Decode the entropy coded data of a scan starting at p. Returns the end of the scan, or NULL on error.
+static const unsigned char *decodeScan(jpegDecoder &dec, const std::vector<jpegComponent *> &scan, const unsigned char *p)
+{
+	const unsigned char *end = dec.data + dec.size;
+
+	// Find the restart markers and the end of the scan.
+	std::vector<const unsigned char *> segments(1, p);
+	const unsigned char *q = p;
+	for (; q + 1 < end; q++)
+	{
+		if (q[0] != 0xFF || q[1] == 0x00 || q[1] == 0xFF)
+			continue;
+		if (q[1] < 0xD0 || q[1] > 0xD7)
+			break;
+		segments.push_back(q + 2);
+		q++;
+	}
+	const unsigned char *scanEnd = q;
+
+	int total = scan.size() == 1 ? scan[0]->blocksX * scan[0]->blocksY : dec.mcusX * dec.mcusY;
+	int interval = dec.restartInterval ? dec.restartInterval : total;
+	if ((size_t)((total + interval - 1) / interval) < segments.size())
+		segments.resize((total + interval - 1) / interval);
+
+	// Each thread takes a contiguous run of segments.
+	int threads = std::min((int)segments.size(), dec.threads);
+	std::vector<char> ok(threads, 1);
+	auto decodeRun = [&](int t) {
+		size_t first = segments.size() * t / threads, last = segments.size() * (t + 1) / threads;
+		for (size_t s = first; s < last && ok[t]; s++)
+		{
+			const unsigned char *segmentEnd = s + 1 < segments.size() ? segments[s + 1] - 2 : scanEnd;
+			ok[t] = decodeMCUs(dec, scan, segments[s], segmentEnd, (int)s * interval, std::min((int)(s + 1) * interval, total));
+		}
+	};
+	if (threads <= 1)
+		decodeRun(0);
+	else
+	{
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+			workers.push_back(std::thread(decodeRun, t));
+		for (int t = 0; t < threads; t++)
+			workers[t].join();
+	}
+
+	for (int t = 0; t < threads; t++)
+		if (!ok[t])
+			return NULL;
+	return scanEnd;
+}
+
+// Upsample one output row of a chroma component to full width in out. Components at
+// half the resolution in one or both directions are interpolated with libjpeg's
+// triangle filter, weighting the nearer sample 3:1; other ratios repeat samples.
+static void upsampleRow(const jpegDecoder &dec, const jpegComponent &c, int row, int width, unsigned char *out)
+{
+	int hRatio = dec.hMax / c.h, vRatio = dec.vMax / c.v;
+	bool fancy = (hRatio == 1 || hRatio == 2) && dec.hMax % c.h == 0 && (vRatio == 1 || vRatio == 2) && dec.vMax % c.v == 0 &&
+				 hRatio * vRatio > 1;
+	if (!fancy)
+	{
+		const unsigned char *in = &c.plane[(size_t)(row * c.v / dec.vMax) * c.stride];
+		for (int x = 0; x < width; x++)
+			out[x] = in[x * c.h / dec.hMax];
+		return;
+	}
+
+	// Samples actually covered by the image; the ones past them are block padding.
+	int rows = (dec.height * c.v + dec.vMax - 1) / dec.vMax;
+	int nearRow = row / vRatio, farRow = nearRow;
+	if (vRatio == 2)
+		farRow = row & 1 ? std::min(nearRow + 1, rows - 1) : std::max(nearRow - 1, 0);
+	const unsigned char *nearIn = &c.plane[(size_t)nearRow * c.stride], *farIn = &c.plane[(size_t)farRow * c.stride];
+	if (hRatio == 1)
+	{
+		for (int x = 0; x < width; x++)
+			out[x] = (unsigned char)((3 * nearIn[x] + farIn[x] + (row & 1 ? 2 : 1)) >> 2);
+		return;
+	}
+	int columns = (width + 1) / 2;
+
+	// Column sums are scaled by 4 in both cases, so the horizontal pass divides by 16.
+	// The rounding biases are libjpeg's: 4 and 8 for h2v1, 8 and 7 for h2v2.
+	int evenBias = vRatio == 2 ? 8 : 4, oddBias = vRatio == 2 ? 7 : 8;
+	int previous = 3 * nearIn[0] + farIn[0], current = previous;
+	for (int x = 0; x < columns; x++)
+	{
+		int next = x + 1 < columns ? 3 * nearIn[x + 1] + farIn[x + 1] : current;
+		out[2 * x] = (unsigned char)((3 * current + previous + evenBias) >> 4);
+		if (2 * x + 1 < width)
+			out[2 * x + 1] = (unsigned char)((3 * current + next + oddBias) >> 4);
+		previous = current;
+		current = next;
+	}
+}
+
+// Upsample and convert output rows [first, last) to RGBA, flipping to bottom-up.
+static void convertRows(const jpegDecoder &dec, imageFile *image, int first, int last)
+{
+	const jpegComponent &y = dec.components[0];
+	std::vector<unsigned char> cbLine(image->width), crLine(image->width);
+	for (int row = first; row < last; row++)
+	{
+		unsigned char *out = image->data + 4 * (size_t)image->width * (image->height - 1 - row);
+		const unsigned char *luma = &y.plane[(size_t)(row * y.v / dec.vMax) * y.stride];
+		if (dec.components.size() == 1)
+		{
+			for (int x = 0; x < image->width; x++, out += 4)
+			{
+				out[0] = out[1] = out[2] = luma[x];
+				out[3] = 0xFF;
+			}
+			continue;
+		}
+
+		upsampleRow(dec, dec.components[1], row, image->width, cbLine.data());
+		upsampleRow(dec, dec.components[2], row, image->width, crLine.data());
+		for (int x = 0; x < image->width; x++, out += 4)
+		{
+			// JFIF YCbCr to RGB in 16.16 fixed point.
+			int l = luma[x * y.h / dec.hMax] << 16;
+			int b = cbLine[x] - 128, r = crLine[x] - 128;
+			int rgb[3] = {(l + 91881 * r + 32768) >> 16, (l - 22554 * b - 46802 * r + 32768) >> 16, (l + 116130 * b + 32768) >> 16};
+			for (int c = 0; c < 3; c++)
+				out[c] = (unsigned char)(rgb[c] < 0 ? 0 : (rgb[c] > 255 ? 255 : rgb[c]));
+			out[3] = 0xFF;
+		}
+	}
+}
+
+static bool fail(const jpegDecoder &dec, const char *message)
+{
+	std::cerr << dec.fileName << ": " << message << std::endl;
+	return false;
+}
+
+static bool parseFrame(jpegDecoder &dec, const unsigned char *p, int length)
+{
+	if (length < 6 || p[0] != 8)
+		return fail(dec, "only 8-bit JPEG is supported");
+	dec.height = (p[1] << 8) | p[2];
+	dec.width = (p[3] << 8) | p[4];
+	int count = p[5];
+	if (dec.width == 0 || dec.height == 0 || (count != 1 && count != 3) || length < 6 + 3 * count)
+		return fail(dec, "unsupported JPEG frame (only grayscale and YCbCr with a known height)");
+	if (dec.width > IMAGE_MAX_SIDE || dec.height > IMAGE_MAX_SIDE)
+		return fail(dec, "image too large");
+
+	dec.hMax = dec.vMax = 1;
+	dec.components.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		jpegComponent &comp = dec.components[i];
+		comp.id = p[6 + 3 * i];
+		comp.h = p[7 + 3 * i] >> 4;
+		comp.v = p[7 + 3 * i] & 15;
+		comp.quant = p[8 + 3 * i] & 3;
+		if (comp.h < 1 || comp.h > 4 || comp.v < 1 || comp.v > 4)
+			return fail(dec, "corrupt JPEG sampling factors");
+		dec.hMax = std::max(dec.hMax, comp.h);
+		dec.vMax = std::max(dec.vMax, comp.v);
+	}
+
+	dec.mcusX = (dec.width + 8 * dec.hMax - 1) / (8 * dec.hMax);
+	dec.mcusY = (dec.height + 8 * dec.vMax - 1) / (8 * dec.vMax);
+	for (int i = 0; i < count; i++)
+	{
+		jpegComponent &comp = dec.components[i];
+		comp.blocksX = ((dec.width * comp.h + dec.hMax - 1) / dec.hMax + 7) / 8;
+		comp.blocksY = ((dec.height * comp.v + dec.vMax - 1) / dec.vMax + 7) / 8;
+		comp.stride = 8 * dec.mcusX * comp.h;
+		try
+		{
+			comp.plane.assign((size_t)comp.stride * 8 * dec.mcusY * comp.v, 0);
+		}
+		catch (const std::bad_alloc &)
+		{
+			return fail(dec, "image too large");
+		}
+	}
+	return true;
+}
+
+static bool parseTables(jpegDecoder &dec, unsigned char marker, const unsigned char *p, int length)
+{
+	const unsigned char *end = p + length;
+	while (p < end)
+	{
+		if (marker == 0xDB)
+		{
+			int precision = p[0] >> 4, id = p[0] & 3;
+			if (precision > 1)
+				return fail(dec, "unsupported JPEG quantization table precision");
+			if (p + 1 + 64 * (precision + 1) > end)
+				return fail(dec, "corrupt JPEG quantization table");
+			for (int k = 0; k < 64; k++)
+				dec.quant[id][k] = precision ? (p[1 + 2 * k] << 8) | p[2 + 2 * k] : p[1 + k];
+			p += 1 + 64 * (precision + 1);
+		}
+		else
+		{
+			if (p + 17 > end)
+				return fail(dec, "corrupt JPEG Huffman table");
+			int tableClass = p[0] >> 4, id = p[0] & 3, total = 0;
+			for (int i = 0; i < 16; i++)
+				total += p[1 + i];
+			if (p + 17 + total > end || !buildHuffman(p + 1, p + 17, tableClass ? dec.ac[id] : dec.dc[id]))
+				return fail(dec, "corrupt JPEG Huffman table");
+			dec.defined[tableClass ? 1 : 0][id] = true;
+			p += 17 + total;
+		}
+	}
+	return true;
+}
+
+imageFile *getJPEG(std::string fileName, int threads)
+{
+	std::ifstream inFile(fileName.c_str(), std::ios::binary | std::ios::ate);
+	if (!inFile)
+	{
+		std::cerr << fileName << ": cannot open" << std::endl;
+		return NULL;
+	}
+	std::vector<unsigned char> file((size_t)inFile.tellg());
+	inFile.seekg(0);
+	inFile.read((char *)file.data(), file.size());
+	inFile.close();
+
+	jpegDecoder dec;
+	dec.fileName = fileName;
+	dec.data = file.data();
+	dec.size = file.size();
+	dec.restartInterval = 0;
+	dec.width = dec.height = 0;
+	dec.threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	memset(dec.quant, 0, sizeof(dec.quant));
+	memset(dec.defined, 0, sizeof(dec.defined));
+
+	if (dec.size < 4 || dec.data[0] != 0xFF || dec.data[1] != 0xD8)
+	{
+		fail(dec, "not a JPEG file");
+		return NULL;
+	}
+
+	const unsigned char *p = dec.data + 2, *end = dec.data + dec.size;
+	bool done = false;
+	while (!done)
+	{
+		// Skip fill bytes up to the next marker.
+		while (p < end && *p != 0xFF)
+			p++;
+		while (p < end && *p == 0xFF)
+			p++;
+		if (p >= end)
+		{
+			fail(dec, "truncated JPEG");
+			return NULL;
+		}
+		unsigned char marker = *p++;
+		if (marker == 0xD9)
+			break;
+		if (marker >= 0xD0 && marker <= 0xD7)
+			continue;
+		if (p + 2 > end)
+		{
+			fail(dec, "truncated JPEG");
+			return NULL;
+		}
+		int length = ((p[0] << 8) | p[1]) - 2;
+		p += 2;
+		if (length < 0 || p + length > end)
+		{
+			fail(dec, "truncated JPEG");
+			return NULL;
+		}
+
+		bool ok = true;
+		switch (marker)
+		{
+		case 0xC0: // Baseline.
+		case 0xC1: // Extended sequential, Huffman.
+			ok = dec.width == 0 ? parseFrame(dec, p, length) : fail(dec, "JPEG has more than one frame");
+			break;
+		case 0xC2:
+		case 0xC3:
+		case 0xC5:
+		case 0xC6:
+		case 0xC7:
+		case 0xC9:
+		case 0xCA:
+		case 0xCB:
+		case 0xCD:
+		case 0xCE:
+		case 0xCF:
+			ok = fail(dec, "progressive, lossless and arithmetic coded JPEG are not supported");
+			break;
+		case 0xDB:
+		case 0xC4:
+			ok = parseTables(dec, marker, p, length);
+			break;
+		case 0xDD:
+			dec.restartInterval = length >= 2 ? (p[0] << 8) | p[1] : 0;
+			break;
+		case 0xDA:
+		{
+			int count = length > 0 ? p[0] : 0;
+			if (dec.width == 0 || count < 1 || count > 4 || length < 4 + 2 * count)
+			{
+				ok = fail(dec, "corrupt JPEG scan header");
+				break;
+			}
+			std::vector<jpegComponent *> scan;
+			for (int i = 0; i < count && ok; i++)
+			{
+				jpegComponent *comp = NULL;
+				for (size_t c = 0; c < dec.components.size(); c++)
+					if (dec.components[c].id == p[1 + 2 * i])
+						comp = &dec.components[c];
+				if (!comp)
+					ok = fail(dec, "JPEG scan refers to an unknown component");
+				else
+				{
+					comp->dcTable = p[2 + 2 * i] >> 4 & 3;
+					comp->acTable = p[2 + 2 * i] & 3;
+					if (!dec.defined[0][comp->dcTable] || !dec.defined[1][comp->acTable])
+						ok = fail(dec, "JPEG scan uses an undefined Huffman table");
+					scan.push_back(comp);
+				}
+			}
+			if (ok)
+			{
+				const unsigned char *scanEnd = decodeScan(dec, scan, p + length);
+				if (!scanEnd)
+				{
+					ok = fail(dec, "corrupt JPEG scan data");
+					break;
+				}
+				p = scanEnd;
+				continue;
+			}
+			break;
+		}
+		}
+		if (!ok)
+			return NULL;
+		p += length;
+	}
+
+	if (dec.width == 0)
+	{
+		fail(dec, "JPEG has no frame");
+		return NULL;
+	}
+
+	unsigned char *outData = new (std::nothrow) unsigned char[4 * (size_t)dec.width * dec.height];
+	if (!outData)
+	{
+		fail(dec, "image too large");
+		return NULL;
+	}
+	imageFile *outRGBA = new imageFile;
+	outRGBA->width = dec.width;
+	outRGBA->height = dec.height;
+	outRGBA->data = outData;
+
+	int threadsUsed = std::min(dec.threads, dec.height);
+	if (threadsUsed <= 1)
+		convertRows(dec, outRGBA, 0, dec.height);
+	else
+	{
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threadsUsed; t++)
+			workers.push_back(std::thread(convertRows, std::cref(dec), outRGBA, dec.height * t / threadsUsed, dec.height * (t + 1) / threadsUsed));
+		for (int t = 0; t < threadsUsed; t++)
+			workers[t].join();
+	}
+	return outRGBA;
+}
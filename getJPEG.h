@@ -0,0 +1,14 @@
+#ifndef GETJPEG_H
+#define GETJPEG_H
+
+#include <string>
+
+#include "getBMP.h"
+
+// Read a baseline (sequential, Huffman coded, 8-bit) grayscale or YCbCr JPEG file
+// into an RGBA image, bottom row first. Scans with restart markers are decoded one
+// run of restart intervals per thread (0 = one thread per core). Returns NULL
+// (after reporting why) if the file cannot be read or uses unsupported features.
+imageFile *getJPEG(std::string fileName, int threads = 0);
+
+#endif
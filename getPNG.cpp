@@ -0,0 +1,359 @@
+// PNG decoder on top of zlib's inflate.
+//
+// The file is read chunk by chunk and the image data is inflated one scanline
+// at a time, unfiltered against the previous line and converted straight into
+// its place in the RGBA output. Apart from the output, memory use is two
+// scanlines and a fixed input buffer. Deflate and the PNG filters both depend on
+// everything before them, so a single image is decoded serially; parallelism
+// comes from decoding several files at once (see getImages()).
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <stdint.h>
+#include <vector>
+#include <zlib.h>
+
+#include "getPNG.h"
+
+// Bytes of compressed data read from the file at a time.
+#define PNG_CHUNK_BYTES (64 * 1024)
+
+struct pngDecoder
+{
+	int width, height;
+	int bitDepth, colorType;
+	int channels; // Samples per pixel.
+	size_t rowBytes; // Bytes per scanline, without the filter type byte.
+	int filterStride; // Bytes per complete pixel, at least 1, for the filters.
+
+	uint32_t palette[256]; // RGBA.
+	bool hasKey; // Transparent color of gray and RGB images (tRNS).
+	int key[3];
+
+	std::vector<unsigned char> previous, current; // Scanlines, filter type byte first.
+	int row; // Next scanline to finish.
+	imageFile *out;
+};
+
+static uint32_t readBE32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static unsigned char paeth(int a, int b, int c)
+{
+	int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return (unsigned char)(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+}
+
+// Undo the scanline filter of dec.current in place.
+static bool unfilterRow(pngDecoder &dec)
+{
+	unsigned char *line = &dec.current[1];
+	const unsigned char *up = &dec.previous[1];
+	int stride = dec.filterStride;
+	size_t n = dec.rowBytes;
+
+	switch (dec.current[0])
+	{
+	case 0:
+		break;
+	case 1:
+		for (size_t i = stride; i < n; i++)
+			line[i] += line[i - stride];
+		break;
+	case 2:
+		for (size_t i = 0; i < n; i++)
+			line[i] += up[i];
+		break;
+	case 3:
+		for (size_t i = 0; i < n; i++)
+			line[i] += (unsigned char)(((i >= (size_t)stride ? line[i - stride] : 0) + up[i]) >> 1);
+		break;
+	case 4:
+		for (size_t i = 0; i < n; i++)
+			line[i] += i >= (size_t)stride ? paeth(line[i - stride], up[i], up[i - stride]) : paeth(0, up[i], 0);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+// Sample s of the unfiltered scanline, at its original bit depth.
+static int sampleAt(const pngDecoder &dec, const unsigned char *line, size_t s)
+{
+	switch (dec.bitDepth)
+	{
+	case 16:
+		return (line[2 * s] << 8) | line[2 * s + 1];
+	case 8:
+		return line[s];
+	default:
+	{
+		size_t bit = s * dec.bitDepth;
+		return (line[bit >> 3] >> (8 - dec.bitDepth - (bit & 7))) & ((1 << dec.bitDepth) - 1);
+	}
+	}
+}
+
+// Convert the unfiltered scanline to RGBA into its bottom-up row of the output.
+static void convertRow(const pngDecoder &dec)
+{
+	const unsigned char *line = &dec.current[1];
+	unsigned char *out = dec.out->data + 4 * (size_t)dec.width * (dec.height - 1 - dec.row);
+	int maxSample = (1 << dec.bitDepth) - 1;
+
+	// Fast paths for the common 8-bit layouts.
+	if (dec.bitDepth == 8 && dec.colorType == 6)
+	{
+		memcpy(out, line, 4 * (size_t)dec.width);
+		return;
+	}
+	if (dec.bitDepth == 8 && dec.colorType == 2 && !dec.hasKey)
+	{
+		for (int x = 0; x < dec.width; x++, line += 3, out += 4)
+		{
+			out[0] = line[0];
+			out[1] = line[1];
+			out[2] = line[2];
+			out[3] = 0xFF;
+		}
+		return;
+	}
+
+	for (int x = 0; x < dec.width; x++, out += 4)
+	{
+		size_t s = (size_t)x * dec.channels;
+		int v[4];
+		for (int c = 0; c < dec.channels; c++)
+			v[c] = sampleAt(dec, line, s + c);
+
+		switch (dec.colorType)
+		{
+		case 3: // Palette.
+			memcpy(out, &dec.palette[v[0]], 4);
+			continue;
+		case 0: // Gray.
+		case 4: // Gray and alpha.
+			out[0] = out[1] = out[2] = (unsigned char)(v[0] * 255 / maxSample);
+			out[3] = dec.colorType == 4 ? (unsigned char)(v[1] * 255 / maxSample) : (dec.hasKey && v[0] == dec.key[0] ? 0 : 0xFF);
+			continue;
+		default: // RGB, RGB and alpha.
+			for (int c = 0; c < 3; c++)
+				out[c] = (unsigned char)(v[c] * 255 / maxSample);
+			if (dec.colorType == 6)
+				out[3] = (unsigned char)(v[3] * 255 / maxSample);
+			else
+				out[3] = dec.hasKey && v[0] == dec.key[0] && v[1] == dec.key[1] && v[2] == dec.key[2] ? 0 : 0xFF;
+		}
+	}
+}
+
+static bool parseHeader(pngDecoder &dec, const unsigned char *p, uint32_t length)
+{
+	if (length != 13)
+		return false;
+	dec.width = (int)readBE32(p);
+	dec.height = (int)readBE32(p + 4);
+	dec.bitDepth = p[8];
+	dec.colorType = p[9];
+	int interlace = p[12];
+
+	static const int channelsOf[7] = {1, 0, 3, 1, 2, 0, 4};
+	dec.channels = dec.colorType <= 6 ? channelsOf[dec.colorType] : 0;
+	bool depthOK = dec.bitDepth == 8 || dec.bitDepth == 16 ||
+				   ((dec.colorType == 0 || dec.colorType == 3) && (dec.bitDepth == 1 || dec.bitDepth == 2 || dec.bitDepth == 4));
+	if (dec.width <= 0 || dec.height <= 0 || dec.channels == 0 || !depthOK || (dec.colorType == 3 && dec.bitDepth == 16) ||
+		p[10] != 0 || p[11] != 0 || interlace != 0)
+		return false;
+
+	size_t bitsPerPixel = (size_t)dec.channels * dec.bitDepth;
+	dec.rowBytes = ((size_t)dec.width * bitsPerPixel + 7) / 8;
+	dec.filterStride = bitsPerPixel < 8 ? 1 : (int)(bitsPerPixel / 8);
+	return true;
+}
+
+imageFile *getPNG(std::string fileName)
+{
+	static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+	std::ifstream inFile(fileName.c_str(), std::ios::binary);
+	unsigned char header[8];
+	if (!inFile.read((char *)header, 8) || memcmp(header, signature, 8) != 0)
+	{
+		std::cerr << fileName << ": not a PNG file" << std::endl;
+		return NULL;
+	}
+
+	pngDecoder dec;
+	memset(dec.palette, 0, sizeof(dec.palette));
+	dec.hasKey = false;
+	dec.row = 0;
+	dec.out = NULL;
+	dec.width = 0;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	inflateInit(&zs);
+
+	std::vector<unsigned char> buffer(PNG_CHUNK_BYTES);
+	size_t filled = 0; // Bytes of the current scanline inflated so far.
+	const char *error = NULL;
+	bool ended = false;
+
+	while (!error && !ended)
+	{
+		unsigned char chunk[8];
+		if (!inFile.read((char *)chunk, 8))
+		{
+			error = "truncated PNG";
+			break;
+		}
+		uint32_t length = readBE32(chunk);
+		const unsigned char *type = chunk + 4;
+		if (length > 0x7FFFFFFF)
+		{
+			error = "corrupt PNG chunk length";
+			break;
+		}
+
+		if (memcmp(type, "IDAT", 4) == 0)
+		{
+			if (!dec.out)
+			{
+				error = "PNG image data before its header";
+				break;
+			}
+			for (uint32_t left = length; left > 0 && !error;)
+			{
+				uint32_t n = left < buffer.size() ? left : (uint32_t)buffer.size();
+				if (!inFile.read((char *)buffer.data(), n))
+				{
+					error = "truncated PNG";
+					break;
+				}
+				left -= n;
+				zs.next_in = buffer.data();
+				zs.avail_in = n;
+				// Inflate may hold back output once a scanline fills up, so keep going after a
+				// completed scanline even when the input is used up.
+				bool more = true;
+				while (more && dec.row < dec.height)
+				{
+					zs.next_out = &dec.current[filled];
+					zs.avail_out = (uInt)(dec.current.size() - filled);
+					int status = inflate(&zs, Z_NO_FLUSH);
+					if (status == Z_BUF_ERROR)
+						break; // No progress possible until more input arrives.
+					if (status != Z_OK && status != Z_STREAM_END)
+					{
+						error = "corrupt PNG image data";
+						break;
+					}
+					filled = dec.current.size() - zs.avail_out;
+					bool rowDone = filled == dec.current.size();
+					if (rowDone)
+					{
+						if (!unfilterRow(dec))
+						{
+							error = "corrupt PNG filter type";
+							break;
+						}
+						convertRow(dec);
+						dec.previous.swap(dec.current);
+						filled = 0;
+						dec.row++;
+					}
+					if (status == Z_STREAM_END)
+						break;
+					more = zs.avail_in > 0 || rowDone;
+				}
+			}
+			inFile.seekg(4, std::ios::cur); // CRC.
+			continue;
+		}
+
+		// Only the header, palette and transparency are read; every other chunk is skipped.
+		if (memcmp(type, "IHDR", 4) != 0 && memcmp(type, "PLTE", 4) != 0 && memcmp(type, "tRNS", 4) != 0)
+		{
+			if (memcmp(type, "IEND", 4) == 0)
+				ended = true;
+			else if (!inFile.seekg((std::streamoff)length + 4, std::ios::cur))
+				error = "truncated PNG";
+			continue;
+		}
+
+		if (length > 3 * 256) // The longest of the three, a full palette.
+		{
+			error = "corrupt PNG chunk length";
+			break;
+		}
+		std::vector<unsigned char> data(length);
+		if (!inFile.read((char *)data.data(), length) || !inFile.seekg(4, std::ios::cur))
+		{
+			error = "truncated PNG";
+			break;
+		}
+
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (dec.out || !parseHeader(dec, data.data(), length))
+			{
+				error = "unsupported PNG (interlaced or invalid header)";
+				break;
+			}
+			unsigned char *outData = NULL;
+			if (dec.width > IMAGE_MAX_SIDE || dec.height > IMAGE_MAX_SIDE ||
+				!(outData = new (std::nothrow) unsigned char[4 * (size_t)dec.width * dec.height]))
+			{
+				error = "image too large";
+				break;
+			}
+			dec.out = new imageFile;
+			dec.out->width = dec.width;
+			dec.out->height = dec.height;
+			dec.out->data = outData;
+			dec.previous.assign(1 + dec.rowBytes, 0);
+			dec.current.assign(1 + dec.rowBytes, 0);
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			for (uint32_t i = 0; i < length / 3 && i < 256; i++)
+			{
+				unsigned char rgba[4] = {data[3 * i], data[3 * i + 1], data[3 * i + 2], 0xFF};
+				memcpy(&dec.palette[i], rgba, 4);
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0 && dec.out)
+		{
+			if (dec.colorType == 3)
+				for (uint32_t i = 0; i < length && i < 256; i++)
+					((unsigned char *)&dec.palette[i])[3] = data[i];
+			else if ((dec.colorType == 0 && length >= 2) || (dec.colorType == 2 && length >= 6))
+			{
+				dec.hasKey = true;
+				for (int c = 0; c < (dec.colorType == 0 ? 1 : 3); c++)
+					dec.key[c] = (data[2 * c] << 8) | data[2 * c + 1];
+			}
+		}
+	}
+	inflateEnd(&zs);
+
+	if (!error && (!dec.out || dec.row < dec.height))
+		error = "truncated PNG image data";
+	if (error)
+	{
+		std::cerr << fileName << ": " << error << std::endl;
+		if (dec.out)
+		{
+			delete[] dec.out->data;
+			delete dec.out;
+		}
+		return NULL;
+	}
+	return dec.out;
+}
@@ -0,0 +1,13 @@
+#ifndef GETPNG_H
+#define GETPNG_H
+
+#include <string>
+
+#include "getBMP.h"
+
+// Read a non-interlaced PNG file (any color type, 1 to 16 bits per sample) into
+// an RGBA image, bottom row first. Returns NULL (after reporting why) if the
+// file cannot be read or uses unsupported features.
+imageFile *getPNG(std::string fileName);
+
+#endif
@@ -0,0 +1,109 @@
+// Frame time governor.
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "governor.h"
+
+// Frames averaged before each decision; the window starts over after every adjustment
+// so that the next decision sees only frames rendered with the new settings.
+#define GOVERNOR_WINDOW 30
+
+// Quality is given back only when frames take less than this fraction of the budget.
+#define GOVERNOR_RESTORE_FRACTION 0.75
+
+struct qualityKnob
+{
+	std::string name;
+	float *value;
+	float best, worst, step;
+};
+
+struct frameGovernor
+{
+	double budget; // Milliseconds.
+	std::vector<qualityKnob> knobs;
+	std::vector<double> times; // Frame times of the current window.
+	double average; // Of the last full window.
+};
+
+frameGovernor *createFrameGovernor(double budgetMs)
+{
+	frameGovernor *governor = new frameGovernor;
+	governor->budget = budgetMs;
+	governor->average = 0;
+	return governor;
+}
+
+void destroyFrameGovernor(frameGovernor *governor)
+{
+	delete governor;
+}
+
+void addQualityKnob(frameGovernor *governor, const char *name, float *value, float best, float worst, float step)
+{
+	qualityKnob knob;
+	knob.name = name;
+	knob.value = value;
+	knob.best = best;
+	knob.worst = worst;
+	knob.step = std::fabs(step);
+	governor->knobs.push_back(knob);
+}
+
+// Turn a knob one step towards its worst (or best) value. Returns false if it is already there.
+static bool turnKnob(qualityKnob &knob, bool worse)
+{
+	float target = worse ? knob.worst : knob.best;
+	float distance = target - *knob.value;
+	if (std::fabs(distance) < 1e-6f)
+		return false;
+	*knob.value = std::fabs(distance) <= knob.step ? target : *knob.value + (distance > 0 ? knob.step : -knob.step);
+	return true;
+}
+
+bool governFrame(frameGovernor *governor, double frameMs)
+{
+	governor->times.push_back(frameMs);
+	if (governor->times.size() < GOVERNOR_WINDOW)
+		return false;
+
+	double sum = 0;
+	for (size_t i = 0; i < governor->times.size(); i++)
+		sum += governor->times[i];
+	governor->average = sum / governor->times.size();
+	governor->times.clear();
+
+	bool worse = governor->average > governor->budget;
+	if (!worse && governor->average > governor->budget * GOVERNOR_RESTORE_FRACTION)
+		return false;
+
+	// Give up quality from the first knob on, and take it back from the last one.
+	int n = (int)governor->knobs.size();
+	for (int k = 0; k < n; k++)
+	{
+		qualityKnob &knob = governor->knobs[worse ? k : n - 1 - k];
+		float before = *knob.value;
+		if (!turnKnob(knob, worse))
+			continue;
+		std::cout << "Governor: " << governor->average << " ms " << (worse ? "over" : "under") << " the " << governor->budget
+				  << " ms budget, " << knob.name << " " << before << " -> " << *knob.value << std::endl;
+		return true;
+	}
+	return false;
+}
+
+double averageFrameTime(const frameGovernor *governor)
+{
+	return governor->average;
+}
+
+void printGovernor(const frameGovernor *governor)
+{
+	std::cout << "Frame time: " << governor->average << " ms of " << governor->budget << " ms budget";
+	for (size_t k = 0; k < governor->knobs.size(); k++)
+		std::cout << ", " << governor->knobs[k].name << " " << *governor->knobs[k].value;
+	std::cout << std::endl;
+}
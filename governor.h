@@ -0,0 +1,30 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+// Frame time governor: trades rendering quality for frame time.
+//
+// Quality settings are registered as knobs, cheapest to give up first. When the
+// recent frame times run over the budget, the governor turns the next knob one
+// step towards its worst value; when they run well under, it turns the last one
+// back. Every adjustment is logged with the frame time that caused it.
+
+struct frameGovernor;
+
+// Govern frames to the given budget in milliseconds.
+frameGovernor *createFrameGovernor(double budgetMs);
+void destroyFrameGovernor(frameGovernor *governor);
+
+// Let the governor adjust *value between best and worst (either may be the
+// larger) in steps of step. Knobs are given up in the order they are added.
+void addQualityKnob(frameGovernor *governor, const char *name, float *value, float best, float worst, float step);
+
+// Record how long a frame took to render. Returns true if a knob was turned.
+bool governFrame(frameGovernor *governor, double frameMs);
+
+// Average of the recent frame times, in milliseconds.
+double averageFrameTime(const frameGovernor *governor);
+
+// Print the budget, recent frame time and every knob.
+void printGovernor(const frameGovernor *governor);
+
+#endif
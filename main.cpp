@@ -1,396 +1,804 @@
-/*
- * Solar.c
- *
- * Program to demonstrate how to use a local
- * coordinate method to position parts of a
- * model in relation to other model parts.
- *
- * Draws a simple solar system, with a sun, planet and moon.
- * Based on sample code from the OpenGL programming guide
- *		by Woo, Neider, Davis.  Addison-Wesley.
- *
- * Author: Samuel R. Buss
- *
- * Software accompanying the book
- *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
- *		by S. Buss, Cambridge University Press, 2003.
- *
- * Software is "as-is" and carries no warranty.  It may be used without
- *   restriction, but if you modify it, please change the filenames to
- *   prevent confusion between different versions.
- * Bug reports: Sam Buss, sbuss@ucsd.edu.
- * Web page: http://math.ucsd.edu/~sbuss/MathCG
- *
- * USAGE:
- *    Press "r" key to toggle (off and on) running the animation
- *    Press "s" key to single-step animation
- *    The up arrow key and down array key control the
- *			time step used in the animation rate.  Each key
- *			press multiplies or divides the times by a factor
- *			of two (2).
- *	  Press ESCAPE to exit.
- *
- */
-
-#include "Solar.hpp"
-#include <stdlib.h>
-#include <cmath>
-#include <GL/glut.h> // OpenGL Graphics Utility Library
-#include "getBMP.h"
-#include <iostream>
-
-static GLenum spinMode = GL_TRUE;
-static GLenum singleStep = GL_FALSE;
-
-// Year
-const GLfloat MERCURY_YEAR = 88.0;
-const GLfloat VENUS_YEAR = 225.0;
-const GLfloat EARTH_YEAR = 365.0;
-const GLfloat MARS_YEAR = 687.0;
-const GLfloat JUPITER_YEAR = 4332.0;
-const GLfloat SATURN_YEAR = 29.5 * 365.0;
-const GLfloat URANUS_YEAR = 84.0 * 365.0;
-const GLfloat NEPTUNE_YEAR = 165.0 * 365.0;
-
-// Day
-const GLfloat MERCURY_DAY = 58.7;
-const GLfloat VENUS_DAY = 243.0;
-const GLfloat EARTH_DAY = 1.0;
-const GLfloat MARS_DAY = 24.6 / 24;
-const GLfloat JUPITER_DAY = 9.83 / 24;
-const GLfloat SATURN_DAY = 10.23 / 24;
-const GLfloat URANUS_DAY = 17.23 / 24;
-const GLfloat NEPTUNE_DAY = 16.1 / 24;
-
-// These three variables control the animation's state and speed.
-static float HourOfDay = 0.0;
-static float DayOfYear = 0.0;
-static float AnimateIncrement = 24.0; // Time step for animation (hours)
-
-GLfloat WHITE[] = {1, 1, 1};
-GLfloat RED[] = {1, 0, 0};
-GLfloat GREEN[] = {0, 1, 0};
-GLfloat MAGENTA[] = {1, 0, 1};
-
-bool ambientEnabled = true;
-bool diffuseEnabled = true;
-bool specularEnabled = true;
-
-
-void SetupLighting()
-{
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-
-    GLfloat lightAmbient[] = {0.2f, 0.2f, 0.2f, 1.0f};
-    GLfloat lightDiffuse[] = {0.8f, 0.8f, 0.8f, 1.0f};
-    GLfloat lightSpecular[] = {1.0f, 1.0f, 1.0f, 1.0f};
-    GLfloat lightOff[] = {0.0f, 0.0f, 0.0f, 1.0f};
-
-    glLightfv(GL_LIGHT0, GL_AMBIENT, ambientEnabled ? lightAmbient : lightOff);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuseEnabled ? lightDiffuse : lightOff);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, specularEnabled ? lightSpecular : lightOff);
-
-    GLfloat lightPosition[] = {0.0f, 0.0f, 0.0f, 1.0f}; // Point light at Sun
-    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
-
-    glEnable(GL_COLOR_MATERIAL);
-    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
-}
-
-
-
-// glutKeyboardFunc is called below to set this function to handle
-//		all normal key presses.
-static void KeyPressFunc(unsigned char Key, int x, int y)
-{
-	switch (Key)
-	{
-	case 'R':
-	case 'r':
-		Key_r();
-		break;
-	case 's':
-	case 'S':
-		Key_s();
-		break;
-	case 'a':
-	case 'A':
-      ambientEnabled = !ambientEnabled;
-	  std::cout << "ambientEnabled: " << ambientEnabled << std::endl;
-      break;
-    case '1':
-      specularEnabled = !specularEnabled;
-	  std::cout << "specularenabled: " << specularEnabled << std::endl;
-      break;
-    case 'd': 
-	case 'D':
-      diffuseEnabled = !diffuseEnabled;
-	  std::cout << "diffuseEnabled: " << diffuseEnabled << std::endl;
-      break;
-	case 27: // Escape key
-		exit(1);
-	}
-	glutPostRedisplay();
-}
-
-// glutSpecialFunc is called below to set this function to handle
-//		all special key presses.  See glut.h for the names of
-//		special keys.
-static void SpecialKeyFunc(int Key, int x, int y)
-{
-	switch (Key)
-	{
-	case GLUT_KEY_UP:
-		Key_up();
-		break;
-	case GLUT_KEY_DOWN:
-		Key_down();
-		break;
-	}
-}
-
-static void Key_r(void)
-{
-	if (singleStep)
-	{ // If ending single step mode
-		singleStep = GL_FALSE;
-		spinMode = GL_TRUE; // Restart animation
-	}
-	else
-	{
-		spinMode = !spinMode; // Toggle animation on and off.
-	}
-}
-
-static void Key_s(void)
-{
-	singleStep = GL_TRUE;
-	spinMode = GL_TRUE;
-}
-
-static void Key_up(void)
-{
-	AnimateIncrement *= 2.0; // Double the animation time step
-}
-
-static void Key_down(void)
-{
-	AnimateIncrement /= 2.0; // Halve the animation time step
-}
-
-/*
- * Animate() handles the animation and the redrawing of the
- *		graphics window contents.
- */
-static void Animate(void)
-{
-
-	SetupLighting();
-	// Clear the rendering window
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	if (spinMode)
-	{
-		// Update the animation state
-		HourOfDay += AnimateIncrement;
-		DayOfYear += AnimateIncrement / 24.0;
-
-		//HourOfDay = HourOfDay - ((int)(HourOfDay / 24)) * 24;
-		//DayOfYear = DayOfYear - ((int)(DayOfYear / 365)) * 365;
-	}
-
-	// Clear the current matrix (Modelview)
-	glLoadIdentity();
-
-	// Back off eight units to be able to view from the origin.
-	glTranslatef(0.0, 0.0, -8.0);
-
-	// Rotate the plane of the elliptic (rotate the model's plane about the x axis by fifteen degrees)
-	glRotatef(15.0, 1.0, 0.0, 0.0);
-
-	// Draw the sun as a yellow, wireframe sphere
-	//glColor3f(.0, 1.0, 0.0);
-	imageFile* sunTexture = getBMP("images/sun.bmp");
-    glEnable(GL_TEXTURE_2D);
-
-    GLuint sunTextureID;
-    glGenTextures(1, &sunTextureID);
-    glBindTexture(GL_TEXTURE_2D, sunTextureID);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, sunTexture->width, sunTexture->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, sunTexture->data);
-
-    GLUquadric* sunQuad = gluNewQuadric();
-    gluQuadricTexture(sunQuad, GL_TRUE);
-    gluSphere(sunQuad, 0.4, 20, 20);
-
-    gluDeleteQuadric(sunQuad);
-    glDeleteTextures(1, &sunTextureID);
-    glDisable(GL_TEXTURE_2D);
-
-    delete[] sunTexture->data;
-    delete sunTexture;
-
-	struct Planet
-	{
-		float distance;
-		float year;
-		float day;
-		float size;
-		float r, g, b;
-		std::string image;
-	};
-
-	Planet planets[] = {
-		{0.579, MERCURY_YEAR, MERCURY_DAY, 0.1, 0.5, 0.5, 0.5, "images/mercury.bmp"},
-		{1.082, VENUS_YEAR, VENUS_DAY, 0.12, 0.9, 0.6, 0.1, "images/venus.bmp"},
-		{1.496, EARTH_YEAR, EARTH_DAY, 0.13, 0.2, 0.2, 1.0, "images/earth.bmp"},
-		{2.28, MARS_YEAR, MARS_DAY, 0.07, 1.0, 0.0, 0.0, "images/mars.bmp"},
-		{7.79, JUPITER_YEAR, JUPITER_DAY, 0.3, 1.0, 0.5, 0.0, "images/jupiter.bmp"},
-		{14.27, SATURN_YEAR, SATURN_DAY, 0.25, 1.0, 1.0, 0.5, "images/saturn.bmp"},
-		{28.71, URANUS_YEAR, URANUS_DAY, 0.2, 0.5, 0.5, 1.0, "images/uranus.bmp"},
-		{44.97, NEPTUNE_YEAR, NEPTUNE_DAY, 0.18, 0.3, 0.3, 0.8, "images/neptune.bmp"}};
-
-	for (auto &planet : planets)
-	{
-		imageFile* texture;
-		texture = getBMP(planet.image);
-		glPushMatrix();
-		glRotatef(360.0 * DayOfYear / planet.year, 0.0, 1.0, 0.0);
-		glTranslatef(planet.distance, 0.0, 0.0);				  
-		glRotatef(360.0 * HourOfDay / planet.day, 0.0, 1.0, 0.0); 
-		glEnable(GL_TEXTURE_2D);
-
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);		
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture->width, texture->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture->data);
-
-		GLUquadric* quad = gluNewQuadric();
-		gluQuadricTexture(quad, GL_TRUE);
-		gluSphere(quad, planet.size, 20, 20);
-
-		gluDeleteQuadric(quad);
-		glDeleteTextures(1, &textureID);
-		glDisable(GL_TEXTURE_2D);
-
-		glPopMatrix();
-
-		delete[] texture->data;
-		delete texture;
-		glPopMatrix();
-	}
-
-	glPushMatrix();
-	glRotatef(360.0 * DayOfYear / EARTH_YEAR, 0.0, 1.0, 0.0);
-	glTranslatef(1.496, 0.0, 0.0);
-	glRotatef(360.0 * 12.0 * DayOfYear / 365.0, 0.0, 1.0, 0.0);
-	glTranslatef(0.2, 0.0, 0.0);
-	glutWireSphere(0.05, 5, 5);
-	glPopMatrix();
-
-	// Flush the pipeline, and swap the buffers
-	glFlush();
-	glutSwapBuffers();
-
-	if (singleStep)
-	{
-		spinMode = GL_FALSE;
-	}
-
-	glutPostRedisplay(); // Request a re-draw for animation purposes
-}
-
-// Initialize OpenGL's rendering modes
-void OpenGLInit(void)
-{
-
-	glShadeModel(GL_FLAT);
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	glClearDepth(1.0);
-	glEnable(GL_DEPTH_TEST);
-	glLightfv(GL_LIGHT0, GL_AMBIENT, WHITE);    // Ambient light
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, WHITE);    // Diffuse light
-    glLightfv(GL_LIGHT0, GL_SPECULAR, WHITE);   // Specular light
-	const GLfloat LIGHT_POSITION[] = {0.0f, 0.0f, 0.0f, 1.0f}; // Point light
-    glLightfv(GL_LIGHT0, GL_POSITION, LIGHT_POSITION);
-	glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-
-    // Set up material properties for planets and other objects
-    glMaterialfv(GL_FRONT, GL_SPECULAR, WHITE);  // Specular reflection
-    glMaterialfv(GL_FRONT, GL_AMBIENT, WHITE);   // Ambient reflection
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, WHITE);   // Diffuse reflection
-    glMaterialf(GL_FRONT, GL_SHININESS, 50.0f);  // Shininess factor (higher = shinier)
-
-    // Set background color and clear depth
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Black background
-    glClearDepth(1.0f);
-
-    // Enable smooth shading for better visuals
-    glShadeModel(GL_SMOOTH);
-}
-
-// ResizeWindow is called when the window is resized
-static void ResizeWindow(int w, int h)
-{
-	float aspectRatio;
-	h = (h == 0) ? 1 : h;
-	w = (w == 0) ? 1 : w;
-	glViewport(0, 0, w, h); // View port uses whole window
-	aspectRatio = (float)w / (float)h;
-
-	// Set up the projection view matrix (not very well!)
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(60.0, aspectRatio, 1.0, 30.0);
-
-	// Select the Modelview matrix
-	glMatrixMode(GL_MODELVIEW);
-}
-
-
-
-// Main routine
-// Set up OpenGL, hook up callbacks, and start the main loop
-int main(int argc, char **argv)
-{
-	// Need to double buffer for animation
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-
-	// Create and position the graphics window
-	glutInitWindowPosition(0, 0);
-	glutInitWindowSize(600, 360);
-	glutCreateWindow("Systeme Solaire");
-
-	// Initialize OpenGL.
-	OpenGLInit();
-
-	// Set up callback functions for key presses
-	glutKeyboardFunc(KeyPressFunc);
-	glutSpecialFunc(SpecialKeyFunc);
-
-
-	// Set up the callback function for resizing windows
-	glutReshapeFunc(ResizeWindow);
-
-	// Callback for graphics image redrawing
-	glutDisplayFunc(Animate);
-
-	// Start the main loop.  glutMainLoop never returns.
-	glutMainLoop();
-
-	return (0); // Compiler requires this to be here. (Never reached)
-}
+/*
+ * Solar.c
+ *
+ * Program to demonstrate how to use a local
+ * coordinate method to position parts of a
+ * model in relation to other model parts.
+ *
+ * Draws a simple solar system, with a sun, planet and moon.
+ * Based on sample code from the OpenGL programming guide
+ *		by Woo, Neider, Davis.  Addison-Wesley.
+ *
+ * Author: Samuel R. Buss
+ *
+ * Software accompanying the book
+ *		3D Computer Graphics: A Mathematical Introduction with OpenGL,
+ *		by S. Buss, Cambridge University Press, 2003.
+ *
+ * Software is "as-is" and carries no warranty.  It may be used without
+ *   restriction, but if you modify it, please change the filenames to
+ *   prevent confusion between different versions.
+ * Bug reports: Sam Buss, sbuss@ucsd.edu.
+ * Web page: http://math.ucsd.edu/~sbuss/MathCG
+ *
+ * USAGE:
+ *    Press "r" key to toggle (off and on) running the animation
+ *    Press "s" key to single-step animation
+ *    The up arrow key and down array key control the
+ *			time step used in the animation rate.  Each key
+ *			press multiplies or divides the times by a factor
+ *			of two (2).
+ *    Press "v" key to reverse the direction of time.  With -nbody
+ *			the simulation retraces its path exactly when reversed.
+ *    Press "t" key to toggle the orbit trails, "o" the orbit paths.
+ *    Press "," and "." to jump a year back and forward.
+ *    Press "i" key to print frame, texture and simulation statistics.
+ *    Press "[" and "]" to lower and raise the render scale, and "f"
+ *			to switch the upscale filter between sharpen and bilinear.
+ *    With -catalog, page up and page down fly forward and back, the
+ *			left and right arrow keys turn, < and > halve and double
+ *			the distance flown per key press, and home returns to the
+ *			home system.
+ *	  Press ESCAPE to exit.
+ *
+ * Options:
+ *    -scene file         scene to show (default scenes/solar.scene)
+ *    -catalog file       star catalog to fly through
+ *    -nbody              move the bodies by N-body simulation instead of
+ *			their fixed orbits
+ *    -play file          play back a run recorded with solaire-sim -r,
+ *			for the days it covers
+ *    -texbudget mb       texture memory budget (default 256)
+ *    -fps n              frames per second at most, 0 for no cap (default 60)
+ *    -frametime ms       frame time the quality governor aims for (default 16.6)
+ *    -scale s            render scale, 0.25 to 1 (default 1)
+ *    -novsync            do not wait for vertical sync
+ *
+ */
+
+#include "Solar.hpp"
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <GL/glut.h> // OpenGL Graphics Utility Library
+#include <GL/glx.h>
+#include "getBMP.h"
+#include "texstream.h"
+#include "texture.h"
+#include "residency.h"
+#include "procedural.h"
+#include "getImage.h"
+#include "vtexture.h"
+#include "vtfile.h"
+#include "watch.h"
+#include "governor.h"
+#include "frametimer.h"
+#include "resolution.h"
+#include "scene.h"
+#include "galaxy.h"
+#include "trails.h"
+#include "orbits.h"
+#include "ephemeris.h"
+#include "ephfile.h"
+#include "nbody.h"
+#include "trajectory.h"
+#include <iostream>
+
+static GLenum spinMode = GL_TRUE;
+static GLenum singleStep = GL_FALSE;
+
+// These three variables control the animation's state and speed.
+// Double, so the time stays exact to well under a second for millennia either side of day 0.
+static double HourOfDay = 0.0;
+static double DayOfYear = 0.0;
+static double AnimateIncrement = 24.0; // Time step for animation (hours)
+
+GLfloat WHITE[] = {1, 1, 1};
+GLfloat RED[] = {1, 0, 0};
+GLfloat GREEN[] = {0, 1, 0};
+GLfloat MAGENTA[] = {1, 0, 1};
+
+// The bodies drawn, read from a scene file at startup.
+static scene world;
+static std::string sceneFile = "scenes/solar.scene"; // Set with -scene.
+static std::vector<float> bodyPositions; // Three per body, this frame.
+static ephemerisCache *ephemeris; // Interpolates bodyPositions between cached knots.
+static ephFile ephemerisFile; // Baked positions (solaire-bake -e), used for the times it covers.
+static nbodySim *simulation; // Moves the bodies by gravity instead, when started with -nbody.
+static trajectoryFile *recording; // A recorded run (solaire-sim -r) played back with -play, for the times it covers.
+static std::vector<GLuint> bodyTexture; // 0 for bodies drawn in their colour.
+static std::vector<virtualTexture *> bodyVT; // Tiles of the image, when a tile file was baked for it.
+static std::vector<int> bodyResident; // Residency handle of the texture.
+static std::vector<std::string> bodyTextureFile; // Image the texture is loaded from: the body's own or a generated map.
+
+// Galaxy mode: other star systems from a catalog, around the home system.
+static galaxy *stars; // NULL unless a catalog was given with -catalog.
+#define GALAXY_EXPAND_DISTANCE 60.0 // Systems closer than this are drawn with their bodies.
+#define GALAXY_FAR_PLANE 4000.0
+static float cameraPosition[3]; // Moved with page up and page down.
+static float cameraYaw; // Degrees; turned with the left and right arrow keys.
+static float flyStep = 2.0; // Distance moved per key press; doubled and halved with > and <.
+
+// Orbit trails: the recent path of every body.
+#define ORBIT_TRAIL_LENGTH 256 // Positions kept per body, one per animation step.
+static orbitTrails *trails;
+static bool showTrails = true; // Toggled with the t key.
+
+// Orbit paths: the whole ellipse of every body.
+static orbitPaths *orbitLines;
+static bool showOrbits = true; // Toggled with the o key.
+
+static textureStreamer *streamer; // Streams source images into their textures without stalling frames.
+static textureResidency *residency; // Keeps the textures within the texture memory budget.
+static size_t textureBudget = 256 << 20; // Bytes; set with -texbudget megabytes.
+
+// Size of the maps generated for bodies without a proper image.
+#define PROCEDURAL_WIDTH 1024
+#define PROCEDURAL_HEIGHT 512
+
+// Images narrower than this are placeholders, and a map is generated instead.
+#define PLACEHOLDER_WIDTH 256
+
+static fileWatcher *imageWatcher; // Reports images changed on disk, to reload them while running.
+
+// Frame scheduling: frames are drawn only when something changes.
+#define IDLE_POLL_MS 100 // How often to look for changed images while idle.
+static int frameRateCap = 60; // Frames per second at most, 0 for no cap; set with -fps.
+static bool frameWanted; // The last frame left work for the next one.
+static bool frameTimerDrawing; // The frame timer runs at the frame rate, not idle polling.
+static int frameTimerGeneration; // Timers of earlier generations are stale.
+
+// Quality the frame time governor trades for frame time.
+static frameGovernor *governor;
+static frameTimer *frameTiming; // Measures frames for the governor without waiting on the GPU.
+static double frameBudget = 16.6; // Milliseconds; set with -frametime.
+static float sphereDetail = 1.0; // Fraction of the slices and stacks of each sphere.
+static float mipBias = 0.0; // Added to the mip level of every texture lookup.
+static float governedScale = 1.0; // Fraction of renderScale the scene is rendered at.
+
+// Dynamic resolution: the scene is rendered at a fraction of the window size and upscaled.
+static resolutionScaler *scaler; // NULL without framebuffer objects.
+static float renderScale = 1.0; // Set with the [ and ] keys or -scale.
+static upscaleFilter upscale = UPSCALE_SHARPEN; // Toggled with the f key.
+static int windowWidth, windowHeight;
+
+bool ambientEnabled = true;
+bool diffuseEnabled = true;
+bool specularEnabled = true;
+
+
+void SetupLighting()
+{
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+
+    GLfloat lightAmbient[] = {0.2f, 0.2f, 0.2f, 1.0f};
+    GLfloat lightDiffuse[] = {0.8f, 0.8f, 0.8f, 1.0f};
+    GLfloat lightSpecular[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    GLfloat lightOff[] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    glLightfv(GL_LIGHT0, GL_AMBIENT, ambientEnabled ? lightAmbient : lightOff);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuseEnabled ? lightDiffuse : lightOff);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, specularEnabled ? lightSpecular : lightOff);
+
+    GLfloat lightPosition[] = {0.0f, 0.0f, 0.0f, 1.0f}; // Point light at Sun
+    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+
+    glEnable(GL_COLOR_MATERIAL);
+    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+}
+
+
+
+// The image to texture a body with: its own, unless that is missing or only a
+// placeholder, in which case a map is generated (or found cached).
+static std::string SurfaceImage(std::string name, std::string image, const surfaceParams &surface)
+{
+	int width, height;
+	if (getImageSize(image, width, height) && width >= PLACEHOLDER_WIDTH)
+		return image;
+	std::string generated = proceduralSurfaceFile(name, surface, PROCEDURAL_WIDTH, PROCEDURAL_HEIGHT);
+	return generated.empty() ? image : generated;
+}
+
+// Reload the textures of any image that was changed on disk. Only the changed
+// images are read again, on the streamer's workers, so this never stalls a frame.
+// Returns true if any texture is being reloaded.
+static bool ReloadChangedImages(void)
+{
+	if (!imageWatcher)
+		return false;
+	std::vector<std::string> changed;
+	pollFileWatcher(imageWatcher, changed);
+	bool reloading = false;
+	for (size_t i = 0; i < changed.size(); i++)
+	{
+		sourceImageChanged(changed[i]);
+		bool reloaded = reloadResidentTexture(residency, changed[i]);
+
+		// A body's own image may have replaced its placeholder, or become one, so choose
+		// between it and a generated map again and load whichever it is now.
+		for (int b = 0; b < world.count; b++)
+		{
+			if (bodyResident[b] < 0 || world.image[b] != changed[i])
+				continue;
+			std::string file = SurfaceImage(world.name[b], world.image[b], world.surface[b]);
+			if (file == bodyTextureFile[b])
+				continue;
+			bodyTextureFile[b] = file;
+			reloadResidentTexture(residency, bodyResident[b], file);
+			reloaded = true;
+		}
+
+		if (reloaded)
+		{
+			std::cout << "Reloading " << changed[i] << std::endl;
+			reloading = true;
+		}
+	}
+	return reloading;
+}
+
+// Drive the frame loop. While the simulation runs or something is still loading,
+// ask for a frame at most frameRateCap times a second; otherwise only poll for
+// changed images now and then. Input and window changes ask for frames themselves.
+static void StartFrameTimer(bool drawing)
+{
+	frameTimerDrawing = drawing;
+	int interval = !drawing ? IDLE_POLL_MS : (frameRateCap > 0 ? 1000 / frameRateCap : 0);
+	glutTimerFunc(interval, FrameTimer, ++frameTimerGeneration);
+}
+
+static void FrameTimer(int generation)
+{
+	if (generation != frameTimerGeneration)
+		return; // Replaced by a newer timer.
+	bool drawing = ReloadChangedImages() || spinMode || frameWanted;
+	if (drawing)
+		glutPostRedisplay();
+	StartFrameTimer(drawing);
+}
+
+// Set how many display refreshes a buffer swap waits for: 1 for vsync, 0 for none.
+static void SetSwapInterval(int interval)
+{
+	typedef int (*swapIntervalFunc)(int);
+	swapIntervalFunc swapInterval = (swapIntervalFunc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+	if (!swapInterval)
+		swapInterval = (swapIntervalFunc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalSGI");
+	if (swapInterval)
+		swapInterval(interval);
+}
+
+// Slices (and stacks) of a sphere drawn with the given number at full detail.
+static int SphereSlices(int full)
+{
+	return std::max(4, (int)(full * sphereDetail + 0.5f));
+}
+
+// Print what the renderer is holding and doing.
+static void PrintStats(void)
+{
+	printGovernor(governor);
+
+	residencyStats textures;
+	getResidencyStats(residency, textures);
+	std::cout << "Textures: " << textures.residentBytes / 1024 << " KB resident of " << textures.budget / 1024
+			  << " KB budget, " << textures.reduced << " of " << textures.textures << " at reduced resolution, "
+			  << textures.evictions << " evictions, " << textures.restores << " restores" << std::endl;
+
+	ephemerisStats orbits;
+	getEphemerisStats(ephemeris, orbits);
+	std::cout << "Ephemeris: " << orbits.hits << " interpolated and " << orbits.misses << " exact evaluations, "
+			  << orbits.rebuilds << " knot sets built, " << orbits.pendingJobs << " jobs pending" << std::endl;
+
+	if (simulation)
+	{
+		nbodyStats sim;
+		getNBodyStats(simulation, sim);
+		std::cout << "N-body: day " << sim.days << " in steps of " << sim.stepDays << " days, " << sim.stepsTaken
+				  << " steps taken, " << sim.lastSeekSteps << " in the last seek, " << sim.snapshots << " snapshots in "
+				  << sim.snapshotBytes / 1024 << " KB" << std::endl;
+	}
+
+	if (stars)
+	{
+		galaxyStats systems;
+		getGalaxyStats(stars, systems);
+		std::cout << "Galaxy: " << systems.expanded << " of " << systems.systems << " systems expanded, "
+				  << systems.animated << " animated this frame, " << systems.expansions << " expansions, "
+				  << systems.collapses << " collapses" << std::endl;
+	}
+}
+
+// Diameter in pixels of a sphere of the given radius around the modelview origin.
+static float ProjectedSize(float radius)
+{
+	GLfloat modelview[16], projection[16];
+	GLint viewport[4];
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float distance = sqrtf(modelview[12] * modelview[12] + modelview[13] * modelview[13] + modelview[14] * modelview[14]);
+	if (distance <= radius)
+		return (float)viewport[3];
+	return radius * projection[5] * viewport[3] / distance;
+}
+
+// glutKeyboardFunc is called below to set this function to handle
+//		all normal key presses.
+static void KeyPressFunc(unsigned char Key, int x, int y)
+{
+	switch (Key)
+	{
+	case 'R':
+	case 'r':
+		Key_r();
+		break;
+	case 's':
+	case 'S':
+		Key_s();
+		break;
+	case 'a':
+	case 'A':
+      ambientEnabled = !ambientEnabled;
+	  std::cout << "ambientEnabled: " << ambientEnabled << std::endl;
+      break;
+    case '1':
+      specularEnabled = !specularEnabled;
+	  std::cout << "specularenabled: " << specularEnabled << std::endl;
+      break;
+    case 'd': 
+	case 'D':
+      diffuseEnabled = !diffuseEnabled;
+	  std::cout << "diffuseEnabled: " << diffuseEnabled << std::endl;
+      break;
+	case 'v':
+	case 'V':
+		AnimateIncrement = -AnimateIncrement; // Run time backwards, or forwards again.
+		break;
+	case 't':
+	case 'T':
+		showTrails = !showTrails;
+		break;
+	case 'o':
+	case 'O':
+		showOrbits = !showOrbits;
+		break;
+	case 'i':
+	case 'I':
+		PrintStats();
+		break;
+	case '[':
+	case ']':
+		renderScale = std::min(1.0f, std::max(0.25f, renderScale + (Key == ']' ? 0.125f : -0.125f)));
+		std::cout << "Render scale: " << renderScale << std::endl;
+		break;
+	case '<':
+	case '>':
+		flyStep *= Key == '>' ? 2.0 : 0.5;
+		std::cout << "Fly step: " << flyStep << std::endl;
+		break;
+	case ',':
+	case '.':
+		DayOfYear += Key == '.' ? 365.25 : -365.25;
+		clearOrbitTrails(trails);
+		std::cout << "Day " << DayOfYear << std::endl;
+		break;
+	case 'f':
+	case 'F':
+		upscale = upscale == UPSCALE_SHARPEN ? UPSCALE_BILINEAR : UPSCALE_SHARPEN;
+		std::cout << "Upscale filter: " << (upscale == UPSCALE_SHARPEN ? "sharpen" : "bilinear") << std::endl;
+		break;
+	case 27: // Escape key
+		exit(1);
+	}
+	glutPostRedisplay();
+}
+
+// glutSpecialFunc is called below to set this function to handle
+//		all special key presses.  See glut.h for the names of
+//		special keys.
+static void SpecialKeyFunc(int Key, int x, int y)
+{
+	switch (Key)
+	{
+	case GLUT_KEY_UP:
+		Key_up();
+		break;
+	case GLUT_KEY_DOWN:
+		Key_down();
+		break;
+	case GLUT_KEY_PAGE_UP:
+	case GLUT_KEY_PAGE_DOWN:
+	{
+		float step = Key == GLUT_KEY_PAGE_UP ? flyStep : -flyStep;
+		cameraPosition[0] += step * sinf(cameraYaw * M_PI / 180);
+		cameraPosition[2] -= step * cosf(cameraYaw * M_PI / 180);
+		break;
+	}
+	case GLUT_KEY_LEFT:
+		cameraYaw -= 5.0;
+		break;
+	case GLUT_KEY_RIGHT:
+		cameraYaw += 5.0;
+		break;
+	case GLUT_KEY_HOME:
+		cameraPosition[0] = cameraPosition[1] = cameraPosition[2] = 0.0;
+		cameraYaw = 0.0;
+		break;
+	}
+	glutPostRedisplay();
+}
+
+static void Key_r(void)
+{
+	if (singleStep)
+	{ // If ending single step mode
+		singleStep = GL_FALSE;
+		spinMode = GL_TRUE; // Restart animation
+	}
+	else
+	{
+		spinMode = !spinMode; // Toggle animation on and off.
+	}
+}
+
+static void Key_s(void)
+{
+	singleStep = GL_TRUE;
+	spinMode = GL_TRUE;
+}
+
+static void Key_up(void)
+{
+	AnimateIncrement *= 2.0; // Double the animation time step
+}
+
+static void Key_down(void)
+{
+	AnimateIncrement /= 2.0; // Halve the animation time step
+}
+
+// Positions from the recorded run, if one is playing and covers the time. A corrupt recording is dropped.
+static bool PlayRecording(void)
+{
+	if (!recording || !trajectoryCovers(recording, DayOfYear))
+		return false;
+	if (evaluateTrajectory(recording, DayOfYear, bodyPositions.data()))
+		return true;
+	closeTrajectory(recording);
+	recording = NULL;
+	return false;
+}
+
+/*
+ * Animate() handles the animation and the redrawing of the
+ *		graphics window contents.
+ */
+static void Animate(void)
+{
+
+	// Upload whichever textures the workers have finished since the last frame.
+	serviceTextureStreamer(streamer);
+
+	beginFrameTimer(frameTiming);
+	int tilesWanted = 0; // Tiles of virtual textures still to stream.
+	glTexEnvf(GL_TEXTURE_FILTER_CONTROL, GL_TEXTURE_LOD_BIAS, mipBias);
+
+	if (scaler)
+		beginScaledFrame(scaler, windowWidth, windowHeight, renderScale * governedScale);
+
+	SetupLighting();
+	// Clear the rendering window
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	if (spinMode)
+	{
+		// Update the animation state
+		HourOfDay += AnimateIncrement;
+		DayOfYear += AnimateIncrement / 24.0;
+
+		//HourOfDay = HourOfDay - ((int)(HourOfDay / 24)) * 24;
+		//DayOfYear = DayOfYear - ((int)(DayOfYear / 365)) * 365;
+	}
+
+	// Clear the current matrix (Modelview)
+	glLoadIdentity();
+
+	// Back off eight units to be able to view from the origin.
+	glTranslatef(0.0, 0.0, -8.0);
+
+	// Rotate the plane of the elliptic (rotate the model's plane about the x axis by fifteen degrees)
+	glRotatef(15.0, 1.0, 0.0, 0.0);
+
+	// Fly the camera, in galaxy mode.
+	glRotatef(cameraYaw, 0.0, 1.0, 0.0);
+	glTranslatef(-cameraPosition[0], -cameraPosition[1], -cameraPosition[2]);
+
+	// Draw every body at its place in its orbit, turned by its own rotation.
+	if (!PlayRecording())
+	{
+		if (simulation)
+		{
+			seekNBody(simulation, DayOfYear);
+			nbodyPositions(simulation, bodyPositions);
+		}
+		else if (ephFileCovers(ephemerisFile, DayOfYear))
+			evaluateEphFile(ephemerisFile, DayOfYear, bodyPositions.data());
+		else
+			evaluateEphemeris(ephemeris, DayOfYear, bodyPositions);
+	}
+	if (spinMode)
+		recordOrbitTrails(trails, bodyPositions.data());
+	for (int b = 0; b < world.count; b++)
+	{
+		glPushMatrix();
+		glTranslatef(bodyPositions[3 * b], bodyPositions[3 * b + 1], bodyPositions[3 * b + 2]);
+		if (world.spin[b] > 0)
+			glRotatef(fmod(360.0 * HourOfDay / world.spin[b], 360.0), 0.0, 1.0, 0.0);
+		float radius = world.radius[b];
+
+		if (bodyVT[b])
+		{
+			glEnable(GL_TEXTURE_2D);
+			tilesWanted += drawVirtualTexturedSphere(bodyVT[b], radius);
+			glDisable(GL_TEXTURE_2D);
+		}
+		else
+		{
+			GLUquadric* quad = gluNewQuadric();
+			if (bodyTexture[b])
+			{
+				glEnable(GL_TEXTURE_2D);
+				glBindTexture(GL_TEXTURE_2D, bodyTexture[b]);
+				touchResidentTexture(residency, bodyResident[b], ProjectedSize(radius));
+				gluQuadricTexture(quad, GL_TRUE);
+			}
+			else
+				glColor3fv(&world.color[3 * b]);
+			gluSphere(quad, radius, SphereSlices(20), SphereSlices(20));
+			gluDeleteQuadric(quad);
+			glDisable(GL_TEXTURE_2D);
+			glColor3f(1.0, 1.0, 1.0);
+		}
+
+		glPopMatrix();
+	}
+
+	updateOrbitPaths(orbitLines, world);
+	if (showOrbits)
+		drawOrbitPaths(orbitLines, bodyPositions.data());
+	if (showTrails)
+		drawOrbitTrails(trails, world.color.data());
+
+	// The other systems: points far away, their bodies close by.
+	int systemsWaiting = stars ? drawGalaxy(stars, DayOfYear, SphereSlices(12)) : 0;
+
+	if (scaler)
+		endScaledFrame(scaler, upscale);
+
+	// The governor hears of each frame once the GPU has finished it, a frame or two later.
+	double frameMs = endFrameTimer(frameTiming);
+	if (frameMs >= 0)
+		governFrame(governor, frameMs);
+	glutSwapBuffers();
+
+	int texturesChanging = updateTextureResidency(residency);
+
+	if (singleStep)
+	{
+		spinMode = GL_FALSE;
+	}
+
+	// Draw again only while something will change: the animation, textures still loading, or systems still expanding.
+	frameWanted = tilesWanted > 0 || texturesChanging > 0 || pendingTextureStreams(streamer) > 0 || systemsWaiting > 0;
+	if ((spinMode || frameWanted) && !frameTimerDrawing)
+		StartFrameTimer(true);
+}
+
+// Initialize OpenGL's rendering modes
+void OpenGLInit(void)
+{
+
+	glShadeModel(GL_FLAT);
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClearDepth(1.0);
+	glEnable(GL_DEPTH_TEST);
+	glLightfv(GL_LIGHT0, GL_AMBIENT, WHITE);    // Ambient light
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, WHITE);    // Diffuse light
+    glLightfv(GL_LIGHT0, GL_SPECULAR, WHITE);   // Specular light
+	const GLfloat LIGHT_POSITION[] = {0.0f, 0.0f, 0.0f, 1.0f}; // Point light
+    glLightfv(GL_LIGHT0, GL_POSITION, LIGHT_POSITION);
+	glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+
+    // Set up material properties for planets and other objects
+    glMaterialfv(GL_FRONT, GL_SPECULAR, WHITE);  // Specular reflection
+    glMaterialfv(GL_FRONT, GL_AMBIENT, WHITE);   // Ambient reflection
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, WHITE);   // Diffuse reflection
+    glMaterialf(GL_FRONT, GL_SHININESS, 50.0f);  // Shininess factor (higher = shinier)
+
+    // Set background color and clear depth
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Black background
+    glClearDepth(1.0f);
+
+    // Enable smooth shading for better visuals
+    glShadeModel(GL_SMOOTH);
+}
+
+// Read every texture and build its mip chain once, rather than on every frame.
+void LoadTextures(void)
+{
+	if (useTexturePack("textures.pak"))
+		std::cout << "Using baked textures from textures.pak" << std::endl;
+
+	// Decode every image on worker threads and stream them in while the scene is already drawn.
+	std::vector<std::string> fileNames;
+	std::vector<int> bodies; // Body of each file.
+	bodyTexture.assign(world.count, 0);
+	bodyVT.assign(world.count, NULL);
+	bodyResident.assign(world.count, -1);
+	bodyTextureFile.assign(world.count, "");
+
+	int screenWidth = glutGet(GLUT_SCREEN_WIDTH), screenHeight = glutGet(GLUT_SCREEN_HEIGHT);
+	for (int b = 0; b < world.count; b++)
+	{
+		std::string image = world.image[b];
+		if (image.empty())
+			continue;
+		// Very large maps are baked into tile files and streamed instead.
+		bodyVT[b] = createVirtualTexture(vtFileName(image), screenWidth, screenHeight);
+		if (bodyVT[b])
+			std::cout << "Streaming " << image << " from " << vtFileName(image) << std::endl;
+		else
+		{
+			fileNames.push_back(SurfaceImage(world.name[b], image, world.surface[b]));
+			bodies.push_back(b);
+		}
+	}
+
+	// Bodies whose image cannot be read keep a placeholder in their own colour.
+	std::vector<float> colors;
+	for (size_t i = 0; i < bodies.size(); i++)
+		colors.insert(colors.end(), &world.color[3 * bodies[i]], &world.color[3 * bodies[i]] + 3);
+
+	std::vector<GLuint> loaded;
+	streamer = createTextureStreamer();
+	loadTextures(fileNames, loaded, streamer, colors.data());
+	residency = createTextureResidency(textureBudget, streamer);
+	for (size_t i = 0; i < loaded.size(); i++)
+	{
+		bodyTexture[bodies[i]] = loaded[i];
+		bodyResident[bodies[i]] = addResidentTexture(residency, loaded[i], fileNames[i]);
+		bodyTextureFile[bodies[i]] = fileNames[i];
+	}
+
+	imageWatcher = createFileWatcher("images");
+}
+
+// ResizeWindow is called when the window is resized
+static void ResizeWindow(int w, int h)
+{
+	float aspectRatio;
+	h = (h == 0) ? 1 : h;
+	w = (w == 0) ? 1 : w;
+	glViewport(0, 0, w, h); // View port uses whole window
+	windowWidth = w;
+	windowHeight = h;
+	aspectRatio = (float)w / (float)h;
+
+	// Set up the projection view matrix (not very well!)
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(60.0, aspectRatio, 1.0, stars ? GALAXY_FAR_PLANE : 30.0);
+
+	// Select the Modelview matrix
+	glMatrixMode(GL_MODELVIEW);
+	glutPostRedisplay();
+}
+
+
+
+// Main routine
+// Set up OpenGL, hook up callbacks, and start the main loop
+int main(int argc, char **argv)
+{
+	// Need to double buffer for animation
+	glutInit(&argc, argv);
+	bool vsync = true, nbody = false;
+	std::string playFile;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-texbudget" && i + 1 < argc)
+			textureBudget = (size_t)atoi(argv[++i]) << 20;
+		else if (arg == "-fps" && i + 1 < argc)
+			frameRateCap = atoi(argv[++i]);
+		else if (arg == "-frametime" && i + 1 < argc)
+			frameBudget = atof(argv[++i]);
+		else if (arg == "-scale" && i + 1 < argc)
+			renderScale = std::min(1.0f, std::max(0.25f, (float)atof(argv[++i])));
+		else if (arg == "-novsync")
+			vsync = false;
+		else if (arg == "-scene" && i + 1 < argc)
+			sceneFile = argv[++i];
+		else if (arg == "-nbody")
+			nbody = true;
+		else if (arg == "-play" && i + 1 < argc)
+			playFile = argv[++i];
+		else if (arg == "-catalog" && i + 1 < argc)
+		{
+			stars = createGalaxy(argv[++i], GALAXY_EXPAND_DISTANCE);
+			if (!stars)
+				return 1;
+		}
+	}
+	if (!loadScene(sceneFile, world))
+		return 1;
+	ephemeris = createEphemerisCache(world);
+	if (nbody)
+		simulation = createNBody(world);
+	bodyPositions.resize(3 * world.count);
+	if (!playFile.empty() && (recording = openTrajectory(playFile)) != NULL)
+	{
+		const trajHeader *h = trajectoryHeader(recording);
+		if (h->bodies == (uint32_t)world.count && h->sceneHash == sceneHash(world, true))
+			std::cout << "Playing " << playFile << ", days " << h->firstDay << " to "
+					  << h->firstDay + (h->samples - 1) * h->stepDays << std::endl;
+		else
+		{
+			std::cerr << playFile << ": recorded from a different scene or before it changed, ignored" << std::endl;
+			closeTrajectory(recording);
+			recording = NULL;
+		}
+	}
+	if (openEphFile(ephFileName(sceneFile), ephemerisFile))
+	{
+		if (ephemerisFile.header->bodies == (uint32_t)world.count && ephemerisFile.header->sceneHash == sceneHash(world, false))
+			std::cout << "Using baked positions from " << ephFileName(sceneFile) << std::endl;
+		else
+		{
+			std::cerr << ephFileName(sceneFile) << ": baked for a different scene or before it changed, ignored" << std::endl;
+			closeEphFile(ephemerisFile);
+		}
+	}
+
+	// Give up the cheapest quality first: sharpness of textures, then tessellation, then resolution.
+	governor = createFrameGovernor(frameBudget);
+	addQualityKnob(governor, "texture mip bias", &mipBias, 0.0, 2.0, 0.5);
+	addQualityKnob(governor, "sphere detail", &sphereDetail, 1.0, 0.3, 0.1);
+	addQualityKnob(governor, "render scale", &governedScale, 1.0, 0.5, 0.125);
+	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+
+	// Create and position the graphics window
+	glutInitWindowPosition(0, 0);
+	glutInitWindowSize(600, 360);
+	glutCreateWindow("Systeme Solaire");
+
+	// Initialize OpenGL.
+	OpenGLInit();
+	trails = createOrbitTrails(world.count, ORBIT_TRAIL_LENGTH);
+	orbitLines = createOrbitPaths();
+	SetSwapInterval(vsync ? 1 : 0);
+	scaler = createResolutionScaler();
+	frameTiming = createFrameTimer();
+	LoadTextures();
+
+	// Set up callback functions for key presses
+	glutKeyboardFunc(KeyPressFunc);
+	glutSpecialFunc(SpecialKeyFunc);
+
+
+	// Set up the callback function for resizing windows
+	glutReshapeFunc(ResizeWindow);
+
+	// Callback for graphics image redrawing
+	glutDisplayFunc(Animate);
+	StartFrameTimer(true);
+
+	// Start the main loop.  glutMainLoop never returns.
+	glutMainLoop();
+
+	return (0); // Compiler requires this to be here. (Never reached)
+}
@@ -0,0 +1,116 @@
+// Mip chain generation for RGBA images.
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mipmap.h"
+
+// Average one output row from source rows s0 and s1 (both RGBA, src width w).
+static void downsampleRow(const unsigned char *s0, const unsigned char *s1, int w, unsigned char *out, int dw)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	// Four output texels (eight source texels per row) at a time, at 16-bit precision.
+	if (w > 1)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; x + 4 <= dw; x += 4)
+		{
+			const unsigned char *a = s0 + 8 * x;
+			const unsigned char *b = s1 + 8 * x;
+			__m128i a0 = _mm_loadu_si128((const __m128i *)a);
+			__m128i a1 = _mm_loadu_si128((const __m128i *)(a + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i *)b);
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(b + 16));
+
+			// Vertical sums: texels 0-1, 2-3, 4-5 and 6-7.
+			__m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			__m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			__m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			__m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+			// Horizontal sums: pair even and odd texels.
+			__m128i q0 = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23), _mm_unpackhi_epi64(v01, v23));
+			__m128i q1 = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67), _mm_unpackhi_epi64(v45, v67));
+
+			q0 = _mm_srli_epi16(_mm_add_epi16(q0, two), 2);
+			q1 = _mm_srli_epi16(_mm_add_epi16(q1, two), 2);
+			_mm_storeu_si128((__m128i *)(out + 4 * x), _mm_packus_epi16(q0, q1));
+		}
+	}
+#endif
+
+	// Remaining texels, clamping at the right edge for one texel wide sources.
+	for (; x < dw; x++)
+	{
+		int x0 = 2 * x;
+		int x1 = std::min(2 * x + 1, w - 1);
+		for (int c = 0; c < 4; c++)
+		{
+			int sum = s0[4 * x0 + c] + s0[4 * x1 + c] + s1[4 * x0 + c] + s1[4 * x1 + c];
+			out[4 * x + c] = (unsigned char)((sum + 2) >> 2);
+		}
+	}
+}
+
+void downsampleBox(const imageFile *src, imageFile *dst)
+{
+	size_t srcPitch = 4 * (size_t)src->width;
+	size_t dstPitch = 4 * (size_t)dst->width;
+	for (int y = 0; y < dst->height; y++)
+	{
+		int y0 = 2 * y;
+		int y1 = std::min(2 * y + 1, src->height - 1);
+		downsampleRow(src->data + srcPitch * y0, src->data + srcPitch * y1, src->width,
+					  dst->data + dstPitch * y, dst->width);
+	}
+}
+
+size_t mipChainBytes(int width, int height)
+{
+	size_t total = 0;
+	for (;;)
+	{
+		total += 4 * (size_t)width * height;
+		if (width == 1 && height == 1)
+			return total;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+}
+
+void buildMipChainInto(const imageFile *image, unsigned char *storage, std::vector<imageFile> &levels)
+{
+	levels.clear();
+	int w = image->width, h = image->height;
+	for (;;)
+	{
+		imageFile level;
+		level.width = w;
+		level.height = h;
+		level.data = storage;
+		levels.push_back(level);
+		storage += 4 * (size_t)w * h;
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+
+	memcpy(levels[0].data, image->data, 4 * (size_t)image->width * image->height);
+	for (size_t i = 1; i < levels.size(); i++)
+		downsampleBox(&levels[i - 1], &levels[i]);
+}
+
+void buildMipChain(const imageFile *image, mipChain &chain)
+{
+	// Size every level first so that the storage is allocated once.
+	chain.storage.resize(mipChainBytes(image->width, image->height));
+	buildMipChainInto(image, chain.storage.data(), chain.levels);
+}
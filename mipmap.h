@@ -0,0 +1,30 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <vector>
+
+#include "getBMP.h"
+
+// A full mip chain of an RGBA image, from the source image (level 0) down to 1x1.
+// All levels live back to back in one allocation so that a small level is never
+// more than a few cache lines away from its neighbours.
+struct mipChain
+{
+	std::vector<imageFile> levels; // Level descriptors; data points into storage.
+	std::vector<unsigned char> storage; // Texels of every level.
+};
+
+// Halve an RGBA image with a 2x2 box filter (SSE2 when available).
+void downsampleBox(const imageFile *src, imageFile *dst);
+
+// Build the mip chain of an RGBA image.
+void buildMipChain(const imageFile *image, mipChain &chain);
+
+// Bytes of the whole mip chain of an RGBA image of the given size.
+size_t mipChainBytes(int width, int height);
+
+// Build the mip chain of an RGBA image into caller-provided storage of mipChainBytes()
+// bytes, such as a mapped pixel buffer. levels describes each level within storage.
+void buildMipChainInto(const imageFile *image, unsigned char *storage, std::vector<imageFile> &levels);
+
+#endif
@@ -0,0 +1,273 @@
+// N-body simulation: fixed-point leapfrog integration with a snapshot store for seeking.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+
+#include "nbody.h"
+
+// Steps per orbit of the fastest body, shrunk like ephemeris knots for eccentric orbits.
+#define NBODY_STEPS_PER_ORBIT 256
+
+// G times one solar mass, in scene units (10^8 km) cubed per day squared.
+#define NBODY_GM_SUN 9.906e-4
+
+// Values per body in the state and in every snapshot: position and velocity, one array per axis.
+#define STATE_ARRAYS 6
+
+// Fixed-point positions use this many bits for the reach of the scene, leaving
+// headroom below the 63 of an int64_t for bodies that wander beyond it.
+#define NBODY_POSITION_BITS 60
+
+struct nbodySim
+{
+	const scene *s;
+	int count;
+	double stepDays;
+	double unit; // Scene units per fixed-point tick.
+	std::vector<int64_t> state; // x, y, z arrays in ticks, then vx, vy, vz in ticks per step; count each.
+	std::vector<double> position; // The positions of the state in scene units, for the kicks.
+	std::vector<int64_t> kick; // Three arrays of count: half a step's velocity change at the current positions, in ticks per step.
+	std::vector<double> centralMu; // Pull towards the parent that keeps each body on its scene orbit.
+	std::vector<int> massive; // Bodies with a mass.
+	std::vector<double> massiveMu; // G m of each of them.
+	int64_t step; // Steps from day 0 of the current state.
+	std::map<int64_t, size_t> snapshots; // Step of each snapshot to its offset in store.
+	std::vector<int64_t> store;
+	nbodyStats stats;
+};
+
+// The half kicks at the current positions. They depend on nothing else, so a
+// step back recomputes exactly the kicks the step forward applied.
+static void accelerate(nbodySim *sim)
+{
+	const scene &s = *sim->s;
+	int n = sim->count;
+	for (int i = 0; i < 3 * n; i++)
+		sim->position[i] = sim->state[i] * sim->unit;
+	const double *x = &sim->position[0], *y = x + n, *z = y + n;
+	int64_t *kx = &sim->kick[0], *ky = kx + n, *kz = ky + n;
+	double toKick = sim->stepDays * sim->stepDays / 2 / sim->unit;
+	for (int b = 0; b < n; b++)
+	{
+		double sx = 0, sy = 0, sz = 0;
+
+		// The parent (or the origin, for a body without one) through the scene orbit.
+		int p = s.parent[b];
+		double rx = x[b] - (p >= 0 ? x[p] : 0), ry = y[b] - (p >= 0 ? y[p] : 0), rz = z[b] - (p >= 0 ? z[p] : 0);
+		double r2 = rx * rx + ry * ry + rz * rz;
+		if (sim->centralMu[b] > 0 && r2 > 0)
+		{
+			double k = sim->centralMu[b] / (r2 * sqrt(r2));
+			sx -= rx * k;
+			sy -= ry * k;
+			sz -= rz * k;
+		}
+
+		// Everything else with a mass.
+		for (size_t m = 0; m < sim->massive.size(); m++)
+		{
+			int j = sim->massive[m];
+			if (j == b || j == p)
+				continue;
+			double dx = x[j] - x[b], dy = y[j] - y[b], dz = z[j] - z[b];
+			double d2 = dx * dx + dy * dy + dz * dz;
+			if (d2 == 0)
+				continue;
+			double k = sim->massiveMu[m] / (d2 * sqrt(d2));
+			sx += dx * k;
+			sy += dy * k;
+			sz += dz * k;
+		}
+		kx[b] = llround(sx * toKick);
+		ky[b] = llround(sy * toKick);
+		kz[b] = llround(sz * toKick);
+	}
+}
+
+static void takeSnapshot(nbodySim *sim)
+{
+	if (sim->step % NBODY_SNAPSHOT_STEPS != 0 || sim->snapshots.count(sim->step))
+		return;
+	sim->snapshots[sim->step] = sim->store.size();
+	sim->store.insert(sim->store.end(), sim->state.begin(), sim->state.end());
+	sim->stats.snapshots = (int)sim->snapshots.size();
+	sim->stats.snapshotBytes = sim->store.size() * sizeof(int64_t);
+}
+
+static void restoreSnapshot(nbodySim *sim, int64_t step)
+{
+	const int64_t *snapshot = &sim->store[sim->snapshots[step]];
+	std::copy(snapshot, snapshot + sim->state.size(), sim->state.begin());
+	sim->step = step;
+	accelerate(sim);
+}
+
+// Kick, drift, kick, one step forward (direction 1) or back (-1). In integers
+// every operation is exact, so stepping back with the velocities negated
+// undoes a step forward bit for bit, and rewinding needs no stored history.
+static void leapfrog(nbodySim *sim, int direction)
+{
+	int n = sim->count;
+	int64_t *position = &sim->state[0], *velocity = position + 3 * n;
+	const int64_t *kick = &sim->kick[0];
+	if (direction < 0)
+		for (int i = 0; i < 3 * n; i++)
+			velocity[i] = -velocity[i];
+	for (int i = 0; i < 3 * n; i++)
+	{
+		velocity[i] += kick[i];
+		position[i] += velocity[i];
+	}
+	accelerate(sim);
+	for (int i = 0; i < 3 * n; i++)
+		velocity[i] += kick[i];
+	if (direction < 0)
+		for (int i = 0; i < 3 * n; i++)
+			velocity[i] = -velocity[i];
+	sim->step += direction;
+}
+
+nbodySim *createNBody(const scene &s)
+{
+	nbodySim *sim = new nbodySim;
+	sim->s = &s;
+	int n = sim->count = s.count;
+
+	sim->stepDays = 0;
+	sim->centralMu.assign(n, 0);
+	std::vector<double> reach(n); // Farthest a body gets from the origin on its scene orbit.
+	double farthest = 1;
+	for (int b = 0; b < n; b++)
+	{
+		double a = s.semiMajorAxis[b], period = s.period[b];
+		reach[b] = a * (1 + s.eccentricity[b]) + (s.parent[b] >= 0 ? reach[s.parent[b]] : 0);
+		farthest = std::max(farthest, reach[b]);
+		if (a > 0 && period > 0)
+		{
+			// Kepler's third law: mu = 4 pi^2 a^3 / T^2.
+			sim->centralMu[b] = 4 * M_PI * M_PI * a * a * a / (period * period);
+			double step = period * pow(1.0 - s.eccentricity[b], 1.5) / NBODY_STEPS_PER_ORBIT;
+			if (sim->stepDays == 0 || step < sim->stepDays)
+				sim->stepDays = step;
+		}
+		if (s.mass[b] > 0)
+		{
+			sim->massive.push_back(b);
+			sim->massiveMu.push_back(NBODY_GM_SUN * s.mass[b]);
+		}
+	}
+	if (sim->stepDays == 0)
+		sim->stepDays = 1; // Nothing moves.
+	sim->unit = farthest / ((int64_t)1 << NBODY_POSITION_BITS);
+
+	// Start on the scene orbits at day 0; parents come before their children.
+	std::vector<double> start((size_t)STATE_ARRAYS * n, 0);
+	double *position = &start[0], *velocity = position + 3 * n;
+	std::vector<int> root(n);
+	for (int b = 0; b < n; b++)
+	{
+		float p[3], v[3];
+		orbitState(s, b, 0, p, v);
+		int parent = s.parent[b];
+		root[b] = parent >= 0 ? root[parent] : b;
+		for (int c = 0; c < 3; c++)
+		{
+			position[c * n + b] = p[c] + (parent >= 0 ? position[c * n + parent] : 0);
+			velocity[c * n + b] = v[c] + (parent >= 0 ? velocity[c * n + parent] : 0);
+		}
+	}
+
+	// Set each root with a mass moving against the momentum of everything around it, so the system does not drift.
+	std::vector<double> momentum((size_t)3 * n, 0);
+	for (int b = 0; b < n; b++)
+		if (root[b] != b)
+			for (int c = 0; c < 3; c++)
+				momentum[3 * root[b] + c] += s.mass[b] * velocity[c * n + b];
+	for (int b = 0; b < n; b++)
+	{
+		int r = root[b];
+		if (s.mass[r] > 0)
+			for (int c = 0; c < 3; c++)
+				velocity[c * n + b] -= momentum[3 * r + c] / s.mass[r];
+	}
+
+	sim->state.resize(start.size());
+	for (int i = 0; i < 3 * n; i++)
+	{
+		sim->state[i] = llround(position[i] / sim->unit);
+		sim->state[3 * n + i] = llround(velocity[i] * sim->stepDays / sim->unit);
+	}
+	sim->position.resize((size_t)3 * n);
+	sim->kick.assign((size_t)3 * n, 0);
+	accelerate(sim);
+	sim->step = 0;
+
+	sim->stats.bodies = n;
+	sim->stats.stepDays = sim->stepDays;
+	sim->stats.days = 0;
+	sim->stats.stepsTaken = sim->stats.lastSeekSteps = 0;
+	sim->stats.snapshots = 0;
+	sim->stats.snapshotBytes = 0;
+	takeSnapshot(sim);
+	return sim;
+}
+
+void destroyNBody(nbodySim *sim)
+{
+	delete sim;
+}
+
+int64_t seekNBody(nbodySim *sim, double days)
+{
+	int64_t target = (int64_t)llround(days / sim->stepDays);
+
+	// Steps are exactly reversible, so start from whichever is nearest the target, on
+	// either side of it: the snapshots around it, or the current state, as during playback.
+	std::map<int64_t, size_t>::iterator after = sim->snapshots.lower_bound(target);
+	int64_t nearest = sim->step;
+	if (after != sim->snapshots.end() && llabs(after->first - target) < llabs(nearest - target))
+		nearest = after->first;
+	if (after != sim->snapshots.begin() && llabs((--after)->first - target) < llabs(nearest - target))
+		nearest = after->first;
+	if (nearest != sim->step)
+		restoreSnapshot(sim, nearest);
+
+	int64_t steps = 0;
+	int direction = target >= sim->step ? 1 : -1;
+	while (sim->step != target)
+	{
+		leapfrog(sim, direction);
+		takeSnapshot(sim);
+		steps++;
+	}
+
+	sim->stats.days = sim->step * sim->stepDays;
+	sim->stats.stepsTaken += steps;
+	sim->stats.lastSeekSteps = steps;
+	return steps;
+}
+
+void nbodyPositions(const nbodySim *sim, std::vector<float> &positions)
+{
+	int n = sim->count;
+	positions.resize(3 * n);
+	for (int b = 0; b < n; b++)
+		for (int c = 0; c < 3; c++)
+			positions[3 * b + c] = (float)(sim->state[c * n + b] * sim->unit);
+}
+
+void nbodyPositions(const nbodySim *sim, std::vector<double> &positions)
+{
+	int n = sim->count;
+	positions.resize(3 * n);
+	for (int b = 0; b < n; b++)
+		for (int c = 0; c < 3; c++)
+			positions[3 * b + c] = sim->state[c * n + b] * sim->unit;
+}
+
+void getNBodyStats(const nbodySim *sim, nbodyStats &stats)
+{
+	stats = sim->stats;
+}
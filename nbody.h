@@ -0,0 +1,55 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+// N-body simulation: the bodies of a scene moved by gravity instead of along
+// fixed ellipses, with a timeline that can be scrubbed.
+//
+// Every body is pulled towards its parent as hard as its scene orbit needs
+// (so a scene's exaggerated orbits still hold), and by every other body with a
+// mass, which is where the orbits start to perturb each other. The state starts
+// on the scene orbits at day 0 and is advanced in fixed steps by leapfrog.
+//
+// Positions and velocities are fixed-point integers, so a step backwards
+// exactly undoes a step forwards: playing time in reverse retraces the forward
+// run bit for bit, at any distance from day 0, without storing its history.
+//
+// Every NBODY_SNAPSHOT_STEPS steps the whole state is copied into a snapshot
+// store, one position and velocity array per axis. Seeking restores the
+// snapshot nearest the target (or carries on from the current state, if that
+// is nearer) and integrates only the rest of the way, so once a run has been
+// played through, any time in it is at most NBODY_SNAPSHOT_STEPS / 2 steps away.
+
+#include <stdint.h>
+#include <vector>
+
+#include "scene.h"
+
+#define NBODY_SNAPSHOT_STEPS 1024
+
+struct nbodySim;
+
+struct nbodyStats
+{
+	int bodies;
+	double stepDays;
+	double days; // Time of the current state.
+	int64_t stepsTaken; // Steps integrated since creation.
+	int64_t lastSeekSteps; // Steps the last seek integrated.
+	int snapshots;
+	size_t snapshotBytes;
+};
+
+// Start a simulation on the orbits of a scene, which must outlive it and not change.
+nbodySim *createNBody(const scene &s);
+void destroyNBody(nbodySim *sim);
+
+// Move the simulation to the given time in days, before or after day 0. Returns the number of steps integrated.
+int64_t seekNBody(nbodySim *sim, double days);
+
+// Position of every body (three floats each) in the current state.
+void nbodyPositions(const nbodySim *sim, std::vector<float> &positions);
+void nbodyPositions(const nbodySim *sim, std::vector<double> &positions);
+
+void getNBodyStats(const nbodySim *sim, nbodyStats &stats);
+
+#endif
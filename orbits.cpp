@@ -0,0 +1,166 @@
+// Orbit paths: curvature-adaptive sampling and the cached vertex buffer.
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <GL/glut.h>
+
+#include "orbits.h"
+
+// Largest distance, as a fraction of the semi-major axis, between a segment and the ellipse it stands for.
+#define ORBIT_PATH_TOLERANCE 1e-4
+
+// Bounds on the samples per orbit, for nearly straight and very tight ones.
+#define ORBIT_PATH_MIN_SAMPLES 32
+#define ORBIT_PATH_MAX_SAMPLES 4096
+
+// How much of the body's colour its orbit is drawn in.
+#define ORBIT_PATH_BRIGHTNESS 0.6f
+
+struct cachedOrbit
+{
+	float semiMajorAxis, eccentricity, inclination; // Elements last sampled.
+	float color[3];
+	std::vector<GLfloat> vertices; // Position and colour, six floats each.
+};
+
+// Orbits around the same parent, drawn together.
+struct orbitGroup
+{
+	int parent;
+	std::vector<GLint> first;
+	std::vector<GLsizei> count;
+};
+
+struct orbitPaths
+{
+	GLuint buffer;
+	std::vector<cachedOrbit> orbits; // One per body.
+	std::vector<orbitGroup> groups;
+};
+
+orbitPaths *createOrbitPaths(void)
+{
+	orbitPaths *paths = new orbitPaths;
+	glGenBuffers(1, &paths->buffer);
+	return paths;
+}
+
+void destroyOrbitPaths(orbitPaths *paths)
+{
+	glDeleteBuffers(1, &paths->buffer);
+	delete paths;
+}
+
+// Sample an orbit at steps of eccentric anomaly that keep the sagitta of each
+// segment, curvature * length^2 / 8, within the tolerance. With
+// q = sqrt(a^2 sin^2 E + b^2 cos^2 E) the curvature is ab / q^3 and ds/dE is q,
+// so the step is sqrt(8 tolerance q / b) with the tolerance relative to a.
+static void sampleOrbit(const scene &s, int body, cachedOrbit &orbit)
+{
+	double a = s.semiMajorAxis[body], e = s.eccentricity[body];
+	double b = a * sqrt(1 - e * e);
+	double minStep = 2 * M_PI / ORBIT_PATH_MAX_SAMPLES, maxStep = 2 * M_PI / ORBIT_PATH_MIN_SAMPLES;
+
+	orbit.vertices.clear();
+	for (double E = 0; E < 2 * M_PI - 0.5 * minStep;)
+	{
+		GLfloat vertex[6];
+		orbitPoint(s, body, E, vertex);
+		for (int c = 0; c < 3; c++)
+			vertex[3 + c] = orbit.color[c] * ORBIT_PATH_BRIGHTNESS;
+		orbit.vertices.insert(orbit.vertices.end(), vertex, vertex + 6);
+
+		double q = sqrt(a * a * sin(E) * sin(E) + b * b * cos(E) * cos(E));
+		E += std::min(maxStep, std::max(minStep, sqrt(8 * ORBIT_PATH_TOLERANCE * q / b)));
+	}
+}
+
+int updateOrbitPaths(orbitPaths *paths, const scene &s)
+{
+	bool rebuild = (int)paths->orbits.size() != s.count;
+	paths->orbits.resize(s.count);
+	int resampled = 0;
+	for (int b = 0; b < s.count; b++)
+	{
+		cachedOrbit &orbit = paths->orbits[b];
+		const float *color = &s.color[3 * b];
+		bool hasOrbit = s.parent[b] >= 0 && s.semiMajorAxis[b] > 0;
+		float a = hasOrbit ? s.semiMajorAxis[b] : 0;
+		if (!orbit.vertices.empty() && a == orbit.semiMajorAxis && s.eccentricity[b] == orbit.eccentricity &&
+			s.inclination[b] == orbit.inclination && std::equal(color, color + 3, orbit.color))
+			continue;
+		if (orbit.vertices.empty() && !hasOrbit)
+			continue;
+
+		orbit.semiMajorAxis = a;
+		orbit.eccentricity = s.eccentricity[b];
+		orbit.inclination = s.inclination[b];
+		std::copy(color, color + 3, orbit.color);
+		if (hasOrbit)
+			sampleOrbit(s, b, orbit);
+		else
+			orbit.vertices.clear();
+		rebuild = true;
+		resampled++;
+	}
+	if (!rebuild)
+		return 0;
+
+	// Lay the orbits out one parent after another, so that each parent's are drawn in one call.
+	std::vector<std::vector<int> > children(s.count);
+	for (int b = 0; b < s.count; b++)
+		if (!paths->orbits[b].vertices.empty())
+			children[s.parent[b]].push_back(b);
+	paths->groups.clear();
+	std::vector<GLfloat> vertices;
+	for (int parent = 0; parent < s.count; parent++)
+	{
+		orbitGroup group;
+		group.parent = parent;
+		for (size_t i = 0; i < children[parent].size(); i++)
+		{
+			int b = children[parent][i];
+			group.first.push_back((GLint)(vertices.size() / 6));
+			group.count.push_back((GLsizei)(paths->orbits[b].vertices.size() / 6));
+			vertices.insert(vertices.end(), paths->orbits[b].vertices.begin(), paths->orbits[b].vertices.end());
+		}
+		if (!group.first.empty())
+			paths->groups.push_back(group);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, paths->buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return resampled;
+}
+
+void drawOrbitPaths(orbitPaths *paths, const float *positions)
+{
+	if (paths->groups.empty())
+		return;
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glBindBuffer(GL_ARRAY_BUFFER, paths->buffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), (const GLvoid *)0);
+	glColorPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), (const GLvoid *)(3 * sizeof(GLfloat)));
+	for (size_t i = 0; i < paths->groups.size(); i++)
+	{
+		const orbitGroup &group = paths->groups[i];
+		const float *p = &positions[3 * group.parent];
+		glPushMatrix();
+		glTranslatef(p[0], p[1], p[2]);
+		glMultiDrawArrays(GL_LINE_LOOP, group.first.data(), group.count.data(), (GLsizei)group.first.size());
+		glPopMatrix();
+	}
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glPopAttrib();
+}
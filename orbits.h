@@ -0,0 +1,26 @@
+#ifndef ORBITS_H
+#define ORBITS_H
+
+// Orbit paths: the whole ellipse of every body, drawn as a line loop.
+//
+// Each orbit is sampled once, more densely where it curves most (around
+// periapsis and apoapsis), so that no segment strays from the true ellipse by
+// more than a small fraction of its size. The samples are cached in one vertex
+// buffer and a body is sampled again only when its orbital elements change.
+// Orbits are relative to their parent body, so those around the same parent are
+// drawn together with one glMultiDrawArrays() call.
+
+#include "scene.h"
+
+struct orbitPaths;
+
+orbitPaths *createOrbitPaths(void);
+void destroyOrbitPaths(orbitPaths *paths);
+
+// Resample the orbits whose elements changed since the last call. Returns the number resampled.
+int updateOrbitPaths(orbitPaths *paths, const scene &s);
+
+// Draw every orbit around its parent at the given body positions (three floats each, see scenePositions()).
+void drawOrbitPaths(orbitPaths *paths, const float *positions);
+
+#endif
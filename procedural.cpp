@@ -0,0 +1,347 @@
+// Procedural planet surfaces from fractal gradient noise.
+//
+// The noise is 3D Perlin gradient noise with the corner hashes computed
+// arithmetically instead of looked up in a permutation table, so that four
+// pixels of a row are evaluated at once with SSE2. The scalar path computes the
+// same values bit for bit for the pixels left over at the end of a row.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "getImage.h"
+#include "procedural.h"
+
+// Bump when the generator changes, so that cached maps are generated again.
+#define PROCEDURAL_VERSION 1
+
+#define PROCEDURAL_DIRECTORY "images/generated"
+
+// Noise fields a surface is shaded from: a large-scale field and a detail field.
+struct fieldSpec
+{
+	float scale[3]; // Of the unit sphere position, in units of params.frequency.
+	float offset; // Moves the field away from the other one.
+	int octaves;
+};
+
+static const fieldSpec baseFields[] = {{{1, 1, 1}, 0, 6}, {{1, 1, 4}, 0, 5}, {{1, 1, 1}, 0, 5}};
+static const fieldSpec detailFields[] = {{{0.5f, 0.5f, 0.5f}, 17.3f, 3}, {{4, 4, 4}, 17.3f, 3}, {{6, 6, 6}, 17.3f, 2}};
+
+static inline uint32_t hashCorner(int32_t x, int32_t y, int32_t z, uint32_t seed)
+{
+	uint32_t h = ((uint32_t)x * 0x8DA6B343u) ^ ((uint32_t)y * 0xD8163841u) ^ ((uint32_t)z * 0xCB1AB31Fu) ^ seed;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	return h;
+}
+
+// Dot product of the offset with one of Perlin's twelve edge gradients (and four repeats).
+static inline float gradient(uint32_t hash, float x, float y, float z)
+{
+	int h = (hash >> 8) & 15;
+	float u = h < 8 ? x : y;
+	float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+static inline float fade(float t)
+{
+	return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+static inline float lerp(float a, float b, float t)
+{
+	return a + t * (b - a);
+}
+
+static float noise(float x, float y, float z, uint32_t seed)
+{
+	float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+	int32_t ix = (int32_t)fx, iy = (int32_t)fy, iz = (int32_t)fz;
+	x -= fx;
+	y -= fy;
+	z -= fz;
+	float u = fade(x), v = fade(y), w = fade(z);
+
+	float n[8];
+	for (int c = 0; c < 8; c++)
+	{
+		int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+		n[c] = gradient(hashCorner(ix + dx, iy + dy, iz + dz, seed), x - dx, y - dy, z - dz);
+	}
+	float y0 = lerp(lerp(n[0], n[1], u), lerp(n[2], n[3], u), v);
+	float y1 = lerp(lerp(n[4], n[5], u), lerp(n[6], n[7], u), v);
+	return lerp(y0, y1, w);
+}
+
+// Sum of octaves of noise, each twice the frequency and half the amplitude, normalised to about -1..1.
+static float fractal(float x, float y, float z, int octaves, uint32_t seed)
+{
+	float sum = 0, amplitude = 1, total = 0;
+	for (int o = 0; o < octaves; o++)
+	{
+		sum += amplitude * noise(x, y, z, seed + o);
+		total += amplitude;
+		amplitude *= 0.5f;
+		x *= 2;
+		y *= 2;
+		z *= 2;
+	}
+	return sum / total;
+}
+
+#ifdef __SSE2__
+// Low 32 bits of the lane products; SSE2 only multiplies two lanes at a time.
+static inline __m128i mul32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i hashCorner4(__m128i x, __m128i y, __m128i z, __m128i seed)
+{
+	__m128i h = _mm_xor_si128(mul32(x, _mm_set1_epi32((int)0x8DA6B343u)), mul32(y, _mm_set1_epi32((int)0xD8163841u)));
+	h = _mm_xor_si128(h, _mm_xor_si128(mul32(z, _mm_set1_epi32((int)0xCB1AB31Fu)), seed));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+	h = mul32(h, _mm_set1_epi32(0x2C1B3C6D));
+	return _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+}
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 gradient4(__m128i hash, __m128 x, __m128 y, __m128 z)
+{
+	__m128i h = _mm_and_si128(_mm_srli_epi32(hash, 8), _mm_set1_epi32(15));
+	__m128 below8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+	__m128 below4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+	__m128 useX = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+	__m128 u = select4(below8, x, y);
+	__m128 v = select4(below4, y, select4(useX, x, z));
+	__m128 signU = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+	__m128 signV = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+	return _mm_add_ps(_mm_xor_ps(u, signU), _mm_xor_ps(v, signV));
+}
+
+static inline __m128 floor4(__m128 x, __m128i &i)
+{
+	i = _mm_cvttps_epi32(x);
+	__m128 f = _mm_cvtepi32_ps(i);
+	__m128 roundedUp = _mm_cmpgt_ps(f, x); // Truncation rounds negative values up.
+	i = _mm_add_epi32(i, _mm_castps_si128(roundedUp));
+	return _mm_sub_ps(f, _mm_and_ps(roundedUp, _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 fade4(__m128 t)
+{
+	__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15))), _mm_set1_ps(10));
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static __m128 noise4(__m128 x, __m128 y, __m128 z, uint32_t seed)
+{
+	__m128i ix, iy, iz;
+	x = _mm_sub_ps(x, floor4(x, ix));
+	y = _mm_sub_ps(y, floor4(y, iy));
+	z = _mm_sub_ps(z, floor4(z, iz));
+	__m128 u = fade4(x), v = fade4(y), w = fade4(z);
+	__m128i s = _mm_set1_epi32((int)seed), one = _mm_set1_epi32(1);
+	__m128 oneF = _mm_set1_ps(1.0f);
+
+	__m128 n[8];
+	for (int c = 0; c < 8; c++)
+	{
+		int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+		__m128i h = hashCorner4(dx ? _mm_add_epi32(ix, one) : ix, dy ? _mm_add_epi32(iy, one) : iy, dz ? _mm_add_epi32(iz, one) : iz, s);
+		n[c] = gradient4(h, dx ? _mm_sub_ps(x, oneF) : x, dy ? _mm_sub_ps(y, oneF) : y, dz ? _mm_sub_ps(z, oneF) : z);
+	}
+	__m128 y0 = lerp4(lerp4(n[0], n[1], u), lerp4(n[2], n[3], u), v);
+	__m128 y1 = lerp4(lerp4(n[4], n[5], u), lerp4(n[6], n[7], u), v);
+	return lerp4(y0, y1, w);
+}
+
+static __m128 fractal4(__m128 x, __m128 y, __m128 z, int octaves, uint32_t seed)
+{
+	__m128 sum = _mm_setzero_ps(), two = _mm_set1_ps(2.0f);
+	float amplitude = 1, total = 0;
+	for (int o = 0; o < octaves; o++)
+	{
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), noise4(x, y, z, seed + o)));
+		total += amplitude;
+		amplitude *= 0.5f;
+		x = _mm_mul_ps(x, two);
+		y = _mm_mul_ps(y, two);
+		z = _mm_mul_ps(z, two);
+	}
+	return _mm_div_ps(sum, _mm_set1_ps(total));
+}
+#endif
+
+static inline float smoothstep(float a, float b, float x)
+{
+	float t = std::min(1.0f, std::max(0.0f, (x - a) / (b - a)));
+	return t * t * (3 - 2 * t);
+}
+
+// Shade a pixel at the given latitude (sine) from its base and detail noise.
+static void shade(const surfaceParams &params, float sinLatitude, float base, float detail, unsigned char *out)
+{
+	float t;
+	switch (params.kind)
+	{
+	case SURFACE_BANDED:
+	{
+		// A slower wave added to the phase makes the bands uneven in width.
+		float latitude = sinLatitude + 0.15f * params.turbulence * base;
+		float phase = latitude * params.bands * (float)M_PI;
+		float band = 0.5f + 0.5f * sinf(phase + 2 * sinf(0.37f * phase));
+		t = 0.1f + 0.7f * band + 0.4f * detail;
+		break;
+	}
+	case SURFACE_SOLAR:
+		t = 0.5f + 1.5f * params.turbulence * base + 0.6f * detail;
+		break;
+	default:
+		t = 0.55f + 1.6f * params.turbulence * base - 0.4f * smoothstep(0.02f, 0.15f, detail);
+	}
+	t = std::min(1.0f, std::max(0.0f, t));
+	for (int c = 0; c < 3; c++)
+		out[c] = (unsigned char)(255 * lerp(params.dark[c], params.light[c], t) + 0.5f);
+	out[3] = 0xFF;
+}
+
+static void generateRows(const surfaceParams *params, imageFile *image, int y0, int y1, const float *cosLongitude, const float *sinLongitude)
+{
+	const fieldSpec &baseField = baseFields[params->kind], &detailField = detailFields[params->kind];
+	float f = params->frequency / (2 * (float)M_PI); // The equator is 2 pi around.
+	uint32_t baseSeed = params->seed * 2654435761u, detailSeed = baseSeed + 1013904223u;
+	float bx = baseField.scale[0] * f, by = baseField.scale[1] * f, bz = baseField.scale[2] * f;
+	float dx = detailField.scale[0] * f, dy = detailField.scale[1] * f, dz = detailField.scale[2] * f;
+
+	for (int y = y0; y < y1; y++)
+	{
+		// Bottom row first: row 0 is at the south pole, as gluSphere maps it.
+		float theta = (float)M_PI * (y + 0.5f) / image->height;
+		float radius = sinf(theta), pz = -cosf(theta);
+		unsigned char *out = image->data + 4 * (size_t)image->width * y;
+		int x = 0;
+#ifdef __SSE2__
+		__m128 r = _mm_set1_ps(radius);
+		__m128 baseZ = _mm_set1_ps(pz * bz + baseField.offset), detailZ = _mm_set1_ps(pz * dz + detailField.offset);
+		for (; x + 4 <= image->width; x += 4)
+		{
+			__m128 px = _mm_mul_ps(r, _mm_loadu_ps(cosLongitude + x)), py = _mm_mul_ps(r, _mm_loadu_ps(sinLongitude + x));
+			__m128 base = fractal4(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(bx)), _mm_set1_ps(baseField.offset)),
+								   _mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(by)), _mm_set1_ps(baseField.offset)), baseZ, baseField.octaves, baseSeed);
+			__m128 detail = fractal4(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(dx)), _mm_set1_ps(detailField.offset)),
+									 _mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(dy)), _mm_set1_ps(detailField.offset)), detailZ, detailField.octaves, detailSeed);
+			float b[4], d[4];
+			_mm_storeu_ps(b, base);
+			_mm_storeu_ps(d, detail);
+			for (int i = 0; i < 4; i++)
+				shade(*params, pz, b[i], d[i], out + 4 * (x + i));
+		}
+#endif
+		for (; x < image->width; x++)
+		{
+			float px = radius * cosLongitude[x], py = radius * sinLongitude[x];
+			float base = fractal(px * bx + baseField.offset, py * by + baseField.offset, pz * bz + baseField.offset, baseField.octaves, baseSeed);
+			float detail = fractal(px * dx + detailField.offset, py * dy + detailField.offset, pz * dz + detailField.offset, detailField.octaves, detailSeed);
+			shade(*params, pz, base, detail, out + 4 * x);
+		}
+	}
+}
+
+imageFile *generateSurface(const surfaceParams &params, int width, int height, int threads)
+{
+	imageFile *image = new imageFile;
+	image->width = width;
+	image->height = height;
+	image->data = new unsigned char[4 * (size_t)width * height];
+
+	// Every row shares the longitudes.
+	std::vector<float> cosLongitude(width), sinLongitude(width);
+	for (int x = 0; x < width; x++)
+	{
+		float phi = 2 * (float)M_PI * (x + 0.5f) / width;
+		cosLongitude[x] = cosf(phi);
+		sinLongitude[x] = sinf(phi);
+	}
+
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min(threads, height);
+
+	// Pixels are independent, so each thread takes a contiguous band of rows.
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; t++)
+		workers.push_back(std::thread(generateRows, &params, image, height * t / threads, height * (t + 1) / threads, cosLongitude.data(), sinLongitude.data()));
+	generateRows(&params, image, 0, height / threads, cosLongitude.data(), sinLongitude.data());
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	return image;
+}
+
+// FNV-1a over the bytes of a value.
+template <typename T>
+static void hashValue(uint32_t &hash, const T &value)
+{
+	const unsigned char *p = (const unsigned char *)&value;
+	for (size_t i = 0; i < sizeof(T); i++)
+		hash = (hash ^ p[i]) * 16777619u;
+}
+
+std::string proceduralSurfaceFile(std::string name, const surfaceParams &params, int width, int height)
+{
+	uint32_t hash = 2166136261u;
+	hashValue(hash, (int)PROCEDURAL_VERSION);
+	hashValue(hash, (int)params.kind);
+	hashValue(hash, params.seed);
+	for (int c = 0; c < 3; c++)
+	{
+		hashValue(hash, params.dark[c]);
+		hashValue(hash, params.light[c]);
+	}
+	hashValue(hash, params.frequency);
+	hashValue(hash, params.bands);
+	hashValue(hash, params.turbulence);
+
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "-%dx%d-%08x.bmp", width, height, hash);
+	std::string fileName = std::string(PROCEDURAL_DIRECTORY) + "/" + name + suffix;
+	if (isImageFile(fileName))
+		return fileName;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	imageFile *image = generateSurface(params, width, height);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	mkdir(PROCEDURAL_DIRECTORY, 0755);
+	bool written = writeBMP(fileName, image);
+	delete[] image->data;
+	delete image;
+	if (!written)
+		return "";
+	std::cout << "Generated " << fileName << " in " << ms << " ms" << std::endl;
+	return fileName;
+}
@@ -0,0 +1,40 @@
+#ifndef PROCEDURAL_H
+#define PROCEDURAL_H
+
+// Procedural planet surfaces, for bodies whose image is missing or too small.
+//
+// Maps are fractal gradient noise sampled on the unit sphere, so they wrap in
+// longitude and do not pinch at the poles, shaded into a colour ramp by kind of
+// surface.
+
+#include <string>
+
+#include "getBMP.h"
+
+enum surfaceKind
+{
+	SURFACE_ROCKY, // Mottled highlands and darker plains.
+	SURFACE_BANDED, // Gas giant cloud bands, warped by turbulence.
+	SURFACE_SOLAR // Granulated photosphere.
+};
+
+struct surfaceParams
+{
+	surfaceKind kind;
+	unsigned seed;
+	float dark[3], light[3]; // Ends of the colour ramp, 0 to 1.
+	float frequency; // Size of the largest features: noise cycles around the equator.
+	float bands; // Banded surfaces: bands from pole to pole.
+	float turbulence; // How far noise displaces the bands, or contrast of other surfaces.
+};
+
+// Generate a width x height RGBA map, bottom row first, with rows split across
+// threads (0 = one per core).
+imageFile *generateSurface(const surfaceParams &params, int width, int height, int threads = 0);
+
+// Name of a BMP file holding the surface for the named body, generated and
+// written to images/generated/ unless a file for the same parameters and size is
+// already there. Returns an empty string if it cannot be written.
+std::string proceduralSurfaceFile(std::string name, const surfaceParams &params, int width, int height);
+
+#endif
@@ -0,0 +1,239 @@
+// Texture residency: mip levels held per texture to fit a memory budget.
+
+#include <algorithm>
+#include <vector>
+
+#include "residency.h"
+#include "texstream.h"
+#include "texture.h"
+
+// Textures given back higher mip levels per frame, so that growing does not burst.
+#define RESIDENCY_RESTORES_PER_FRAME 1
+
+struct residentTexture
+{
+	GLuint texture;
+	std::string fileName;
+	int width, height; // Of the full image, 0 until it has been loaded.
+	std::vector<size_t> levelBytes; // Bytes of each level of the full mip chain.
+	int level; // First level of the full chain the texture holds.
+	int target; // Level being loaded, -1 if none.
+	unsigned long lastUsed; // Frame the texture was last drawn in.
+	float pixels; // Size on screen when last drawn.
+};
+
+struct textureResidency
+{
+	size_t budget;
+	textureStreamer *streamer;
+	std::vector<residentTexture> textures;
+	unsigned long frame;
+	unsigned long evictions, restores;
+};
+
+textureResidency *createTextureResidency(size_t budget, textureStreamer *streamer)
+{
+	textureResidency *residency = new textureResidency;
+	residency->budget = budget;
+	residency->streamer = streamer;
+	residency->frame = 1;
+	residency->evictions = residency->restores = 0;
+	return residency;
+}
+
+void destroyTextureResidency(textureResidency *residency)
+{
+	delete residency;
+}
+
+int addResidentTexture(textureResidency *residency, GLuint texture, std::string fileName)
+{
+	residentTexture t;
+	t.texture = texture;
+	t.fileName = fileName;
+	t.width = t.height = 0;
+	t.level = 0;
+	t.target = -1;
+	t.lastUsed = 0;
+	t.pixels = 0;
+	residency->textures.push_back(t);
+	return (int)residency->textures.size() - 1;
+}
+
+void touchResidentTexture(textureResidency *residency, int handle, float pixels)
+{
+	residentTexture &t = residency->textures[handle];
+	t.lastUsed = residency->frame;
+	t.pixels = pixels;
+}
+
+void reloadResidentTexture(textureResidency *residency, int handle, std::string fileName)
+{
+	residentTexture &t = residency->textures[handle];
+	t.fileName = fileName;
+	// The size may have changed, so measure the texture again once it has loaded.
+	t.levelBytes.clear();
+	t.width = t.height = 0;
+	t.level = 0;
+	t.target = -1;
+	reloadTexture(t.texture, fileName, 0, residency->streamer);
+}
+
+bool reloadResidentTexture(textureResidency *residency, std::string fileName)
+{
+	bool found = false;
+	for (size_t i = 0; i < residency->textures.size(); i++)
+		if (residency->textures[i].fileName == fileName)
+		{
+			reloadResidentTexture(residency, (int)i, fileName);
+			found = true;
+		}
+	return found;
+}
+
+// Bytes the texture holds from the given level of its full mip chain down.
+static size_t bytesFrom(const residentTexture &t, int level)
+{
+	size_t bytes = 0;
+	for (size_t i = level; i < t.levelBytes.size(); i++)
+		bytes += t.levelBytes[i];
+	return bytes;
+}
+
+// Record the size of every level of a fully loaded texture.
+static void measure(residentTexture &t)
+{
+	glBindTexture(GL_TEXTURE_2D, t.texture);
+	GLint maxLevel = 0;
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &t.width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &t.height);
+
+	t.levelBytes.clear();
+	for (GLint i = 0; i <= maxLevel; i++)
+	{
+		GLint w = 0, h = 0, compressed = GL_FALSE, size = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_WIDTH, &w);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_HEIGHT, &h);
+		if (w == 0 || h == 0)
+			break;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed)
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+		t.levelBytes.push_back(compressed ? (size_t)size : 4 * (size_t)w * h);
+	}
+}
+
+// Coarsest level that still has a texel per pixel at the size drawn. The texture
+// wraps around the sphere, so half its width and all its height face the viewer.
+static int wantedLevel(const residentTexture &t)
+{
+	int last = (int)t.levelBytes.size() - 1, level = 0;
+	while (level < last && (t.width >> (level + 1)) >= 2 * t.pixels && (t.height >> (level + 1)) >= t.pixels)
+		level++;
+	return level;
+}
+
+static bool leastRecentlyUsed(const residentTexture *a, const residentTexture *b)
+{
+	if (a->lastUsed != b->lastUsed)
+		return a->lastUsed < b->lastUsed;
+	return a->pixels < b->pixels;
+}
+
+int updateTextureResidency(textureResidency *residency)
+{
+	// Catch up with loads that have finished; textures still loading keep their place.
+	std::vector<residentTexture *> settled;
+	size_t loading = 0;
+	int changing = 0;
+	for (size_t i = 0; i < residency->textures.size(); i++)
+	{
+		residentTexture &t = residency->textures[i];
+		if (residency->streamer && isTextureStreaming(residency->streamer, t.texture))
+		{
+			loading += bytesFrom(t, std::min(t.level, t.target < 0 ? t.level : t.target));
+			changing++;
+			continue;
+		}
+		if (t.levelBytes.empty())
+			measure(t);
+		if (t.target >= 0)
+		{
+			t.level = t.target;
+			t.target = -1;
+		}
+		settled.push_back(&t);
+	}
+
+	// Plan the levels: drawn textures want what their size on screen can show,
+	// others keep what they have. Then cut the least recently used down to the budget.
+	std::vector<int> plan(settled.size());
+	size_t total = loading;
+	for (size_t i = 0; i < settled.size(); i++)
+	{
+		residentTexture &t = *settled[i];
+		plan[i] = t.lastUsed == residency->frame ? wantedLevel(t) : t.level;
+		total += bytesFrom(t, plan[i]);
+	}
+
+	std::vector<size_t> order(settled.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&settled](size_t a, size_t b) { return leastRecentlyUsed(settled[a], settled[b]); });
+	for (size_t k = 0; k < order.size() && total > residency->budget; k++)
+	{
+		size_t i = order[k];
+		residentTexture &t = *settled[i];
+		while (plan[i] < (int)t.levelBytes.size() - 1 && total > residency->budget)
+		{
+			total -= t.levelBytes[plan[i]];
+			plan[i]++;
+		}
+	}
+
+	// Shrink at once by dropping the finer levels the texture already holds, since that
+	// frees memory and reads nothing. Growing needs the image again, so grow a few at a
+	// time, largest on screen first.
+	int restores = 0;
+	for (size_t k = order.size(); k-- > 0;)
+	{
+		size_t i = order[k];
+		residentTexture &t = *settled[i];
+		if (plan[i] > t.level)
+		{
+			dropTextureLevels(t.texture, plan[i]);
+			t.level = plan[i];
+			residency->evictions++;
+			continue;
+		}
+		if (plan[i] == t.level)
+			continue;
+		changing++;
+		if (restores++ >= RESIDENCY_RESTORES_PER_FRAME)
+			continue;
+		residency->restores++;
+		t.target = plan[i];
+		reloadTexture(t.texture, t.fileName, plan[i], residency->streamer);
+	}
+
+	residency->frame++;
+	return changing;
+}
+
+void getResidencyStats(const textureResidency *residency, residencyStats &stats)
+{
+	stats.budget = residency->budget;
+	stats.residentBytes = 0;
+	stats.textures = (int)residency->textures.size();
+	stats.reduced = 0;
+	for (size_t i = 0; i < residency->textures.size(); i++)
+	{
+		const residentTexture &t = residency->textures[i];
+		stats.residentBytes += bytesFrom(t, t.level);
+		if (t.level > 0)
+			stats.reduced++;
+	}
+	stats.evictions = residency->evictions;
+	stats.restores = residency->restores;
+}
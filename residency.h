@@ -0,0 +1,52 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+// Texture residency under a memory budget.
+//
+// Each texture is stamped with the frame it was last drawn in and the size it
+// was drawn at on screen. A texture holds only the mip levels its projected size
+// can show, and when the textures together exceed the budget the least recently
+// used (then the smallest on screen) are cut down to lower mip levels, down to the
+// final 1x1 level as a placeholder. They grow back once they are drawn larger
+// and the budget has room again.
+
+#include <string>
+#include <GL/glut.h>
+
+struct textureResidency;
+struct textureStreamer;
+
+struct residencyStats
+{
+	size_t budget; // Bytes.
+	size_t residentBytes;
+	int textures;
+	int reduced; // Textures holding less than their full mip chain.
+	unsigned long evictions; // Times a texture was cut to lower mip levels.
+	unsigned long restores; // Times a texture was given back higher mip levels.
+};
+
+// Manage textures within budget bytes. Source images are reloaded through the streamer, if given.
+textureResidency *createTextureResidency(size_t budget, textureStreamer *streamer = NULL);
+void destroyTextureResidency(textureResidency *residency);
+
+// Manage a texture loaded with loadTexture(s) from the image file. Returns its handle.
+int addResidentTexture(textureResidency *residency, GLuint texture, std::string fileName);
+
+// Reload the textures of an image file that has changed, in full; they are
+// fitted to the budget again once loaded. Returns false if no texture uses it.
+bool reloadResidentTexture(textureResidency *residency, std::string fileName);
+
+// Reload a texture in full from another image file, and from that file in future reloads.
+void reloadResidentTexture(textureResidency *residency, int handle, std::string fileName);
+
+// Note that the texture is drawn this frame, covering the given number of pixels across.
+void touchResidentTexture(textureResidency *residency, int handle, float pixels);
+
+// Call once per frame after drawing: fits the textures to the budget, evicting
+// or restoring mip levels. Returns the number of textures still changing level.
+int updateTextureResidency(textureResidency *residency);
+
+void getResidencyStats(const textureResidency *residency, residencyStats &stats);
+
+#endif
@@ -0,0 +1,193 @@
+// Dynamic resolution rendering into a framebuffer object.
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <algorithm>
+#include <iostream>
+#include <GL/glut.h>
+
+#include "resolution.h"
+#include "texture.h"
+
+// How much the sharpening filter boosts the difference from the neighbouring texels.
+#define UPSCALE_SHARPNESS 0.6f
+
+static const char *sharpenSource =
+	"uniform sampler2D scene;\n"
+	"uniform vec2 texel; // One texel, in texture coordinates.\n"
+	"uniform vec2 limit; // Centre of the last texel rendered.\n"
+	"uniform float sharpness;\n"
+	"vec3 tap(vec2 uv) { return texture2D(scene, clamp(uv, 0.5 * texel, limit)).rgb; }\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 uv = gl_TexCoord[0].xy;\n"
+	"	vec3 c = tap(uv);\n"
+	"	vec3 around = tap(uv + vec2(texel.x, 0.0)) + tap(uv - vec2(texel.x, 0.0)) + tap(uv + vec2(0.0, texel.y)) + tap(uv - vec2(0.0, texel.y));\n"
+	"	gl_FragColor = vec4(clamp(c + sharpness * (c - 0.25 * around), 0.0, 1.0), 1.0);\n"
+	"}\n";
+
+struct resolutionScaler
+{
+	GLuint framebuffer, color, depth;
+	int width, height; // Allocated size.
+	int renderWidth, renderHeight; // Size rendered this frame.
+	int windowWidth, windowHeight;
+	bool active; // This frame renders into the framebuffer.
+	GLuint sharpen; // Program, 0 without GLSL.
+};
+
+static GLuint buildSharpenProgram(void)
+{
+	if (!hasExtension("GL_ARB_fragment_shader") && !hasExtension("GL_ARB_shading_language_100"))
+		return 0;
+	GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader, 1, &sharpenSource, NULL);
+	glCompileShader(shader);
+	GLint ok = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		std::cerr << "Sharpening filter: " << log << std::endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+resolutionScaler *createResolutionScaler(void)
+{
+	if (!hasExtension("GL_ARB_framebuffer_object"))
+		return NULL;
+
+	resolutionScaler *scaler = new resolutionScaler;
+	glGenFramebuffers(1, &scaler->framebuffer);
+	glGenTextures(1, &scaler->color);
+	glGenRenderbuffers(1, &scaler->depth);
+	scaler->width = scaler->height = 0;
+	scaler->renderWidth = scaler->renderHeight = 0;
+	scaler->windowWidth = scaler->windowHeight = 0;
+	scaler->active = false;
+	scaler->sharpen = buildSharpenProgram();
+	return scaler;
+}
+
+void destroyResolutionScaler(resolutionScaler *scaler)
+{
+	glDeleteFramebuffers(1, &scaler->framebuffer);
+	glDeleteTextures(1, &scaler->color);
+	glDeleteRenderbuffers(1, &scaler->depth);
+	if (scaler->sharpen)
+		glDeleteProgram(scaler->sharpen);
+	delete scaler;
+}
+
+// Size the framebuffer to the window.
+static void allocate(resolutionScaler *scaler, int width, int height)
+{
+	glBindTexture(GL_TEXTURE_2D, scaler->color);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, scaler->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, scaler->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scaler->color, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, scaler->depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Dynamic resolution: framebuffer incomplete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	scaler->width = width;
+	scaler->height = height;
+}
+
+void beginScaledFrame(resolutionScaler *scaler, int windowWidth, int windowHeight, float scale)
+{
+	scaler->windowWidth = windowWidth;
+	scaler->windowHeight = windowHeight;
+	scaler->active = scale < 1.0f;
+	if (!scaler->active)
+	{
+		glViewport(0, 0, windowWidth, windowHeight);
+		return;
+	}
+
+	if (scaler->width != windowWidth || scaler->height != windowHeight)
+		allocate(scaler, windowWidth, windowHeight);
+	scaler->renderWidth = std::max(1, (int)(windowWidth * scale + 0.5f));
+	scaler->renderHeight = std::max(1, (int)(windowHeight * scale + 0.5f));
+	glBindFramebuffer(GL_FRAMEBUFFER, scaler->framebuffer);
+	glViewport(0, 0, scaler->renderWidth, scaler->renderHeight);
+}
+
+void endScaledFrame(resolutionScaler *scaler, upscaleFilter filter)
+{
+	if (!scaler->active)
+		return;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, scaler->windowWidth, scaler->windowHeight);
+
+	glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, scaler->color);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glColor3f(1, 1, 1);
+
+	float s = (float)scaler->renderWidth / scaler->width, t = (float)scaler->renderHeight / scaler->height;
+	bool sharpen = filter == UPSCALE_SHARPEN && scaler->sharpen;
+	if (sharpen)
+	{
+		glUseProgram(scaler->sharpen);
+		glUniform1i(glGetUniformLocation(scaler->sharpen, "scene"), 0);
+		glUniform2f(glGetUniformLocation(scaler->sharpen, "texel"), 1.0f / scaler->width, 1.0f / scaler->height);
+		glUniform2f(glGetUniformLocation(scaler->sharpen, "limit"), s - 0.5f / scaler->width, t - 0.5f / scaler->height);
+		glUniform1f(glGetUniformLocation(scaler->sharpen, "sharpness"), UPSCALE_SHARPNESS);
+	}
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glBegin(GL_QUADS);
+	glTexCoord2f(0, 0);
+	glVertex2f(-1, -1);
+	glTexCoord2f(s, 0);
+	glVertex2f(1, -1);
+	glTexCoord2f(s, t);
+	glVertex2f(1, 1);
+	glTexCoord2f(0, t);
+	glVertex2f(-1, 1);
+	glEnd();
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+
+	if (sharpen)
+		glUseProgram(0);
+	glPopAttrib();
+}
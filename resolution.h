@@ -0,0 +1,29 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+// Dynamic resolution rendering.
+//
+// Below full scale the scene is rendered into the corner of an offscreen
+// framebuffer at a fraction of the window size and then upscaled to the window,
+// so fill cost falls with the square of the scale. The framebuffer is allocated
+// at the window size, so changing the scale every frame costs nothing.
+
+struct resolutionScaler;
+
+enum upscaleFilter
+{
+	UPSCALE_BILINEAR,
+	UPSCALE_SHARPEN // Bilinear, then an unsharp mask to win back some detail. Needs GLSL.
+};
+
+// NULL if the GL has no framebuffer objects, in which case the scene is always rendered at full scale.
+resolutionScaler *createResolutionScaler(void);
+void destroyResolutionScaler(resolutionScaler *scaler);
+
+// Start rendering a frame at scale (up to 1) times the window size. Sets the viewport.
+void beginScaledFrame(resolutionScaler *scaler, int windowWidth, int windowHeight, float scale);
+
+// Upscale the frame to the window with the given filter.
+void endScaledFrame(resolutionScaler *scaler, upscaleFilter filter);
+
+#endif
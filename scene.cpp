@@ -0,0 +1,373 @@
+// Scene files, text and binary.
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+
+#include "scene.h"
+
+// Binary scene: header, one record per body, then the NUL-terminated strings the records point into.
+struct sceneHeader
+{
+	char magic[4]; // "SLSC"
+	uint32_t version;
+	uint32_t count;
+	uint32_t stringBytes;
+};
+
+struct sceneRecord
+{
+	int32_t parent;
+	uint32_t name, image; // Offsets into the strings.
+	float semiMajorAxis, eccentricity, inclination, period, phase;
+	float spin, radius, color[3];
+	float mass;
+	uint32_t surfaceKind, surfaceSeed;
+	float dark[3], light[3], frequency, bands, turbulence;
+};
+
+#define SCENE_VERSION 2
+
+static void addBody(scene &s, std::string name)
+{
+	static const surfaceParams plain = {SURFACE_ROCKY, 0, {0.3f, 0.3f, 0.3f}, {0.7f, 0.7f, 0.7f}, 6, 0, 0.6f};
+	s.count++;
+	s.name.push_back(name);
+	s.parent.push_back(-1);
+	s.semiMajorAxis.push_back(0);
+	s.eccentricity.push_back(0);
+	s.inclination.push_back(0);
+	s.period.push_back(0);
+	s.phase.push_back(0);
+	s.spin.push_back(0);
+	s.mass.push_back(0);
+	s.radius.push_back(0.1f);
+	for (int c = 0; c < 3; c++)
+		s.color.push_back(1);
+	s.image.push_back("");
+	s.surface.push_back(plain);
+}
+
+static void clearScene(scene &s)
+{
+	s = scene();
+	s.count = 0;
+}
+
+static int findBody(const scene &s, std::string name)
+{
+	for (int i = 0; i < s.count; i++)
+		if (s.name[i] == name)
+			return i;
+	return -1;
+}
+
+static bool loadSceneText(std::string fileName, std::ifstream &inFile, scene &s)
+{
+	std::string line;
+	for (int lineNumber = 1; std::getline(inFile, line); lineNumber++)
+	{
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream in(line);
+		std::string key;
+		if (!(in >> key))
+			continue;
+
+		const char *error = NULL;
+		int b = s.count - 1;
+		if (key == "body")
+		{
+			std::string name;
+			if (!(in >> name))
+				error = "body needs a name";
+			else if (findBody(s, name) >= 0)
+				error = "body defined twice";
+			else
+				addBody(s, name);
+		}
+		else if (b < 0)
+			error = "field before the first body";
+		else if (key == "parent")
+		{
+			std::string name;
+			in >> name;
+			s.parent[b] = findBody(s, name);
+			if (s.parent[b] < 0 || s.parent[b] == b)
+				error = "parent must be a body defined earlier";
+		}
+		else if (key == "orbit")
+		{
+			if (!(in >> s.semiMajorAxis[b] >> s.eccentricity[b] >> s.inclination[b] >> s.period[b] >> s.phase[b]))
+				error = "orbit needs a e i period phase";
+			else if (s.eccentricity[b] < 0 || s.eccentricity[b] >= 1)
+				error = "orbit eccentricity must be in [0, 1)";
+		}
+		else if (key == "spin")
+		{
+			if (!(in >> s.spin[b]))
+				error = "spin needs a day length";
+		}
+		else if (key == "mass")
+		{
+			if (!(in >> s.mass[b]) || s.mass[b] < 0)
+				error = "mass needs a value of at least 0";
+		}
+		else if (key == "radius")
+		{
+			if (!(in >> s.radius[b]))
+				error = "radius needs a value";
+		}
+		else if (key == "color")
+		{
+			if (!(in >> s.color[3 * b] >> s.color[3 * b + 1] >> s.color[3 * b + 2]))
+				error = "color needs r g b";
+		}
+		else if (key == "image")
+		{
+			if (!(in >> s.image[b]))
+				error = "image needs a file name";
+		}
+		else if (key == "surface")
+		{
+			surfaceParams &p = s.surface[b];
+			std::string kind;
+			in >> kind >> p.seed >> p.dark[0] >> p.dark[1] >> p.dark[2] >> p.light[0] >> p.light[1] >> p.light[2] >> p.frequency >> p.bands >> p.turbulence;
+			if (!in)
+				error = "surface needs kind seed dark(r g b) light(r g b) frequency bands turbulence";
+			else if (kind == "rocky")
+				p.kind = SURFACE_ROCKY;
+			else if (kind == "banded")
+				p.kind = SURFACE_BANDED;
+			else if (kind == "solar")
+				p.kind = SURFACE_SOLAR;
+			else
+				error = "surface kind must be rocky, banded or solar";
+		}
+		else
+			error = "unknown field";
+
+		if (error)
+		{
+			std::cerr << fileName << ":" << lineNumber << ": " << error << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool loadSceneBinary(std::string fileName, std::ifstream &inFile, scene &s)
+{
+	sceneHeader header;
+	std::vector<sceneRecord> records;
+	std::vector<char> strings;
+	if (inFile.read((char *)&header, sizeof(header)) && header.version == SCENE_VERSION && header.count < (1u << 24) &&
+		header.stringBytes < (1u << 28))
+	{
+		records.resize(header.count);
+		strings.resize(header.stringBytes + 1, '\0'); // Extra NUL, so that every offset ends in a string.
+		inFile.read((char *)records.data(), records.size() * sizeof(sceneRecord));
+		inFile.read(strings.data(), header.stringBytes);
+	}
+	if (!inFile || records.size() != header.count)
+	{
+		std::cerr << fileName << ": truncated or unsupported binary scene" << std::endl;
+		return false;
+	}
+
+	for (uint32_t b = 0; b < header.count; b++)
+	{
+		const sceneRecord &r = records[b];
+		if (r.name > header.stringBytes || r.image > header.stringBytes || r.parent >= (int32_t)b || r.parent < -1 ||
+			r.surfaceKind > SURFACE_SOLAR || !(r.eccentricity >= 0 && r.eccentricity < 1) || !(r.mass >= 0))
+		{
+			std::cerr << fileName << ": corrupt binary scene" << std::endl;
+			return false;
+		}
+		addBody(s, &strings[r.name]);
+		s.parent[b] = r.parent;
+		s.semiMajorAxis[b] = r.semiMajorAxis;
+		s.eccentricity[b] = r.eccentricity;
+		s.inclination[b] = r.inclination;
+		s.period[b] = r.period;
+		s.phase[b] = r.phase;
+		s.spin[b] = r.spin;
+		s.mass[b] = r.mass;
+		s.radius[b] = r.radius;
+		memcpy(&s.color[3 * b], r.color, sizeof(r.color));
+		s.image[b] = &strings[r.image];
+		surfaceParams &p = s.surface[b];
+		p.kind = (surfaceKind)r.surfaceKind;
+		p.seed = r.surfaceSeed;
+		memcpy(p.dark, r.dark, sizeof(p.dark));
+		memcpy(p.light, r.light, sizeof(p.light));
+		p.frequency = r.frequency;
+		p.bands = r.bands;
+		p.turbulence = r.turbulence;
+	}
+	return true;
+}
+
+bool loadScene(std::string fileName, scene &s)
+{
+	clearScene(s);
+	std::ifstream inFile(fileName.c_str(), std::ios::binary);
+	char magic[4] = {0, 0, 0, 0};
+	if (!inFile.read(magic, 4))
+	{
+		std::cerr << fileName << ": cannot read scene" << std::endl;
+		return false;
+	}
+	inFile.seekg(0);
+
+	bool loaded = memcmp(magic, "SLSC", 4) == 0 ? loadSceneBinary(fileName, inFile, s) : loadSceneText(fileName, inFile, s);
+	if (loaded && s.count == 0)
+	{
+		std::cerr << fileName << ": scene has no bodies" << std::endl;
+		loaded = false;
+	}
+	if (!loaded)
+		clearScene(s);
+	return loaded;
+}
+
+bool writeSceneBinary(std::string fileName, const scene &s)
+{
+	std::string strings;
+	std::vector<sceneRecord> records(s.count);
+	for (int b = 0; b < s.count; b++)
+	{
+		sceneRecord &r = records[b];
+		memset(&r, 0, sizeof(r));
+		r.parent = s.parent[b];
+		r.name = (uint32_t)strings.size();
+		strings += s.name[b];
+		strings += '\0';
+		r.image = (uint32_t)strings.size();
+		strings += s.image[b];
+		strings += '\0';
+		r.semiMajorAxis = s.semiMajorAxis[b];
+		r.eccentricity = s.eccentricity[b];
+		r.inclination = s.inclination[b];
+		r.period = s.period[b];
+		r.phase = s.phase[b];
+		r.spin = s.spin[b];
+		r.mass = s.mass[b];
+		r.radius = s.radius[b];
+		memcpy(r.color, &s.color[3 * b], sizeof(r.color));
+		const surfaceParams &p = s.surface[b];
+		r.surfaceKind = p.kind;
+		r.surfaceSeed = p.seed;
+		memcpy(r.dark, p.dark, sizeof(r.dark));
+		memcpy(r.light, p.light, sizeof(r.light));
+		r.frequency = p.frequency;
+		r.bands = p.bands;
+		r.turbulence = p.turbulence;
+	}
+
+	sceneHeader header;
+	memcpy(header.magic, "SLSC", 4);
+	header.version = SCENE_VERSION;
+	header.count = (uint32_t)s.count;
+	header.stringBytes = (uint32_t)strings.size();
+
+	std::ofstream outFile(fileName.c_str(), std::ios::binary);
+	outFile.write((const char *)&header, sizeof(header));
+	outFile.write((const char *)records.data(), records.size() * sizeof(sceneRecord));
+	outFile.write(strings.data(), strings.size());
+	if (!outFile)
+	{
+		std::cerr << fileName << ": cannot write scene" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// FNV-1a, carried on from hash.
+static void hashBytes(uint64_t &hash, const void *data, size_t bytes)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < bytes; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+}
+
+uint64_t sceneHash(const scene &s, bool masses)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hashBytes(hash, &s.count, sizeof(s.count));
+	hashBytes(hash, s.parent.data(), s.count * sizeof(int));
+	const std::vector<float> *elements[] = {&s.semiMajorAxis, &s.eccentricity, &s.inclination, &s.period, &s.phase};
+	for (size_t i = 0; i < sizeof(elements) / sizeof(elements[0]); i++)
+		hashBytes(hash, elements[i]->data(), s.count * sizeof(float));
+	if (masses)
+		hashBytes(hash, s.mass.data(), s.count * sizeof(float));
+	return hash;
+}
+
+std::string sceneSiblingName(std::string sceneName, const char *extension)
+{
+	size_t dot = sceneName.find_last_of('.');
+	size_t slash = sceneName.find_last_of('/');
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		sceneName.erase(dot);
+	return sceneName + extension;
+}
+
+void orbitPoint(const scene &s, int body, double eccentricAnomaly, float p[3])
+{
+	// In the orbital plane, x towards periapsis, advancing the way glRotatef() turns about y.
+	double e = s.eccentricity[body], a = s.semiMajorAxis[body];
+	double x = a * (cos(eccentricAnomaly) - e), z = -a * sqrt(1 - e * e) * sin(eccentricAnomaly);
+	double incl = s.inclination[body] * M_PI / 180;
+	p[0] = (float)x;
+	p[1] = (float)(-z * sin(incl));
+	p[2] = (float)(z * cos(incl));
+}
+
+// Solve Kepler's equation M = E - e sin E for the eccentric anomaly by Newton's method.
+static double eccentricAnomaly(const scene &s, int body, double days)
+{
+	double e = s.eccentricity[body];
+	double meanAnomaly = s.phase[body] * M_PI / 180;
+	if (s.period[body] > 0)
+		meanAnomaly += 2 * M_PI * fmod(days / s.period[body], 1.0);
+	meanAnomaly = fmod(meanAnomaly, 2 * M_PI);
+	if (meanAnomaly < 0)
+		meanAnomaly += 2 * M_PI; // Before day 0; Newton's method starts from pi for eccentric orbits, so keep M in [0, 2 pi).
+	double E = e < 0.8 ? meanAnomaly : M_PI;
+	for (int k = 0; k < 8; k++)
+		E -= (E - e * sin(E) - meanAnomaly) / (1 - e * cos(E));
+	return E;
+}
+
+void orbitState(const scene &s, int body, double days, float p[3], float v[3])
+{
+	double E = eccentricAnomaly(s, body, days);
+	orbitPoint(s, body, E, p);
+
+	// dE/dt = n / (1 - e cos E), times the derivative of the point in E.
+	double e = s.eccentricity[body], a = s.semiMajorAxis[body];
+	double rate = s.period[body] > 0 ? 2 * M_PI / s.period[body] / (1 - e * cos(E)) : 0;
+	double vx = -a * sin(E) * rate, vz = -a * sqrt(1 - e * e) * cos(E) * rate;
+	double incl = s.inclination[body] * M_PI / 180;
+	v[0] = (float)vx;
+	v[1] = (float)(-vz * sin(incl));
+	v[2] = (float)(vz * cos(incl));
+}
+
+void scenePositions(const scene &s, double days, std::vector<float> &positions)
+{
+	positions.resize(3 * s.count);
+	for (int b = 0; b < s.count; b++)
+	{
+		float *p = &positions[3 * b];
+		orbitPoint(s, b, eccentricAnomaly(s, b, days), p);
+		if (s.parent[b] >= 0)
+			for (int c = 0; c < 3; c++)
+				p[c] += positions[3 * s.parent[b] + c];
+	}
+}
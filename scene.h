@@ -0,0 +1,67 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+// Scene description: the bodies of a system, their hierarchy, orbits and assets.
+//
+// A scene is read from a text file or from its compact binary form (see
+// solaire-bake -c) into flat arrays, one entry per body. A body's parent always
+// comes before it, so positions can be computed in a single pass.
+//
+// Text format: '#' starts a comment. "body <name>" starts a body; the lines
+// after it set its fields, all optional:
+//
+//    parent <name>                 body it orbits (default: none, fixed at the origin)
+//    orbit <a> <e> <i> <period> <phase>
+//                                  semi-major axis, eccentricity, inclination (degrees),
+//                                  period (days) and mean anomaly at day 0 (degrees)
+//    spin <day>                    rotation period (days, default 0: none)
+//    mass <m>                      solar masses, pulling on other bodies in N-body mode (default 0)
+//    radius <r>
+//    color <r> <g> <b>             drawn when the body has no image
+//    image <file>
+//    surface <rocky|banded|solar> <seed> <dark r g b> <light r g b> <frequency> <bands> <turbulence>
+//                                  generated when the image file is missing or a placeholder
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "procedural.h"
+
+struct scene
+{
+	int count;
+	std::vector<std::string> name;
+	std::vector<int> parent; // Index of the parent body, -1 for none.
+	std::vector<float> semiMajorAxis, eccentricity, inclination, period, phase;
+	std::vector<float> spin;
+	std::vector<float> mass; // Solar masses.
+	std::vector<float> radius;
+	std::vector<float> color; // Three per body.
+	std::vector<std::string> image;
+	std::vector<surfaceParams> surface;
+};
+
+// Read a scene file, text or binary. Returns false (after reporting why) if it cannot be read.
+bool loadScene(std::string fileName, scene &s);
+
+// Write a scene in binary form. Returns false (after reporting why) if it cannot be written.
+bool writeSceneBinary(std::string fileName, const scene &s);
+
+// Hash of what places the bodies of a scene: their hierarchy and orbits and, when positions come from N-body
+// simulation, their masses. Files of positions store it, so one made before the scene was changed can be told apart.
+uint64_t sceneHash(const scene &s, bool masses);
+
+// Name of a file kept next to a scene file: its name with the extension replaced (e.g. ".eph").
+std::string sceneSiblingName(std::string sceneName, const char *extension);
+
+// Position of every body (three floats each) at the given time in days.
+void scenePositions(const scene &s, double days, std::vector<float> &positions);
+
+// Point of a body's orbit at the given eccentric anomaly (radians), relative to its parent.
+void orbitPoint(const scene &s, int body, double eccentricAnomaly, float p[3]);
+
+// Position and velocity (per day) of a body at the given time in days, relative to its parent.
+void orbitState(const scene &s, int body, double days, float p[3], float v[3]);
+
+#endif
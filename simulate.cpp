@@ -0,0 +1,213 @@
+/*
+ * simulate.cpp
+ *
+ * solaire-sim: run the scenes of the viewer without a window, on libsolaire
+ * (see solaire.h), and write what they do to files or the terminal.
+ *
+ * USAGE:
+ *    solaire-sim -x firstDay lastDay stepDays [-csv] [-j threads] scene...
+ *
+ *    Exports the position of every body of each scene from firstDay to
+ *    lastDay, every stepDays, next to it: a binary .pos file (see export.h)
+ *    or, with -csv, a .csv file with a line per body per time.
+ *
+ *    solaire-sim -r days stepDays [-q quantum] scene...
+ *
+ *    Records an N-body run of each scene from day 0 to days, every stepDays
+ *    (rounded to whole simulation steps), into a compressed trajectory file
+ *    next to it, with the extension replaced by .trj (see trajectory.h).
+ *    Positions are kept to within half a quantum (default 1e-6 scene units).
+ *    The viewer plays the file back with -play.
+ *
+ *    solaire-sim -events firstDay lastDay observer [-j threads] scene...
+ *
+ *    Lists the eclipses and transits seen from the observer body of each
+ *    scene from firstDay to lastDay, with their first and last contacts.
+ *
+ *    -j sets the number of threads (default: one per core).
+ *
+ * Options apply to every scene, wherever they are given; exactly one of
+ * -x, -r and -events must be.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "events.h"
+#include "export.h"
+#include "nbody.h"
+#include "scene.h"
+#include "trajectory.h"
+
+enum simMode
+{
+	SIM_NONE,
+	SIM_EXPORT,
+	SIM_RECORD,
+	SIM_EVENTS
+};
+
+struct simOptions
+{
+	double firstDay, lastDay, stepDays;
+	double recordDays, quantum;
+	exportFormat exportAs;
+	std::string observerName;
+	int threads;
+};
+
+static bool exportScene(std::string sceneName, const simOptions &o)
+{
+	std::string exportName = exportFileName(sceneName, o.exportAs);
+	scene s;
+	if (!loadScene(sceneName, s) || !exportPositions(exportName, s, o.firstDay, o.lastDay, o.stepDays, o.exportAs, o.threads))
+		return false;
+	std::cout << sceneName << ": " << s.count << " bodies, days " << o.firstDay << " to " << o.lastDay << " every "
+			  << o.stepDays << " -> " << exportName << std::endl;
+	return true;
+}
+
+static bool recordScene(std::string sceneName, const simOptions &o)
+{
+	std::string trajName = trajectoryFileName(sceneName);
+	scene s;
+	if (!loadScene(sceneName, s))
+		return false;
+	// Sample on whole simulation steps, so every sample is at exactly its time.
+	nbodySim *sim = createNBody(s);
+	nbodyStats stats;
+	getNBodyStats(sim, stats);
+	double sampleDays = std::max(1.0, floor(o.stepDays / stats.stepDays + 0.5)) * stats.stepDays;
+	trajectoryWriter *writer = createTrajectoryWriter(trajName, s, 0, sampleDays, o.quantum);
+	if (!writer)
+	{
+		destroyNBody(sim);
+		return false;
+	}
+	std::vector<double> positions;
+	uint64_t samples = (uint64_t)(o.recordDays / sampleDays) + 1;
+	bool written = true;
+	for (uint64_t k = 0; k < samples && written; k++)
+	{
+		seekNBody(sim, k * sampleDays);
+		nbodyPositions(sim, positions);
+		written = appendTrajectory(writer, positions.data());
+	}
+	destroyNBody(sim);
+	uint64_t bytes = closeTrajectoryWriter(writer);
+	if (!written || bytes == 0)
+		return false;
+	std::cout << sceneName << ": " << samples << " samples of " << s.count << " bodies every " << sampleDays << " days, "
+			  << samples * s.count * 3 * sizeof(double) << " bytes -> " << trajName << ", " << bytes << " bytes"
+			  << std::endl;
+	return true;
+}
+
+static bool searchScene(std::string sceneName, const simOptions &o)
+{
+	scene s;
+	if (!loadScene(sceneName, s))
+		return false;
+	int observer = -1;
+	for (int b = 0; b < s.count; b++)
+		if (s.name[b] == o.observerName)
+			observer = b;
+	if (observer < 0)
+	{
+		std::cerr << sceneName << ": no body named " << o.observerName << std::endl;
+		return false;
+	}
+	std::vector<eventSpec> specs;
+	observerEventSpecs(s, observer, specs);
+	std::vector<sceneEvent> events;
+	findEvents(s, specs, o.firstDay, o.lastDay, events, o.threads);
+	std::cout << sceneName << ": " << events.size() << " events from " << o.observerName << ", days " << o.firstDay
+			  << " to " << o.lastDay << std::endl;
+	for (size_t e = 0; e < events.size(); e++)
+		std::cout << "  day " << events[e].begin << " to " << events[e].end << ", greatest " << events[e].greatest << ": "
+				  << eventName(s, events[e]) << std::endl;
+	return true;
+}
+
+static int usage(void)
+{
+	std::cerr << "usage: solaire-sim -x firstDay lastDay stepDays [-csv] [-j threads] scene..." << std::endl;
+	std::cerr << "       solaire-sim -r days stepDays [-q quantum] scene..." << std::endl;
+	std::cerr << "       solaire-sim -events firstDay lastDay observer [-j threads] scene..." << std::endl;
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	simOptions o;
+	o.firstDay = o.lastDay = o.stepDays = 0;
+	o.recordDays = 0;
+	o.quantum = 1e-6;
+	o.exportAs = EXPORT_BINARY;
+	o.threads = 0;
+	simMode mode = SIM_NONE;
+	int modes = 0;
+	std::vector<std::string> sceneNames;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-x") == 0 && i + 3 < argc)
+		{
+			mode = SIM_EXPORT;
+			modes++;
+			o.firstDay = atof(argv[++i]);
+			o.lastDay = atof(argv[++i]);
+			o.stepDays = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 2 < argc)
+		{
+			mode = SIM_RECORD;
+			modes++;
+			o.recordDays = atof(argv[++i]);
+			o.stepDays = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-events") == 0 && i + 3 < argc)
+		{
+			mode = SIM_EVENTS;
+			modes++;
+			o.firstDay = atof(argv[++i]);
+			o.lastDay = atof(argv[++i]);
+			o.observerName = argv[++i];
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			o.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc)
+			o.quantum = atof(argv[++i]);
+		else if (strcmp(argv[i], "-csv") == 0)
+			o.exportAs = EXPORT_CSV;
+		else if (argv[i][0] == '-')
+		{
+			std::cerr << argv[i] << ": unknown option or missing values" << std::endl;
+			return usage();
+		}
+		else
+			sceneNames.push_back(argv[i]);
+	}
+
+	if (modes > 1)
+	{
+		std::cerr << "solaire-sim: -x, -r and -events cannot be combined" << std::endl;
+		return usage();
+	}
+	if (mode == SIM_NONE || sceneNames.empty())
+		return usage();
+
+	for (size_t i = 0; i < sceneNames.size(); i++)
+	{
+		bool done = mode == SIM_EXPORT ? exportScene(sceneNames[i], o)
+										: (mode == SIM_RECORD ? recordScene(sceneNames[i], o) : searchScene(sceneNames[i], o));
+		if (!done)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,255 @@
+// Batched body state queries: Kepler's equation solved two queries at a time.
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "solaire.h"
+
+// Queries below which a batch is not worth splitting across threads.
+#define SOLAIRE_BAND_QUERIES 65536
+
+// Newton iterations for Kepler's equation, as in scene.cpp.
+#define KEPLER_ITERATIONS 8
+
+struct orbitTable
+{
+	int count;
+	std::vector<int> parent;
+	std::vector<double> a, b; // Semi-major and semi-minor axes.
+	std::vector<double> e;
+	std::vector<double> sinI, cosI; // Inclination.
+	std::vector<double> perPeriod; // Orbits per day, 0 for bodies that do not move.
+	std::vector<double> phase; // Mean anomaly at day 0, radians.
+};
+
+orbitTable *createOrbitTable(const scene &s)
+{
+	orbitTable *table = new orbitTable;
+	int n = table->count = s.count;
+	table->parent = s.parent;
+	table->a.resize(n);
+	table->b.resize(n);
+	table->e.resize(n);
+	table->sinI.resize(n);
+	table->cosI.resize(n);
+	table->perPeriod.resize(n);
+	table->phase.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		double e = s.eccentricity[i], incl = s.inclination[i] * M_PI / 180;
+		table->a[i] = s.semiMajorAxis[i];
+		table->b[i] = s.semiMajorAxis[i] * sqrt(1 - e * e);
+		table->e[i] = e;
+		table->sinI[i] = sin(incl);
+		table->cosI[i] = cos(incl);
+		table->perPeriod[i] = s.period[i] > 0 ? 1.0 / s.period[i] : 0;
+		table->phase[i] = s.phase[i] * M_PI / 180;
+	}
+	return table;
+}
+
+void destroyOrbitTable(orbitTable *table)
+{
+	delete table;
+}
+
+int orbitTableBodies(const orbitTable *table)
+{
+	return table->count;
+}
+
+// State of one body relative to its parent, added to p and v.
+static void addRelativeState(const orbitTable *t, int body, double days, double *p, double *v)
+{
+	double e = t->e[body];
+	double turns = days * t->perPeriod[body];
+	double M = fmod(t->phase[body] + 2 * M_PI * (turns - floor(turns)), 2 * M_PI);
+	if (M < 0)
+		M += 2 * M_PI;
+	double E = e < 0.8 ? M : M_PI;
+	for (int k = 0; k < KEPLER_ITERATIONS; k++)
+		E -= (E - e * sin(E) - M) / (1 - e * cos(E));
+
+	double sinE = sin(E), cosE = cos(E);
+	double x = t->a[body] * (cosE - e), z = -t->b[body] * sinE;
+	p[0] += x;
+	p[1] += -z * t->sinI[body];
+	p[2] += z * t->cosI[body];
+	if (v)
+	{
+		double rate = 2 * M_PI * t->perPeriod[body] / (1 - e * cosE);
+		double vx = -t->a[body] * sinE * rate, vz = -t->b[body] * cosE * rate;
+		v[0] += vx;
+		v[1] += -vz * t->sinI[body];
+		v[2] += vz * t->cosI[body];
+	}
+}
+
+static void queryOne(const orbitTable *t, int body, double days, double *p, double *v)
+{
+	p[0] = p[1] = p[2] = 0;
+	if (v)
+		v[0] = v[1] = v[2] = 0;
+	for (; body >= 0; body = t->parent[body])
+		addRelativeState(t, body, days, p, v);
+}
+
+#ifdef __SSE2__
+// Sine and cosine of two angles of a few turns at most: reduced by quarter turns
+// (pi / 2 split Cody-Waite style, as in fdlibm), then Taylor series to 1e-16.
+static inline void sinCos2(__m128d x, __m128d &s, __m128d &c)
+{
+	__m128i q = _mm_cvtpd_epi32(_mm_mul_pd(x, _mm_set1_pd(2 / M_PI)));
+	__m128d qd = _mm_cvtepi32_pd(q);
+	__m128d r = _mm_sub_pd(x, _mm_mul_pd(qd, _mm_set1_pd(1.57079632673412561417e+00)));
+	r = _mm_sub_pd(r, _mm_mul_pd(qd, _mm_set1_pd(6.07710050650619224932e-11)));
+	__m128d r2 = _mm_mul_pd(r, r);
+
+	static const double sinTerms[] = {-1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800,
+									  1.0 / 6227020800.0, -1.0 / 1307674368000.0};
+	static const double cosTerms[] = {-1.0 / 2, 1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800,
+									  1.0 / 479001600, -1.0 / 87178291200.0, 1.0 / 20922789888000.0};
+	__m128d sr = _mm_set1_pd(sinTerms[6]);
+	for (int k = 5; k >= 0; k--)
+		sr = _mm_add_pd(_mm_mul_pd(sr, r2), _mm_set1_pd(sinTerms[k]));
+	sr = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(sr, r2), r));
+	__m128d cr = _mm_set1_pd(cosTerms[7]);
+	for (int k = 6; k >= 0; k--)
+		cr = _mm_add_pd(_mm_mul_pd(cr, r2), _mm_set1_pd(cosTerms[k]));
+	cr = _mm_add_pd(_mm_set1_pd(1), _mm_mul_pd(cr, r2));
+
+	// sin(r + q pi/2) is sin r, cos r, -sin r, -cos r as q mod 4 goes 0 to 3, and cos(x) = sin(x + pi/2).
+	__m128i q64 = _mm_shuffle_epi32(q, _MM_SHUFFLE(1, 1, 0, 0));
+	__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+	__m128d odd = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q64, one), one));
+	__m128d sign = _mm_set1_pd(-0.0);
+	__m128d sinNegative = _mm_and_pd(_mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q64, two), two)), sign);
+	__m128i q1 = _mm_add_epi32(q64, one);
+	__m128d cosNegative = _mm_and_pd(_mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q1, two), two)), sign);
+	s = _mm_xor_pd(_mm_or_pd(_mm_and_pd(odd, cr), _mm_andnot_pd(odd, sr)), sinNegative);
+	c = _mm_xor_pd(_mm_or_pd(_mm_and_pd(odd, sr), _mm_andnot_pd(odd, cr)), cosNegative);
+}
+
+// Round to the nearest integer, for values well below 2^51.
+static inline __m128d round2(__m128d x)
+{
+	const __m128d magic = _mm_set1_pd(6755399441055744.0); // 1.5 * 2^52.
+	return _mm_sub_pd(_mm_add_pd(x, magic), magic);
+}
+
+// Two queries at once, walking up both parent chains together; a lane whose chain has ended adds zeros.
+static void queryTwo(const orbitTable *t, const int *bodies, const double *days, double *p, double *v)
+{
+	__m128d px = _mm_setzero_pd(), py = px, pz = px, vx = px, vy = px, vz = px;
+	__m128d time = _mm_loadu_pd(days);
+	const __m128d twoPi = _mm_set1_pd(2 * M_PI), zero = _mm_setzero_pd();
+	int body[2] = {bodies[0], bodies[1]};
+	while (body[0] >= 0 || body[1] >= 0)
+	{
+		double a[2], b[2], e[2], sinI[2], cosI[2], perPeriod[2], phase[2];
+		for (int lane = 0; lane < 2; lane++)
+		{
+			int i = body[lane];
+			bool live = i >= 0;
+			a[lane] = live ? t->a[i] : 0;
+			b[lane] = live ? t->b[i] : 0;
+			e[lane] = live ? t->e[i] : 0;
+			sinI[lane] = live ? t->sinI[i] : 0;
+			cosI[lane] = live ? t->cosI[i] : 0;
+			perPeriod[lane] = live ? t->perPeriod[i] : 0;
+			phase[lane] = live ? t->phase[i] : 0;
+			body[lane] = live ? t->parent[i] : -1;
+		}
+		__m128d ea = _mm_loadu_pd(e), rate = _mm_loadu_pd(perPeriod);
+
+		// Mean anomaly in [0, 2 pi), from the fraction of the current orbit.
+		__m128d turns = _mm_mul_pd(time, rate);
+		__m128d M = _mm_add_pd(_mm_loadu_pd(phase), _mm_mul_pd(twoPi, _mm_sub_pd(turns, round2(turns))));
+		M = _mm_sub_pd(M, _mm_mul_pd(twoPi, round2(_mm_div_pd(M, twoPi))));
+		M = _mm_add_pd(M, _mm_and_pd(_mm_cmplt_pd(M, zero), twoPi));
+
+		__m128d eccentric = _mm_cmpge_pd(ea, _mm_set1_pd(0.8));
+		__m128d E = _mm_or_pd(_mm_and_pd(eccentric, _mm_set1_pd(M_PI)), _mm_andnot_pd(eccentric, M));
+		__m128d sinE, cosE;
+		for (int k = 0; k < KEPLER_ITERATIONS; k++)
+		{
+			sinCos2(E, sinE, cosE);
+			__m128d f = _mm_sub_pd(_mm_sub_pd(E, _mm_mul_pd(ea, sinE)), M);
+			E = _mm_sub_pd(E, _mm_div_pd(f, _mm_sub_pd(_mm_set1_pd(1), _mm_mul_pd(ea, cosE))));
+		}
+		sinCos2(E, sinE, cosE);
+
+		__m128d A = _mm_loadu_pd(a), B = _mm_loadu_pd(b), si = _mm_loadu_pd(sinI), ci = _mm_loadu_pd(cosI);
+		__m128d x = _mm_mul_pd(A, _mm_sub_pd(cosE, ea)), z = _mm_mul_pd(_mm_sub_pd(zero, B), sinE);
+		px = _mm_add_pd(px, x);
+		py = _mm_sub_pd(py, _mm_mul_pd(z, si));
+		pz = _mm_add_pd(pz, _mm_mul_pd(z, ci));
+		if (v)
+		{
+			__m128d dE = _mm_div_pd(_mm_mul_pd(twoPi, rate), _mm_sub_pd(_mm_set1_pd(1), _mm_mul_pd(ea, cosE)));
+			__m128d dx = _mm_sub_pd(zero, _mm_mul_pd(_mm_mul_pd(A, sinE), dE));
+			__m128d dz = _mm_sub_pd(zero, _mm_mul_pd(_mm_mul_pd(B, cosE), dE));
+			vx = _mm_add_pd(vx, dx);
+			vy = _mm_sub_pd(vy, _mm_mul_pd(dz, si));
+			vz = _mm_add_pd(vz, _mm_mul_pd(dz, ci));
+		}
+	}
+
+	double out[3][2];
+	_mm_storeu_pd(out[0], px);
+	_mm_storeu_pd(out[1], py);
+	_mm_storeu_pd(out[2], pz);
+	for (int lane = 0; lane < 2; lane++)
+		for (int c = 0; c < 3; c++)
+			p[3 * lane + c] = out[c][lane];
+	if (v)
+	{
+		_mm_storeu_pd(out[0], vx);
+		_mm_storeu_pd(out[1], vy);
+		_mm_storeu_pd(out[2], vz);
+		for (int lane = 0; lane < 2; lane++)
+			for (int c = 0; c < 3; c++)
+				v[3 * lane + c] = out[c][lane];
+	}
+}
+#endif
+
+static void queryBand(const orbitTable *t, const int *bodies, const double *days, double *positions,
+					  double *velocities, size_t begin, size_t end)
+{
+	size_t i = begin;
+#ifdef __SSE2__
+	for (; i + 2 <= end; i += 2)
+		queryTwo(t, bodies + i, days + i, positions + 3 * i, velocities ? velocities + 3 * i : NULL);
+#endif
+	for (; i < end; i++)
+		queryOne(t, bodies[i], days[i], positions + 3 * i, velocities ? velocities + 3 * i : NULL);
+}
+
+void queryBodyStates(const orbitTable *table, const int *bodies, const double *days, size_t count, double *positions,
+					 double *velocities, int threads)
+{
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = (int)std::min((size_t)threads, count / SOLAIRE_BAND_QUERIES);
+	if (threads <= 1)
+	{
+		queryBand(table, bodies, days, positions, velocities, 0, count);
+		return;
+	}
+
+	// Bands of whole pairs, so every thread but the last runs only in SIMD lanes.
+	std::vector<std::thread> bands;
+	for (int t = 0; t < threads; t++)
+		bands.push_back(std::thread(queryBand, table, bodies, days, positions, velocities, count * t / threads & ~(size_t)1,
+									t + 1 == threads ? count : count * (t + 1) / threads & ~(size_t)1));
+	for (size_t t = 0; t < bands.size(); t++)
+		bands[t].join();
+}
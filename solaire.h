@@ -0,0 +1,30 @@
+#ifndef SOLAIRE_H
+#define SOLAIRE_H
+
+// libsolaire: positions and velocities of scene bodies for programs without a
+// window. Nothing here uses GL or GLUT; the library (make lib) holds this and
+// the GL-free modules it builds on (scene, ephemeris, ephfile, nbody).
+//
+// A query is a body and a time. Queries are answered in batches into buffers
+// the caller owns, two at a time in SIMD lanes, and large batches are split
+// across threads. Answers are exact Kepler orbits, as scenePositions() gives,
+// placed around their parents, in doubles.
+
+#include <stddef.h>
+
+#include "scene.h"
+
+struct orbitTable;
+
+// The orbits of a scene, laid out for batched queries. The scene is copied, so it may change or go away afterwards.
+orbitTable *createOrbitTable(const scene &s);
+void destroyOrbitTable(orbitTable *table);
+
+int orbitTableBodies(const orbitTable *table);
+
+// For each i < count, the position (and velocity per day, unless velocities is NULL) of body bodies[i] at time
+// days[i] in days, relative to the scene origin: three doubles each. Threads 0 means one per core.
+void queryBodyStates(const orbitTable *table, const int *bodies, const double *days, size_t count, double *positions,
+					 double *velocities, int threads = 0);
+
+#endif
@@ -0,0 +1,189 @@
+// Reading and writing texture packs.
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bcn.h"
+#include "texpack.h"
+
+size_t texPackLevelSize(uint32_t format, uint32_t width, uint32_t height)
+{
+	switch (format)
+	{
+	case TEXPACK_RGBA8:
+		return 4 * (size_t)width * height;
+	case TEXPACK_BC1:
+		return bcImageSize(BC1, width, height);
+	case TEXPACK_BC3:
+		return bcImageSize(BC3, width, height);
+	}
+	return 0;
+}
+
+// Levels in a full mip chain down to 1x1.
+static uint32_t fullChainLevels(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = width > height ? width : height; size > 1; size /= 2)
+		levels++;
+	return levels;
+}
+
+// Bytes of every level of an entry.
+static size_t entryLevelsSize(const texPackEntry &entry)
+{
+	size_t total = 0;
+	uint32_t w = entry.width, h = entry.height;
+	for (uint32_t i = 0; i < entry.levels; i++)
+	{
+		total += texPackLevelSize(entry.format, w, h);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	return total;
+}
+
+bool openTexPack(std::string fileName, texPack &pack)
+{
+	memset(&pack, 0, sizeof(pack));
+
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(texPackHeader))
+	{
+		std::cerr << fileName << ": not a texture pack" << std::endl;
+		close(fd);
+		return false;
+	}
+
+	// Only the pages that are actually read get loaded, so startup does not depend on the pack size.
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		std::cerr << fileName << ": cannot map texture pack" << std::endl;
+		return false;
+	}
+
+	pack.base = (const unsigned char *)base;
+	pack.size = st.st_size;
+	pack.header = (const texPackHeader *)pack.base;
+	pack.entries = (const texPackEntry *)(pack.base + sizeof(texPackHeader));
+
+	bool valid = memcmp(pack.header->magic, TEXPACK_MAGIC, 4) == 0 && pack.header->version == TEXPACK_VERSION &&
+				 sizeof(texPackHeader) + (size_t)pack.header->count * sizeof(texPackEntry) <= pack.size;
+	for (uint32_t i = 0; valid && i < pack.header->count; i++)
+	{
+		const texPackEntry &entry = pack.entries[i];
+		// Size and level count first, since they bound the loop that sums the level sizes.
+		valid = entry.name[sizeof(entry.name) - 1] == '\0' && entry.width > 0 && entry.height > 0 && entry.levels > 0 &&
+				entry.levels <= fullChainLevels(entry.width, entry.height) && texPackLevelSize(entry.format, 1, 1) > 0 && entry.size == entryLevelsSize(entry) &&
+				entry.offset <= pack.size && entry.size <= pack.size - entry.offset;
+	}
+	if (!valid)
+	{
+		std::cerr << fileName << ": corrupt texture pack" << std::endl;
+		closeTexPack(pack);
+		return false;
+	}
+	return true;
+}
+
+void closeTexPack(texPack &pack)
+{
+	if (pack.base)
+		munmap((void *)pack.base, pack.size);
+	memset(&pack, 0, sizeof(pack));
+}
+
+const texPackEntry *findTexPackEntry(const texPack &pack, std::string name)
+{
+	if (!pack.base)
+		return NULL;
+	for (uint32_t i = 0; i < pack.header->count; i++)
+		if (name == pack.entries[i].name)
+			return &pack.entries[i];
+	return NULL;
+}
+
+const unsigned char *texPackLevelData(const texPack &pack, const texPackEntry *entry, uint32_t level)
+{
+	size_t offset = entry->offset;
+	uint32_t w = entry->width, h = entry->height;
+	for (uint32_t i = 0; i < level; i++)
+	{
+		offset += texPackLevelSize(entry->format, w, h);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	return pack.base + offset;
+}
+
+// Round up to the pack's data alignment.
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + TEXPACK_ALIGN - 1) & ~(uint64_t)(TEXPACK_ALIGN - 1);
+}
+
+bool writeTexPack(std::string fileName, const std::vector<texPackSource *> &sources)
+{
+	texPackHeader header;
+	memcpy(header.magic, TEXPACK_MAGIC, 4);
+	header.version = TEXPACK_VERSION;
+	header.count = (uint32_t)sources.size();
+	header.reserved = 0;
+
+	// Build the index first; data follows it in the same order.
+	std::vector<texPackEntry> entries(sources.size());
+	uint64_t offset = alignOffset(sizeof(header) + entries.size() * sizeof(texPackEntry));
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		const texPackSource *source = sources[i];
+		texPackEntry &entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		if (source->name.size() >= sizeof(entry.name))
+		{
+			std::cerr << source->name << ": name too long for a texture pack" << std::endl;
+			return false;
+		}
+		strcpy(entry.name, source->name.c_str());
+		entry.format = source->format;
+		entry.width = source->width;
+		entry.height = source->height;
+		entry.levels = source->levels;
+		entry.offset = offset;
+		entry.size = entryLevelsSize(entry);
+		if (entry.size != source->data.size())
+		{
+			std::cerr << source->name << ": texel data does not match its format" << std::endl;
+			return false;
+		}
+		offset = alignOffset(offset + entry.size);
+	}
+
+	std::ofstream outFile(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	outFile.write((const char *)&header, sizeof(header));
+	outFile.write((const char *)entries.data(), entries.size() * sizeof(texPackEntry));
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		static const char zeros[TEXPACK_ALIGN] = {0};
+		outFile.write(zeros, entries[i].offset - (uint64_t)outFile.tellp());
+		outFile.write((const char *)sources[i]->data.data(), entries[i].size);
+	}
+	outFile.close();
+
+	if (!outFile)
+	{
+		std::cerr << fileName << ": write failed" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,83 @@
+#ifndef TEXPACK_H
+#define TEXPACK_H
+
+// Texture pack: one binary archive holding GPU-ready mip chains for many images,
+// written offline by solaire-bake and memory-mapped by the viewer.
+//
+// Layout:
+//   texPackHeader
+//   texPackEntry[count]
+//   texel data, each entry's levels back to back from its offset (64-byte aligned)
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define TEXPACK_MAGIC "SLPK"
+#define TEXPACK_VERSION 1
+#define TEXPACK_ALIGN 64
+
+// Texel formats.
+enum
+{
+	TEXPACK_RGBA8 = 0, // 4 bytes per texel, R G B A.
+	TEXPACK_BC1 = 1, // 8 bytes per 4x4 block, opaque (see bcn.h).
+	TEXPACK_BC3 = 2 // 16 bytes per 4x4 block.
+};
+
+struct texPackHeader
+{
+	char magic[4]; // TEXPACK_MAGIC.
+	uint32_t version; // TEXPACK_VERSION.
+	uint32_t count; // Number of entries.
+	uint32_t reserved;
+};
+
+struct texPackEntry
+{
+	char name[64]; // Source image path, NUL terminated.
+	uint32_t format; // One of the TEXPACK_* formats.
+	uint32_t width; // Size of level 0 in texels.
+	uint32_t height;
+	uint32_t levels; // Number of mip levels stored.
+	uint64_t offset; // Byte offset of level 0 from the start of the file.
+	uint64_t size; // Bytes of all levels.
+};
+
+// A texture pack mapped into memory.
+struct texPack
+{
+	const unsigned char *base; // Start of the mapping, NULL when not open.
+	size_t size; // Bytes mapped.
+	const texPackHeader *header;
+	const texPackEntry *entries;
+};
+
+// Bytes of one level of the given format and size.
+size_t texPackLevelSize(uint32_t format, uint32_t width, uint32_t height);
+
+// Map a texture pack and validate its index. Returns false (leaving pack closed) on failure.
+bool openTexPack(std::string fileName, texPack &pack);
+void closeTexPack(texPack &pack);
+
+// Look up an entry by name, NULL if the pack does not hold it.
+const texPackEntry *findTexPackEntry(const texPack &pack, std::string name);
+
+// Pointer to the texels of one level of an entry.
+const unsigned char *texPackLevelData(const texPack &pack, const texPackEntry *entry, uint32_t level);
+
+// An image to be written into a texture pack.
+struct texPackSource
+{
+	std::string name;
+	uint32_t format;
+	uint32_t width; // Size of level 0 in texels.
+	uint32_t height;
+	uint32_t levels;
+	std::vector<unsigned char> data; // Every level in the given format, back to back.
+};
+
+// Write images into a new texture pack. Returns false on I/O failure.
+bool writeTexPack(std::string fileName, const std::vector<texPackSource *> &sources);
+
+#endif
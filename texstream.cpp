@@ -0,0 +1,367 @@
+// Texture streaming through pixel buffer objects.
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "getImage.h"
+#include "mipmap.h"
+#include "texstream.h"
+#include "texture.h"
+
+enum jobState
+{
+	JOB_DECODING, // Worker is reading the image.
+	JOB_NEEDS_SLOT, // Decoded; waiting for a pixel buffer.
+	JOB_FILLING, // Worker is writing the mip chain into the buffer.
+	JOB_READY, // Buffer holds the texels; waiting for the GL thread.
+	JOB_FAILED
+};
+
+struct streamJob
+{
+	GLuint texture;
+	std::string fileName;
+	imageFile *image;
+	size_t bytes; // Bytes of the mip chain.
+	int slot;
+	int firstLevel; // First level of the mip chain to upload.
+	bool superseded; // A later stream replaces the same texture, so this one is dropped.
+	std::vector<imageFile> levels; // Mip levels, data pointing into the slot's mapping.
+	std::atomic<int> state;
+};
+
+struct pboSlot
+{
+	GLuint buffer;
+	size_t size; // Bytes allocated to the buffer.
+	unsigned char *mapped; // Write pointer, NULL while unmapped.
+	GLsync fence; // Passed when the GL has finished reading the buffer.
+	bool busy; // Owned by a job or waiting on its fence.
+};
+
+struct textureStreamer
+{
+	bool persistent; // Buffers stay mapped for their whole life (ARB_buffer_storage, needs fences).
+	bool fences; // ARB_sync is available.
+	std::vector<pboSlot> slots;
+	std::list<streamJob *> jobs; // Owned by the GL thread.
+
+	// Worker pool.
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+static void runWorker(textureStreamer *streamer)
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(streamer->mutex);
+			streamer->wake.wait(lock, [streamer] { return streamer->stopping || !streamer->tasks.empty(); });
+			if (streamer->stopping)
+				return;
+			task = streamer->tasks.front();
+			streamer->tasks.pop_front();
+		}
+		task();
+	}
+}
+
+static void queueTask(textureStreamer *streamer, std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		streamer->tasks.push_back(task);
+	}
+	streamer->wake.notify_one();
+}
+
+textureStreamer *createTextureStreamer(int slots, int workers)
+{
+	textureStreamer *streamer = new textureStreamer;
+	streamer->fences = hasExtension("GL_ARB_sync");
+	// A persistent buffer is never mapped again, so only a fence can tell when the GL has read it.
+	streamer->persistent = streamer->fences && hasExtension("GL_ARB_buffer_storage");
+	streamer->stopping = false;
+
+	streamer->slots.resize(slots);
+	for (size_t i = 0; i < streamer->slots.size(); i++)
+	{
+		pboSlot &slot = streamer->slots[i];
+		glGenBuffers(1, &slot.buffer);
+		slot.size = 0;
+		slot.mapped = NULL;
+		slot.fence = 0;
+		slot.busy = false;
+	}
+
+	if (workers <= 0)
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < workers; i++)
+		streamer->workers.push_back(std::thread(runWorker, streamer));
+	return streamer;
+}
+
+void destroyTextureStreamer(textureStreamer *streamer)
+{
+	{
+		std::lock_guard<std::mutex> lock(streamer->mutex);
+		streamer->stopping = true;
+	}
+	streamer->wake.notify_all();
+	for (size_t i = 0; i < streamer->workers.size(); i++)
+		streamer->workers[i].join();
+
+	for (std::list<streamJob *>::iterator it = streamer->jobs.begin(); it != streamer->jobs.end(); ++it)
+	{
+		if ((*it)->image)
+		{
+			delete[] (*it)->image->data;
+			delete (*it)->image;
+		}
+		delete *it;
+	}
+
+	for (size_t i = 0; i < streamer->slots.size(); i++)
+	{
+		pboSlot &slot = streamer->slots[i];
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		if (slot.mapped)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	delete streamer;
+}
+
+void streamTextureFile(textureStreamer *streamer, GLuint texture, std::string fileName, int firstLevel)
+{
+	streamJob *job = new streamJob;
+	job->texture = texture;
+	job->fileName = fileName;
+	job->image = NULL;
+	job->bytes = 0;
+	job->slot = -1;
+	job->firstLevel = firstLevel;
+	job->superseded = false;
+	job->state = JOB_DECODING;
+
+	// Streams finish in any order, so only the latest into a texture is uploaded.
+	for (std::list<streamJob *>::iterator it = streamer->jobs.begin(); it != streamer->jobs.end(); ++it)
+		if ((*it)->texture == texture)
+			(*it)->superseded = true;
+	streamer->jobs.push_back(job);
+
+	queueTask(streamer, [job] {
+		job->image = getImage(job->fileName);
+		if (job->image)
+			job->bytes = mipChainBytes(job->image->width, job->image->height);
+		job->state = job->image ? JOB_NEEDS_SLOT : JOB_FAILED;
+	});
+}
+
+int pendingTextureStreams(const textureStreamer *streamer)
+{
+	return (int)streamer->jobs.size();
+}
+
+bool isTextureStreaming(const textureStreamer *streamer, GLuint texture)
+{
+	for (std::list<streamJob *>::const_iterator it = streamer->jobs.begin(); it != streamer->jobs.end(); ++it)
+		if ((*it)->texture == texture)
+			return true;
+	return false;
+}
+
+// Make a free slot at least the given size and map it for writing. Returns false
+// if the GL cannot map it, leaving the slot empty so it is allocated afresh next time.
+static bool mapSlot(textureStreamer *streamer, pboSlot &slot, size_t bytes)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	if (streamer->persistent)
+	{
+		// Storage is immutable, so a slot that is too small gets a new buffer.
+		if (slot.size < bytes)
+		{
+			if (slot.mapped)
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glDeleteBuffers(1, &slot.buffer);
+			glGenBuffers(1, &slot.buffer);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, flags);
+			slot.mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+			slot.size = bytes;
+			if (!slot.mapped)
+			{
+				glDeleteBuffers(1, &slot.buffer);
+				glGenBuffers(1, &slot.buffer);
+				slot.size = 0;
+			}
+		}
+	}
+	else
+	{
+		if (slot.size < bytes)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+			slot.size = bytes;
+		}
+		// The fence has passed, so the GL no longer reads the buffer and the map need not synchronize.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | (streamer->fences ? GL_MAP_UNSYNCHRONIZED_BIT : 0);
+		slot.mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot.size, flags);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return slot.mapped != NULL;
+}
+
+// Give back the slot of a job that is dropped without uploading.
+static void releaseSlot(textureStreamer *streamer, int index)
+{
+	pboSlot &slot = streamer->slots[index];
+	if (!streamer->persistent)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		slot.mapped = NULL;
+	}
+	slot.busy = false;
+}
+
+// Upload a finished job's mip chain from its slot and fence the slot.
+static void uploadJob(textureStreamer *streamer, streamJob *job)
+{
+	pboSlot &slot = streamer->slots[job->slot];
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	if (!streamer->persistent)
+	{
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		slot.mapped = NULL;
+	}
+
+	// Texel pointers become offsets into the bound pixel buffer.
+	int first = std::min(job->firstLevel, (int)job->levels.size() - 1);
+	int last = (int)job->levels.size() - 1;
+	glBindTexture(GL_TEXTURE_2D, job->texture);
+	GLint width = 0, height = 0, maxLevel = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, first, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, first, GL_TEXTURE_HEIGHT, &height);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	bool sameSize = width == job->levels[first].width && height == job->levels[first].height && maxLevel == last;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	const unsigned char *base = job->levels[0].data;
+	for (int i = first; i <= last; i++)
+	{
+		const imageFile &level = job->levels[i];
+		const GLvoid *offset = (const GLvoid *)(level.data - base);
+		if (sameSize)
+			glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+	}
+	selectMipLevels(first, last);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (streamer->fences)
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	else
+		slot.busy = false; // Mapping again will synchronize instead.
+}
+
+int serviceTextureStreamer(textureStreamer *streamer)
+{
+	// Recycle slots the GL has finished reading.
+	for (size_t i = 0; i < streamer->slots.size(); i++)
+	{
+		pboSlot &slot = streamer->slots[i];
+		if (slot.fence && glClientWaitSync(slot.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+		{
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			slot.busy = false;
+		}
+	}
+
+	int updated = 0;
+	for (std::list<streamJob *>::iterator it = streamer->jobs.begin(); it != streamer->jobs.end();)
+	{
+		streamJob *job = *it;
+		int state = job->state;
+
+		if (state == JOB_NEEDS_SLOT && job->superseded)
+		{
+			// Replaced before it got a slot: no point building its mip chain.
+			delete[] job->image->data;
+			delete job->image;
+			delete job;
+			it = streamer->jobs.erase(it);
+			continue;
+		}
+		else if (state == JOB_NEEDS_SLOT)
+		{
+			for (size_t i = 0; i < streamer->slots.size(); i++)
+			{
+				pboSlot &slot = streamer->slots[i];
+				if (slot.busy)
+					continue;
+				if (!mapSlot(streamer, slot, job->bytes))
+				{
+					// Retrying would only ask for the same buffer again; leave the placeholder.
+					std::cerr << job->fileName << ": cannot map a " << job->bytes << "-byte pixel buffer" << std::endl;
+					delete[] job->image->data;
+					delete job->image;
+					job->image = NULL;
+					job->state = JOB_FAILED;
+					break;
+				}
+				slot.busy = true;
+				job->slot = (int)i;
+				job->state = JOB_FILLING;
+				unsigned char *target = slot.mapped;
+				queueTask(streamer, [job, target] {
+					buildMipChainInto(job->image, target, job->levels);
+					delete[] job->image->data;
+					delete job->image;
+					job->image = NULL;
+					job->state = JOB_READY;
+				});
+				break;
+			}
+		}
+		else if (state == JOB_READY || state == JOB_FAILED)
+		{
+			if (state == JOB_READY && job->superseded)
+				releaseSlot(streamer, job->slot);
+			else if (state == JOB_READY)
+			{
+				uploadJob(streamer, job);
+				updated++;
+			}
+			delete job;
+			it = streamer->jobs.erase(it);
+			continue;
+		}
+		++it;
+	}
+	return updated;
+}
@@ -0,0 +1,37 @@
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+
+// Asynchronous texture streaming through a ring of pixel buffer objects.
+//
+// Worker threads decode an image and build its mip chain directly into a mapped
+// pixel buffer (persistently mapped when ARB_buffer_storage and ARB_sync are available). The
+// GL thread only issues glTexSubImage2D() from the buffer, which does not wait
+// on client memory, and fences each slot so it is reused only once the GL has
+// finished reading it.
+
+#include <string>
+#include <GL/glut.h>
+
+struct textureStreamer;
+
+// Create a streamer with the given number of pixel buffer slots and worker threads (0 = one per core).
+textureStreamer *createTextureStreamer(int slots = 4, int workers = 0);
+void destroyTextureStreamer(textureStreamer *streamer);
+
+// Queue replacing the contents of a texture with an image file and its mip chain,
+// starting firstLevel levels down the chain. The texture keeps its old contents
+// until the new ones have been uploaded.
+void streamTextureFile(textureStreamer *streamer, GLuint texture, std::string fileName, int firstLevel = 0);
+
+// Call once per frame on the GL thread: hands free slots to waiting jobs, uploads
+// finished ones and recycles slots the GL is done with. Returns the number of
+// textures updated.
+int serviceTextureStreamer(textureStreamer *streamer);
+
+// Number of streams queued and not yet uploaded.
+int pendingTextureStreams(const textureStreamer *streamer);
+
+// True while a stream into the texture is queued and not yet uploaded.
+bool isTextureStreaming(const textureStreamer *streamer, GLuint texture);
+
+#endif
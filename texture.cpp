@@ -0,0 +1,243 @@
+// Texture upload, from a baked texture pack when one is loaded or from source images otherwise.
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+#include "bcn.h"
+#include "getImage.h"
+#include "texstream.h"
+#include "texture.h"
+#include "texpack.h"
+
+// Texture pack that loadTexture() serves textures from, if one is open.
+static texPack texturePack;
+
+// Images changed since the pack was baked; these are read from the source instead.
+static std::set<std::string> changedImages;
+
+static const texPackEntry *findPackedTexture(std::string fileName)
+{
+	if (changedImages.count(fileName))
+		return NULL;
+	return findTexPackEntry(texturePack, fileName);
+}
+
+void sourceImageChanged(std::string fileName)
+{
+	changedImages.insert(fileName);
+}
+
+bool useTexturePack(std::string fileName)
+{
+	closeTexPack(texturePack);
+	return openTexPack(fileName, texturePack);
+}
+
+bool hasExtension(const char *name)
+{
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	size_t length = strlen(name);
+	for (const char *p = extensions; p && (p = strstr(p, name)); p += length)
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	return false;
+}
+
+// Upload one level of a texture pack entry as the given level of the bound texture,
+// decompressing it first if the GL cannot sample it compressed.
+static void uploadTexPackLevel(const texPackEntry *entry, uint32_t level, uint32_t target, uint32_t w, uint32_t h)
+{
+	static int s3tcSupported = -1;
+	const unsigned char *data = texPackLevelData(texturePack, entry, level);
+
+	if (entry->format == TEXPACK_RGBA8)
+	{
+		glTexImage2D(GL_TEXTURE_2D, target, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		return;
+	}
+
+	if (s3tcSupported < 0)
+		s3tcSupported = hasExtension("GL_EXT_texture_compression_s3tc");
+
+	bcFormat bc = entry->format == TEXPACK_BC1 ? BC1 : BC3;
+	if (s3tcSupported)
+	{
+		GLenum internalFormat = bc == BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		glCompressedTexImage2D(GL_TEXTURE_2D, target, internalFormat, w, h, 0, (GLsizei)bcImageSize(bc, w, h), data);
+		return;
+	}
+
+	imageFile image;
+	image.width = w;
+	image.height = h;
+	image.data = new unsigned char[4 * (size_t)w * h];
+	decodeBC(bc, data, &image);
+	glTexImage2D(GL_TEXTURE_2D, target, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+	delete[] image.data;
+}
+
+void selectMipLevels(int firstLevel, int lastLevel)
+{
+	// A level below the base level is never sampled, so a 0x0 image only gives back its storage.
+	for (int i = 0; i < firstLevel; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// Upload the levels of a texture pack entry from firstLevel down straight from the mapping,
+// skipping those from heldLevel on that the bound texture already holds.
+static void uploadTexPackEntry(const texPackEntry *entry, uint32_t firstLevel = 0, uint32_t heldLevel = UINT32_MAX)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	firstLevel = std::min(firstLevel, entry->levels - 1);
+	uint32_t w = std::max(1u, entry->width >> firstLevel), h = std::max(1u, entry->height >> firstLevel);
+	for (uint32_t i = firstLevel; i < std::min(entry->levels, heldLevel); i++)
+	{
+		uploadTexPackLevel(entry, i, i, w, h);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	selectMipLevels(firstLevel, entry->levels - 1);
+}
+
+void uploadMipChain(const mipChain &chain, int firstLevel)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	firstLevel = std::min(firstLevel, (int)chain.levels.size() - 1);
+	for (size_t i = firstLevel; i < chain.levels.size(); i++)
+	{
+		const imageFile &level = chain.levels[i];
+		glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data);
+	}
+	selectMipLevels(firstLevel, (int)chain.levels.size() - 1);
+}
+
+// Create a texture object with the parameters every planet texture uses.
+static GLuint newTexture(void)
+{
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	return textureID;
+}
+
+// Build the mip chain of a decoded image, upload it and free the image. Returns 0 for a NULL image.
+static GLuint uploadImage(imageFile *image)
+{
+	if (!image)
+		return 0;
+
+	mipChain chain;
+	buildMipChain(image, chain);
+	delete[] image->data;
+	delete image;
+
+	GLuint textureID = newTexture();
+	uploadMipChain(chain);
+	return textureID;
+}
+
+GLuint loadTexture(std::string fileName)
+{
+	const texPackEntry *entry = findPackedTexture(fileName);
+	if (entry)
+	{
+		GLuint textureID = newTexture();
+		uploadTexPackEntry(entry);
+		return textureID;
+	}
+	return uploadImage(getImage(fileName));
+}
+
+void loadTextures(const std::vector<std::string> &fileNames, std::vector<GLuint> &textureIDs, textureStreamer *streamer,
+				  const float *colors)
+{
+	textureIDs.assign(fileNames.size(), 0);
+
+	// Textures in the pack need no decoding; decode the others in parallel.
+	std::vector<std::string> decode;
+	std::vector<size_t> decodeIndex;
+	for (size_t i = 0; i < fileNames.size(); i++)
+	{
+		if (findPackedTexture(fileNames[i]))
+			textureIDs[i] = loadTexture(fileNames[i]);
+		else
+		{
+			decode.push_back(fileNames[i]);
+			decodeIndex.push_back(i);
+		}
+	}
+
+	if (streamer)
+	{
+		// Show a placeholder until the image has been streamed in, or for good if it cannot be read.
+		for (size_t i = 0; i < decode.size(); i++)
+		{
+			unsigned char texel[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+			if (colors)
+				for (int c = 0; c < 3; c++)
+					texel[c] = (unsigned char)(std::min(std::max(colors[3 * decodeIndex[i] + c], 0.0f), 1.0f) * 255 + 0.5f);
+			GLuint textureID = newTexture();
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			streamTextureFile(streamer, textureID, decode[i]);
+			textureIDs[decodeIndex[i]] = textureID;
+		}
+		return;
+	}
+
+	std::vector<imageFile *> images;
+	getImages(decode, images);
+	for (size_t i = 0; i < images.size(); i++)
+		textureIDs[decodeIndex[i]] = uploadImage(images[i]);
+}
+
+void dropTextureLevels(GLuint texture, int firstLevel)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	GLint baseLevel = 0, maxLevel = 0;
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	if (firstLevel > baseLevel)
+		selectMipLevels(std::min(firstLevel, (int)maxLevel), maxLevel);
+}
+
+void reloadTexture(GLuint texture, std::string fileName, int firstLevel, textureStreamer *streamer)
+{
+	const texPackEntry *entry = findPackedTexture(fileName);
+	if (entry)
+	{
+		// The entry is unchanged since the texture was loaded from it, so the levels it still holds stay.
+		glBindTexture(GL_TEXTURE_2D, texture);
+		GLint baseLevel = 0, maxLevel = 0, width = 0;
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_WIDTH, &width);
+		bool held = maxLevel == (GLint)entry->levels - 1 && (uint32_t)width == std::max(1u, entry->width >> baseLevel);
+		uploadTexPackEntry(entry, firstLevel, held ? baseLevel : UINT32_MAX);
+		return;
+	}
+	if (streamer)
+	{
+		streamTextureFile(streamer, texture, fileName, firstLevel);
+		return;
+	}
+
+	imageFile *image = getImage(fileName);
+	if (!image)
+		return;
+	mipChain chain;
+	buildMipChain(image, chain);
+	delete[] image->data;
+	delete image;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	uploadMipChain(chain, firstLevel);
+}
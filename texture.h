@@ -0,0 +1,57 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <string>
+#include <vector>
+#include <GL/glut.h>
+
+#include "mipmap.h"
+
+struct textureStreamer;
+
+// True if the GL advertises the named extension.
+bool hasExtension(const char *name);
+
+// Upload a mip chain, from firstLevel down, to the currently bound 2D texture and select trilinear filtering.
+// Texture levels are numbered as in the full chain, with the base level raised to firstLevel.
+void uploadMipChain(const mipChain &chain, int firstLevel = 0);
+
+// Have the currently bound 2D texture sample levels firstLevel to lastLevel of its
+// chain with trilinear filtering, freeing whatever it holds of the finer levels.
+void selectMipLevels(int firstLevel, int lastLevel);
+
+// Serve textures from a baked texture pack (see solaire-bake). Returns false if it cannot be opened,
+// in which case textures are read from the source images.
+bool useTexturePack(std::string fileName);
+
+// Note that an image file has changed, so that its texture pack entry, if any, is out of date
+// and the image is read from the file from now on.
+void sourceImageChanged(std::string fileName);
+
+// Upload an image with its full mip chain into a new texture object. The chain comes
+// from the texture pack if it holds the image, and is built from the source image otherwise.
+// Returns 0 if the image cannot be read.
+GLuint loadTexture(std::string fileName);
+
+// Load many textures, decoding the images that are not in the texture pack on
+// worker threads. textureIDs[i] is the texture of fileNames[i], 0 if unreadable.
+// Given a streamer, those images are streamed in instead, into textures that
+// start out as a one-texel placeholder, and the call returns without waiting for
+// them. The placeholder is filled with colors[3 * i] (r, g, b) if given, white
+// otherwise, and stays if the image turns out to be unreadable.
+void loadTextures(const std::vector<std::string> &fileNames, std::vector<GLuint> &textureIDs, textureStreamer *streamer = NULL,
+				  const float *colors = NULL);
+
+// Replace the contents of a texture with its image's mip chain from firstLevel
+// down, so that a texture cut down to fit a memory budget can be grown back
+// again. Texture pack entries are uploaded at once, only the levels the texture
+// lacks; source images are streamed in when a streamer is given and read here
+// otherwise.
+void reloadTexture(GLuint texture, std::string fileName, int firstLevel, textureStreamer *streamer = NULL);
+
+// Cut a texture down to its mip levels from firstLevel on by raising its base level
+// and freeing the finer levels. The levels kept are not uploaded again, so nothing
+// is read or decoded; growing back needs reloadTexture().
+void dropTextureLevels(GLuint texture, int firstLevel);
+
+#endif
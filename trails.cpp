@@ -0,0 +1,121 @@
+// Orbit trails in a shared ring-buffered vertex buffer.
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <algorithm>
+#include <vector>
+#include <GL/glut.h>
+
+#include "trails.h"
+
+struct orbitTrails
+{
+	int bodies, length;
+	GLuint buffer; // Samples 0 to 2 * length - 1, each the positions of all bodies; then the fade coordinates.
+	GLuint fade; // 1D alpha ramp.
+	int head; // Slot of the next sample.
+	int recorded; // Samples held, up to length.
+};
+
+orbitTrails *createOrbitTrails(int bodies, int length)
+{
+	orbitTrails *trails = new orbitTrails;
+	trails->bodies = bodies;
+	trails->length = std::max(2, length);
+	trails->head = trails->recorded = 0;
+
+	// The fade coordinate of a vertex is its slot, shared by every body.
+	int slots = 2 * trails->length;
+	std::vector<GLfloat> slotCoords(slots);
+	for (int i = 0; i < slots; i++)
+		slotCoords[i] = (GLfloat)i;
+	GLsizeiptr positionBytes = (GLsizeiptr)slots * bodies * 3 * sizeof(GLfloat);
+	glGenBuffers(1, &trails->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, trails->buffer);
+	glBufferData(GL_ARRAY_BUFFER, positionBytes + slots * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, positionBytes, slots * sizeof(GLfloat), slotCoords.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GLubyte ramp[256];
+	for (int i = 0; i < 256; i++)
+		ramp[i] = (GLubyte)i;
+	glGenTextures(1, &trails->fade);
+	glBindTexture(GL_TEXTURE_1D, trails->fade);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_ALPHA8, 256, 0, GL_ALPHA, GL_UNSIGNED_BYTE, ramp);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_1D, 0);
+	return trails;
+}
+
+void destroyOrbitTrails(orbitTrails *trails)
+{
+	glDeleteBuffers(1, &trails->buffer);
+	glDeleteTextures(1, &trails->fade);
+	delete trails;
+}
+
+void recordOrbitTrails(orbitTrails *trails, const float *positions)
+{
+	GLsizeiptr sampleBytes = (GLsizeiptr)trails->bodies * 3 * sizeof(GLfloat);
+	glBindBuffer(GL_ARRAY_BUFFER, trails->buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, trails->head * sampleBytes, sampleBytes, positions);
+	glBufferSubData(GL_ARRAY_BUFFER, (trails->head + trails->length) * sampleBytes, sampleBytes, positions);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	trails->head = (trails->head + 1) % trails->length;
+	trails->recorded = std::min(trails->recorded + 1, trails->length);
+}
+
+void clearOrbitTrails(orbitTrails *trails)
+{
+	trails->head = trails->recorded = 0;
+}
+
+void drawOrbitTrails(orbitTrails *trails, const float *colors)
+{
+	if (trails->recorded < 2)
+		return;
+
+	// The latest samples run from first to head + length - 1, newest last.
+	int count = trails->recorded;
+	int first = trails->head + trails->length - count;
+
+	glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glEnable(GL_TEXTURE_1D);
+	glBindTexture(GL_TEXTURE_1D, trails->fade);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+
+	// Map the slots drawn onto the ramp: the oldest transparent, the newest opaque.
+	glMatrixMode(GL_TEXTURE);
+	glPushMatrix();
+	glLoadIdentity();
+	glScalef(1.0f / (count - 1), 1.0f, 1.0f);
+	glTranslatef((GLfloat)-first, 0.0f, 0.0f);
+	glMatrixMode(GL_MODELVIEW);
+
+	GLsizei stride = trails->bodies * 3 * sizeof(GLfloat);
+	glBindBuffer(GL_ARRAY_BUFFER, trails->buffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glTexCoordPointer(1, GL_FLOAT, 0, (const GLvoid *)((size_t)stride * 2 * trails->length));
+	for (int b = 0; b < trails->bodies; b++)
+	{
+		glVertexPointer(3, GL_FLOAT, stride, (const GLvoid *)((size_t)b * 3 * sizeof(GLfloat)));
+		glColor3fv(&colors[3 * b]);
+		glDrawArrays(GL_LINE_STRIP, first, count);
+	}
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glMatrixMode(GL_TEXTURE);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+}
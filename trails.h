@@ -0,0 +1,29 @@
+#ifndef TRAILS_H
+#define TRAILS_H
+
+// Orbit trails: the recent path of every body, drawn as a fading line.
+//
+// Each body keeps a fixed number of its latest positions in a ring, and all
+// the rings live in one vertex buffer allocated once. The buffer is laid out
+// by sample rather than by body, so the positions recorded in a frame are one
+// contiguous run and are sent with a single glBufferSubData(). Every sample is
+// stored twice, length slots apart, so the latest samples of a body are always
+// one unbroken range that draws as a single line strip. The fade comes from a
+// 1D alpha texture positioned along each strip by the texture matrix.
+
+struct orbitTrails;
+
+// Trails of the given number of positions for the given number of bodies.
+orbitTrails *createOrbitTrails(int bodies, int length);
+void destroyOrbitTrails(orbitTrails *trails);
+
+// Append the current position of every body, three floats each.
+void recordOrbitTrails(orbitTrails *trails, const float *positions);
+
+// Forget the recorded positions, e.g. after a jump in time.
+void clearOrbitTrails(orbitTrails *trails);
+
+// Draw every trail in its body's colour (three floats each), fading out towards its oldest position.
+void drawOrbitTrails(orbitTrails *trails, const float *colors);
+
+#endif
@@ -0,0 +1,383 @@
+// Writing and reading trajectory files.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "trajectory.h"
+
+// Values per block to aim for, so a decoded block stays around two megabytes.
+#define TRAJECTORY_BLOCK_VALUES (1 << 18)
+#define TRAJECTORY_MAX_SAMPLES_PER_BLOCK 256
+#define TRAJECTORY_MIN_SAMPLES_PER_BLOCK 4
+
+// Longest varint, a 64-bit value seven bits a byte.
+#define TRAJECTORY_MAX_VARINT_BYTES 10
+
+struct trajectoryWriter
+{
+	std::string fileName;
+	std::ofstream outFile;
+	trajHeader header;
+	std::vector<trajBody> bodies;
+	std::vector<trajBlock> index;
+	std::vector<int64_t> quanta; // Positions in quanta: samplesPerBlock rows of three per body.
+	uint32_t filled; // Rows of quanta in the current block.
+	std::vector<unsigned char> raw, packed;
+};
+
+struct trajectoryFile
+{
+	std::string fileName;
+	const unsigned char *base;
+	size_t size;
+	const trajHeader *header;
+	const trajBody *bodies;
+	const trajBlock *index;
+	uint64_t decodedBlock; // Block whose quanta are held, blocks when none.
+	std::vector<int64_t> quanta;
+	std::vector<unsigned char> raw;
+	uint64_t heldSample; // First of the two samples evaluateTrajectory holds, samples when none.
+	std::vector<double> before, after; // Positions of heldSample and the one after it.
+};
+
+// Signed values as unsigned, small magnitudes small: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+static uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void putVarint(std::vector<unsigned char> &out, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		out.push_back((unsigned char)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((unsigned char)v);
+}
+
+// Returns false when the varint runs past end.
+static bool getVarint(const unsigned char *&p, const unsigned char *end, uint64_t &v)
+{
+	v = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7)
+	{
+		unsigned char byte = *p++;
+		v |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// Prediction of a position relative to the parent from the two before it in the block, in quanta.
+static int64_t predict(const trajBody &body, uint32_t row, int64_t previous, int64_t beforeThat)
+{
+	if (row == 0)
+		return 0;
+	if (row == 1)
+		return previous;
+	return llround(2 * body.turn * (double)previous) - beforeThat;
+}
+
+// The position of a column relative to its body's parent, in quanta.
+static int64_t relative(const std::vector<trajBody> &bodies, const int64_t *row, size_t column)
+{
+	int parent = bodies[column / 3].parent;
+	return row[column] - (parent >= 0 ? row[3 * parent + column % 3] : 0);
+}
+
+trajectoryWriter *createTrajectoryWriter(std::string fileName, const scene &s, double firstDay, double stepDays,
+										 double quantum)
+{
+	trajectoryWriter *writer = new trajectoryWriter;
+	writer->outFile.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!writer->outFile || s.count <= 0 || stepDays <= 0 || quantum <= 0)
+	{
+		std::cerr << fileName << ": cannot create trajectory file" << std::endl;
+		delete writer;
+		return NULL;
+	}
+	writer->fileName = fileName;
+
+	trajHeader &h = writer->header;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TRAJECTORY_MAGIC, 4);
+	h.version = TRAJECTORY_VERSION;
+	h.bodies = s.count;
+	h.samplesPerBlock = std::max(TRAJECTORY_MIN_SAMPLES_PER_BLOCK,
+								 std::min(TRAJECTORY_MAX_SAMPLES_PER_BLOCK, TRAJECTORY_BLOCK_VALUES / (3 * s.count)));
+	h.quantum = quantum;
+	h.firstDay = firstDay;
+	h.stepDays = stepDays;
+	h.sceneHash = sceneHash(s, true);
+
+	writer->bodies.resize(s.count);
+	for (int b = 0; b < s.count; b++)
+	{
+		trajBody &body = writer->bodies[b];
+		body.parent = s.parent[b];
+		body.reserved = 0;
+		body.turn = s.period[b] > 0 ? cos(2 * M_PI * stepDays / s.period[b]) : 1;
+	}
+	writer->outFile.write((const char *)&h, sizeof(h)); // Rewritten on closing, with the counts.
+	writer->outFile.write((const char *)writer->bodies.data(), writer->bodies.size() * sizeof(trajBody));
+
+	writer->quanta.resize((size_t)h.samplesPerBlock * 3 * s.count);
+	writer->filled = 0;
+	return writer;
+}
+
+static void writeBlock(trajectoryWriter *writer)
+{
+	size_t values = 3 * (size_t)writer->header.bodies;
+	writer->raw.clear();
+	for (size_t column = 0; column < values; column++)
+	{
+		const trajBody &body = writer->bodies[column / 3];
+		int64_t previous = 0, beforeThat = 0;
+		for (uint32_t row = 0; row < writer->filled; row++)
+		{
+			int64_t v = relative(writer->bodies, &writer->quanta[row * values], column);
+			putVarint(writer->raw, zigzag(v - predict(body, row, previous, beforeThat)));
+			beforeThat = previous;
+			previous = v;
+		}
+	}
+
+	uLongf packedBytes = compressBound(writer->raw.size());
+	writer->packed.resize(packedBytes);
+	if (compress2(writer->packed.data(), &packedBytes, writer->raw.data(), writer->raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		std::cerr << writer->fileName << ": cannot compress trajectory block" << std::endl;
+		writer->outFile.setstate(std::ios::failbit);
+		writer->filled = 0;
+		return;
+	}
+
+	trajBlock block;
+	block.offset = (uint64_t)writer->outFile.tellp();
+	block.bytes = (uint32_t)packedBytes;
+	block.rawBytes = (uint32_t)writer->raw.size();
+	writer->outFile.write((const char *)writer->packed.data(), packedBytes);
+	writer->index.push_back(block);
+	writer->filled = 0;
+}
+
+bool appendTrajectory(trajectoryWriter *writer, const double *positions)
+{
+	trajHeader &h = writer->header;
+	size_t values = 3 * (size_t)h.bodies;
+	int64_t *row = &writer->quanta[writer->filled * values];
+	for (size_t i = 0; i < values; i++)
+		row[i] = llround(positions[i] / h.quantum);
+	h.samples++;
+	if (++writer->filled == h.samplesPerBlock)
+		writeBlock(writer);
+	return (bool)writer->outFile;
+}
+
+uint64_t closeTrajectoryWriter(trajectoryWriter *writer)
+{
+	if (writer->filled > 0)
+		writeBlock(writer);
+	trajHeader &h = writer->header;
+	h.blocks = writer->index.size();
+	h.indexOffset = (uint64_t)writer->outFile.tellp();
+	writer->outFile.write((const char *)writer->index.data(), writer->index.size() * sizeof(trajBlock));
+	uint64_t size = (uint64_t)writer->outFile.tellp();
+	writer->outFile.seekp(0);
+	writer->outFile.write((const char *)&h, sizeof(h));
+	writer->outFile.close();
+	if (!writer->outFile)
+	{
+		std::cerr << writer->fileName << ": cannot write trajectory file" << std::endl;
+		size = 0;
+	}
+	delete writer;
+	return size;
+}
+
+trajectoryFile *openTrajectory(std::string fileName)
+{
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cerr << fileName << ": cannot open trajectory file" << std::endl;
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(trajHeader))
+	{
+		std::cerr << fileName << ": not a trajectory file" << std::endl;
+		close(fd);
+		return NULL;
+	}
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		std::cerr << fileName << ": cannot map trajectory file" << std::endl;
+		return NULL;
+	}
+
+	trajectoryFile *file = new trajectoryFile;
+	file->fileName = fileName;
+	file->base = (const unsigned char *)base;
+	file->size = st.st_size;
+	file->header = (const trajHeader *)file->base;
+
+	const trajHeader *h = file->header;
+	bool valid = memcmp(h->magic, TRAJECTORY_MAGIC, 4) == 0 && h->version == TRAJECTORY_VERSION && h->bodies > 0 &&
+				 h->bodies <= (file->size - sizeof(trajHeader)) / sizeof(trajBody) && h->samplesPerBlock > 0 &&
+				 h->samplesPerBlock <= TRAJECTORY_MAX_SAMPLES_PER_BLOCK && h->quantum > 0 && h->blocks == (h->samples + h->samplesPerBlock - 1) / h->samplesPerBlock &&
+				 h->indexOffset <= file->size && h->blocks <= (file->size - h->indexOffset) / sizeof(trajBlock);
+	if (valid)
+	{
+		file->bodies = (const trajBody *)(file->base + sizeof(trajHeader));
+		file->index = (const trajBlock *)(file->base + h->indexOffset);
+		for (uint32_t b = 0; b < h->bodies && valid; b++)
+			valid = file->bodies[b].parent >= -1 && file->bodies[b].parent < (int32_t)b;
+		// No block's varints can be longer than the longest varint for every value it holds.
+		uint64_t rawLimit = (uint64_t)h->samplesPerBlock * 3 * h->bodies * TRAJECTORY_MAX_VARINT_BYTES;
+		for (uint64_t b = 0; b < h->blocks && valid; b++)
+			valid = file->index[b].offset <= file->size && file->index[b].bytes <= file->size - file->index[b].offset &&
+					file->index[b].rawBytes <= rawLimit;
+	}
+	if (!valid)
+	{
+		std::cerr << fileName << ": corrupt trajectory file" << std::endl;
+		closeTrajectory(file);
+		return NULL;
+	}
+	file->decodedBlock = h->blocks;
+	file->quanta.resize((size_t)h->samplesPerBlock * 3 * h->bodies);
+	file->heldSample = h->samples;
+	return file;
+}
+
+void closeTrajectory(trajectoryFile *file)
+{
+	munmap((void *)file->base, file->size);
+	delete file;
+}
+
+const trajHeader *trajectoryHeader(const trajectoryFile *file)
+{
+	return file->header;
+}
+
+// Inflate a block, add back the predictions, then the parents (which come first) to the relative positions.
+static bool decodeBlock(trajectoryFile *file, uint64_t block)
+{
+	const trajHeader *h = file->header;
+	const trajBlock &b = file->index[block];
+	uint32_t rows = (uint32_t)std::min((uint64_t)h->samplesPerBlock, h->samples - block * h->samplesPerBlock);
+	size_t values = 3 * (size_t)h->bodies;
+
+	file->raw.resize(b.rawBytes);
+	uLongf rawBytes = b.rawBytes;
+	bool valid = uncompress(file->raw.data(), &rawBytes, file->base + b.offset, b.bytes) == Z_OK && rawBytes == b.rawBytes;
+	const unsigned char *p = file->raw.data(), *end = p + rawBytes;
+	for (size_t column = 0; column < values && valid; column++)
+	{
+		const trajBody &body = file->bodies[column / 3];
+		int64_t previous = 0, beforeThat = 0;
+		for (uint32_t row = 0; row < rows && valid; row++)
+		{
+			uint64_t difference;
+			valid = getVarint(p, end, difference);
+			int64_t v = predict(body, row, previous, beforeThat) + unzigzag(difference);
+			file->quanta[row * values + column] = v;
+			beforeThat = previous;
+			previous = v;
+		}
+	}
+	if (!valid || p != end)
+	{
+		std::cerr << file->fileName << ": corrupt trajectory block " << block << std::endl;
+		file->decodedBlock = h->blocks;
+		return false;
+	}
+
+	for (uint32_t row = 0; row < rows; row++)
+	{
+		int64_t *q = &file->quanta[row * values];
+		for (uint32_t body = 0; body < h->bodies; body++)
+			if (file->bodies[body].parent >= 0)
+				for (int c = 0; c < 3; c++)
+					q[3 * body + c] += q[3 * file->bodies[body].parent + c];
+	}
+	file->decodedBlock = block;
+	return true;
+}
+
+bool readTrajectory(trajectoryFile *file, uint64_t sample, double *positions)
+{
+	const trajHeader *h = file->header;
+	if (sample >= h->samples)
+		return false;
+	uint64_t block = sample / h->samplesPerBlock;
+	if (block != file->decodedBlock && !decodeBlock(file, block))
+		return false;
+
+	size_t values = 3 * (size_t)h->bodies;
+	const int64_t *row = &file->quanta[(sample % h->samplesPerBlock) * values];
+	for (size_t i = 0; i < values; i++)
+		positions[i] = row[i] * h->quantum;
+	return true;
+}
+
+bool trajectoryCovers(const trajectoryFile *file, double days)
+{
+	const trajHeader *h = file->header;
+	return h->samples >= 2 && days >= h->firstDay && days <= h->firstDay + (h->samples - 1) * h->stepDays;
+}
+
+bool evaluateTrajectory(trajectoryFile *file, double days, float *positions)
+{
+	const trajHeader *h = file->header;
+	double t = (days - h->firstDay) / h->stepDays;
+	uint64_t sample = std::min((uint64_t)t, h->samples - 2);
+	if (sample != file->heldSample)
+	{
+		size_t values = 3 * (size_t)h->bodies;
+		file->before.resize(values);
+		file->after.resize(values);
+		bool ok;
+		if (sample == file->heldSample + 1)
+		{
+			file->before.swap(file->after);
+			ok = readTrajectory(file, sample + 1, file->after.data());
+		}
+		else
+			ok = readTrajectory(file, sample, file->before.data()) && readTrajectory(file, sample + 1, file->after.data());
+		file->heldSample = ok ? sample : h->samples;
+		if (!ok)
+			return false;
+	}
+
+	double u = std::min(1.0, std::max(0.0, t - sample));
+	for (size_t i = 0; i < file->before.size(); i++)
+		positions[i] = (float)(file->before[i] + (file->after[i] - file->before[i]) * u);
+	return true;
+}
+
+std::string trajectoryFileName(std::string sceneName)
+{
+	return sceneSiblingName(sceneName, ".trj");
+}
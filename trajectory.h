@@ -0,0 +1,99 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+// Trajectory file: the recorded positions of every body of a scene at evenly
+// spaced times, such as an N-body run (solaire-sim -r), compressed.
+//
+// Positions are rounded to whole quanta and taken relative to the parent.
+// Each is then predicted from the two samples before it as if it went round
+// a circle at the body's orbital period (x_t = 2 cos(w dt) x_t-1 - x_t-2,
+// which every coordinate of such motion obeys), and only the difference from
+// the prediction is stored: a few quanta while the run follows its orbits.
+// Positions read back are within half a quantum of those recorded; the coding
+// itself is lossless.
+//
+// Layout:
+//   trajHeader
+//   trajBody[bodies]
+//   blocks, each samplesPerBlock samples of every body (fewer in the last):
+//     zlib-deflated columns, one per body and axis in turn, each the zigzag
+//     varint differences of that column's samples from their predictions
+//     (the first sample of a block from zero, the second from the first)
+//   trajBlock[blocks], the index, from indexOffset
+//
+// A sample is read by inflating only its block, found through the index. The
+// viewer plays a recording back (-play) by interpolating between samples.
+
+#include <stdint.h>
+#include <string>
+
+#include "scene.h"
+
+#define TRAJECTORY_MAGIC "SLTJ"
+#define TRAJECTORY_VERSION 2
+
+struct trajHeader
+{
+	char magic[4]; // TRAJECTORY_MAGIC.
+	uint32_t version; // TRAJECTORY_VERSION.
+	uint32_t bodies;
+	uint32_t samplesPerBlock;
+	double quantum; // Scene units per stored step.
+	double firstDay;
+	double stepDays;
+	uint64_t samples;
+	uint64_t blocks;
+	uint64_t indexOffset; // Byte offset of the block index.
+	uint64_t sceneHash; // sceneHash() of the scene recorded, with masses.
+};
+
+struct trajBody
+{
+	int32_t parent; // Index of the parent body, -1 for none.
+	uint32_t reserved;
+	double turn; // cos(w dt) of the prediction, 1 for a straight line.
+};
+
+struct trajBlock
+{
+	uint64_t offset; // Byte offset of the deflated block.
+	uint32_t bytes; // Deflated size.
+	uint32_t rawBytes; // Size of the varints.
+};
+
+struct trajectoryWriter;
+struct trajectoryFile;
+
+// Start recording the bodies of a scene every stepDays from firstDay. Returns NULL (after reporting why) if the file
+// cannot be created.
+trajectoryWriter *createTrajectoryWriter(std::string fileName, const scene &s, double firstDay, double stepDays,
+										 double quantum);
+
+// Record the next sample: the position of every body, three doubles each. Returns false on a write failure.
+bool appendTrajectory(trajectoryWriter *writer, const double *positions);
+
+// Write what is left and the index, and free the writer. Returns the file size, 0 (after reporting why) on failure.
+uint64_t closeTrajectoryWriter(trajectoryWriter *writer);
+
+// Map a trajectory file. Returns NULL (after reporting why) on failure.
+trajectoryFile *openTrajectory(std::string fileName);
+void closeTrajectory(trajectoryFile *file);
+
+const trajHeader *trajectoryHeader(const trajectoryFile *file);
+
+// Position of every body (three doubles each) at a recorded sample. The sample's block stays decoded for the next
+// read. Returns false (after reporting why) if the block is corrupt.
+bool readTrajectory(trajectoryFile *file, uint64_t sample, double *positions);
+
+// Whether the file has samples either side of the given time in days.
+bool trajectoryCovers(const trajectoryFile *file, double days);
+
+// Position of every body (three floats each) at a time the file covers, interpolated linearly between the samples
+// either side. The two samples are kept, so playing forward reads each sample once. Returns false (after reporting
+// why) if a block is corrupt.
+bool evaluateTrajectory(trajectoryFile *file, double days, float *positions);
+
+// Name of the trajectory recorded from a scene: the scene's name with its extension replaced by .trj.
+std::string trajectoryFileName(std::string sceneName);
+
+#endif
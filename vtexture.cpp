@@ -0,0 +1,313 @@
+// Virtual texturing: quadtree patch selection, tile streaming and the LRU page cache.
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <GL/glut.h>
+
+#include "vtexture.h"
+#include "vtfile.h"
+
+// Tiles streamed into the page cache per frame, so that a sudden zoom never stalls a frame.
+#define VT_UPLOADS_PER_FRAME 8
+
+struct vtSlot
+{
+	uint64_t key; // Tile held by the slot.
+	unsigned long frame; // Last frame the tile was used.
+	std::list<int>::iterator lru; // Position in the LRU list.
+};
+
+// A patch chosen for drawing.
+struct vtPatch
+{
+	uint32_t level, tx, ty;
+};
+
+struct virtualTexture
+{
+	vtFile file;
+
+	GLuint cacheTexture; // Physical page cache, slotsPerSide x slotsPerSide tiles with borders.
+	int slotsPerSide;
+	int slotSide; // Texels per slot side, tile plus border.
+	int cacheSize; // Texels per cache texture side.
+
+	std::vector<vtSlot> slots;
+	std::list<int> lru; // Slot indices, most recently used first.
+	std::unordered_map<uint64_t, int> resident; // Tile key -> slot.
+	unsigned long frame;
+
+	std::vector<vtPatch> patches; // Patches of the current frame.
+	GLdouble modelview[16], projection[16];
+	GLint viewport[4];
+	float radius;
+};
+
+static uint64_t tileKey(uint32_t level, uint32_t tx, uint32_t ty)
+{
+	return ((uint64_t)level << 48) | ((uint64_t)ty << 24) | tx;
+}
+
+// Point on the unit sphere at texture coordinates (u, v), following gluSphere().
+static void spherePoint(double u, double v, double p[3])
+{
+	double theta = 2.0 * M_PI * u, rho = M_PI * (1.0 - v);
+	p[0] = -sin(theta) * sin(rho);
+	p[1] = cos(theta) * sin(rho);
+	p[2] = cos(rho);
+}
+
+virtualTexture *createVirtualTexture(std::string fileName, int screenWidth, int screenHeight)
+{
+	vtFile file;
+	if (!openVTFile(fileName, file))
+		return NULL;
+
+	virtualTexture *vt = new virtualTexture;
+	vt->file = file;
+	vt->frame = 0;
+	vt->slotSide = file.header->tileSize + 2 * file.header->border;
+
+	// Room for the tiles of about three screens' worth of texels, plus one per level for the fallbacks.
+	GLint maxSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	double tiles = 3.0 * screenWidth * screenHeight / ((double)file.header->tileSize * file.header->tileSize) + file.header->levels;
+	vt->slotsPerSide = std::min(std::max((int)ceil(sqrt(tiles)), 2), (int)maxSize / vt->slotSide);
+	vt->cacheSize = vt->slotsPerSide * vt->slotSide;
+
+	glGenTextures(1, &vt->cacheTexture);
+	glBindTexture(GL_TEXTURE_2D, vt->cacheTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, vt->cacheSize, vt->cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	return vt;
+}
+
+void destroyVirtualTexture(virtualTexture *vt)
+{
+	glDeleteTextures(1, &vt->cacheTexture);
+	closeVTFile(vt->file);
+	delete vt;
+}
+
+// Mark a resident tile as used this frame.
+static void touchSlot(virtualTexture *vt, int slot)
+{
+	vt->slots[slot].frame = vt->frame;
+	vt->lru.splice(vt->lru.begin(), vt->lru, vt->slots[slot].lru);
+}
+
+// Stream a tile into the page cache. Returns false if every slot is in use this frame.
+static bool streamTile(virtualTexture *vt, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	uint64_t key = tileKey(level, tx, ty);
+	int slot;
+	if (vt->slots.size() < (size_t)(vt->slotsPerSide * vt->slotsPerSide))
+	{
+		slot = (int)vt->slots.size();
+		vtSlot s;
+		s.key = key;
+		vt->lru.push_front(slot);
+		s.lru = vt->lru.begin();
+		vt->slots.push_back(s);
+	}
+	else
+	{
+		slot = vt->lru.back();
+		if (vt->slots[slot].frame == vt->frame)
+			return false;
+		vt->resident.erase(vt->slots[slot].key);
+		vt->slots[slot].key = key;
+	}
+	vt->resident[key] = slot;
+	touchSlot(vt, slot);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % vt->slotsPerSide) * vt->slotSide, (slot / vt->slotsPerSide) * vt->slotSide,
+					vt->slotSide, vt->slotSide, GL_RGBA, GL_UNSIGNED_BYTE, vtTileData(vt->file, level, tx, ty));
+	return true;
+}
+
+// Texture coordinate range of a tile, in [0, 1] over the whole sphere.
+static void tileRect(const vtLevel &l, uint32_t tx, uint32_t ty, double rect[4])
+{
+	rect[0] = (double)tx / l.tilesX;
+	rect[1] = (double)(tx + 1) / l.tilesX;
+	rect[2] = (double)ty / l.tilesY;
+	rect[3] = (double)(ty + 1) / l.tilesY;
+}
+
+// Screen-space extent of a tile's patch in pixels (across, down), from a 3x3 grid of
+// samples. Returns false if none of the samples faces the viewer.
+static bool patchExtent(const virtualTexture *vt, const double rect[4], double extent[2])
+{
+	double screen[3][3][2];
+	bool front = false;
+	for (int j = 0; j < 3; j++)
+		for (int i = 0; i < 3; i++)
+		{
+			double n[3], e[4], c[4];
+			spherePoint(rect[0] + 0.5 * i * (rect[1] - rect[0]), rect[2] + 0.5 * j * (rect[3] - rect[2]), n);
+			for (int r = 0; r < 4; r++)
+				e[r] = vt->modelview[r] * n[0] * vt->radius + vt->modelview[4 + r] * n[1] * vt->radius +
+					   vt->modelview[8 + r] * n[2] * vt->radius + vt->modelview[12 + r];
+			for (int r = 0; r < 4; r++)
+				c[r] = vt->projection[r] * e[0] + vt->projection[4 + r] * e[1] + vt->projection[8 + r] * e[2] + vt->projection[12 + r] * e[3];
+
+			// Facing the viewer if the eye-space normal points back towards the origin.
+			double en[3];
+			for (int r = 0; r < 3; r++)
+				en[r] = vt->modelview[r] * n[0] + vt->modelview[4 + r] * n[1] + vt->modelview[8 + r] * n[2];
+			if (-(en[0] * e[0] + en[1] * e[1] + en[2] * e[2]) > -0.1 * sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]))
+				front = true;
+
+			double w = c[3] > 1e-6 ? c[3] : 1e-6;
+			screen[j][i][0] = (c[0] / w * 0.5 + 0.5) * vt->viewport[2];
+			screen[j][i][1] = (c[1] / w * 0.5 + 0.5) * vt->viewport[3];
+		}
+
+	extent[0] = extent[1] = 0.0;
+	for (int k = 0; k < 3; k++)
+	{
+		double across = 0.0, down = 0.0;
+		for (int m = 0; m < 2; m++)
+		{
+			across += hypot(screen[k][m + 1][0] - screen[k][m][0], screen[k][m + 1][1] - screen[k][m][1]);
+			down += hypot(screen[m + 1][k][0] - screen[m][k][0], screen[m + 1][k][1] - screen[m][k][1]);
+		}
+		extent[0] = std::max(extent[0], across);
+		extent[1] = std::max(extent[1], down);
+	}
+	return front;
+}
+
+// Choose the patches to draw below a tile: split while the tile is magnified on screen.
+static void selectPatches(virtualTexture *vt, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	const vtHeader *h = vt->file.header;
+	const vtLevel &l = vt->file.levels[level];
+	double rect[4], extent[2];
+	tileRect(l, tx, ty, rect);
+
+	uint32_t texelsX = std::min(h->tileSize, l.width), texelsY = std::min(h->tileSize, l.height);
+	if (level > 0 && patchExtent(vt, rect, extent) && (extent[0] > texelsX || extent[1] > texelsY))
+	{
+		const vtLevel &finer = vt->file.levels[level - 1];
+		uint32_t rx = finer.tilesX / l.tilesX, ry = finer.tilesY / l.tilesY;
+		for (uint32_t y = 0; y < ry; y++)
+			for (uint32_t x = 0; x < rx; x++)
+				selectPatches(vt, level - 1, tx * rx + x, ty * ry + y);
+		return;
+	}
+
+	vtPatch patch = {level, tx, ty};
+	vt->patches.push_back(patch);
+}
+
+// Draw a patch with texture coordinates into the given resident tile.
+static void drawPatch(const virtualTexture *vt, const vtPatch &patch, uint32_t level, uint32_t tx, uint32_t ty, int slot)
+{
+	const vtHeader *h = vt->file.header;
+	const vtLevel &l = vt->file.levels[level];
+	double rect[4], tile[4];
+	tileRect(vt->file.levels[patch.level], patch.tx, patch.ty, rect);
+	tileRect(l, tx, ty, tile);
+
+	// Map the tile's texture coordinate range onto its texels in the slot.
+	double s0 = (slot % vt->slotsPerSide) * vt->slotSide + h->border;
+	double t0 = (slot / vt->slotsPerSide) * vt->slotSide + h->border;
+	double sScale = std::min(h->tileSize, l.width) / (tile[1] - tile[0]);
+	double tScale = std::min(h->tileSize, l.height) / (tile[3] - tile[2]);
+
+	int stepsU = std::max(1, (int)ceil((rect[1] - rect[0]) * 32));
+	int stepsV = std::max(1, (int)ceil((rect[3] - rect[2]) * 16));
+	for (int j = 0; j < stepsV; j++)
+	{
+		glBegin(GL_QUAD_STRIP);
+		for (int i = 0; i <= stepsU; i++)
+		{
+			double u = rect[0] + (rect[1] - rect[0]) * i / stepsU;
+			for (int k = 1; k >= 0; k--)
+			{
+				double v = rect[2] + (rect[3] - rect[2]) * (j + k) / stepsV;
+				double n[3];
+				spherePoint(u, v, n);
+				glTexCoord2d((s0 + (u - tile[0]) * sScale) / vt->cacheSize, (t0 + (v - tile[2]) * tScale) / vt->cacheSize);
+				glNormal3dv(n);
+				glVertex3d(n[0] * vt->radius, n[1] * vt->radius, n[2] * vt->radius);
+			}
+		}
+		glEnd();
+	}
+}
+
+int drawVirtualTexturedSphere(virtualTexture *vt, float radius)
+{
+	const vtHeader *h = vt->file.header;
+	uint32_t root = h->levels - 1;
+
+	vt->frame++;
+	vt->radius = radius;
+	glGetDoublev(GL_MODELVIEW_MATRIX, vt->modelview);
+	glGetDoublev(GL_PROJECTION_MATRIX, vt->projection);
+	glGetIntegerv(GL_VIEWPORT, vt->viewport);
+
+	glBindTexture(GL_TEXTURE_2D, vt->cacheTexture);
+
+	// The single tile of the coarsest level is the fallback of last resort, so keep it resident.
+	std::unordered_map<uint64_t, int>::iterator it = vt->resident.find(tileKey(root, 0, 0));
+	if (it == vt->resident.end())
+		streamTile(vt, root, 0, 0);
+	else
+		touchSlot(vt, it->second);
+
+	vt->patches.clear();
+	selectPatches(vt, root, 0, 0);
+
+	// Stream missing tiles, coarsest first so that fallbacks improve evenly.
+	std::vector<vtPatch> missing;
+	for (size_t i = 0; i < vt->patches.size(); i++)
+	{
+		const vtPatch &p = vt->patches[i];
+		it = vt->resident.find(tileKey(p.level, p.tx, p.ty));
+		if (it == vt->resident.end())
+			missing.push_back(p);
+		else
+			touchSlot(vt, it->second);
+	}
+	std::sort(missing.begin(), missing.end(), [](const vtPatch &a, const vtPatch &b) { return a.level > b.level; });
+	size_t streamed = 0;
+	for (; streamed < missing.size() && streamed < VT_UPLOADS_PER_FRAME; streamed++)
+		if (!streamTile(vt, missing[streamed].level, missing[streamed].tx, missing[streamed].ty))
+			break;
+	// With every slot in use this frame, the next frame would not get further.
+	int wanted = streamed < missing.size() && streamed < VT_UPLOADS_PER_FRAME ? 0 : (int)(missing.size() - streamed);
+
+	// Draw each patch from its own tile or the closest resident ancestor.
+	for (size_t i = 0; i < vt->patches.size(); i++)
+	{
+		const vtPatch &p = vt->patches[i];
+		uint32_t level = p.level, tx = p.tx, ty = p.ty;
+		for (;;)
+		{
+			it = vt->resident.find(tileKey(level, tx, ty));
+			if (it != vt->resident.end() || level == root)
+				break;
+			const vtLevel &l = vt->file.levels[level], &coarser = vt->file.levels[level + 1];
+			tx /= l.tilesX / coarser.tilesX;
+			ty /= l.tilesY / coarser.tilesY;
+			level++;
+		}
+		if (it == vt->resident.end())
+			continue;
+		touchSlot(vt, it->second);
+		drawPatch(vt, p, level, tx, ty, it->second);
+	}
+	return wanted;
+}
@@ -0,0 +1,27 @@
+#ifndef VTEXTURE_H
+#define VTEXTURE_H
+
+// Virtual texturing of spheres from a tile file (see vtfile.h).
+//
+// The sphere is drawn as a quadtree of patches, one per tile. A patch is split
+// while its tile has fewer texels than the patch covers on screen. Every patch
+// asks for its tile. Missing tiles are streamed from the mapped file into a
+// fixed-size physical page cache texture, a few per frame, evicting the least
+// recently used. Until a tile arrives, its patch is drawn from the nearest
+// coarser tile that is resident. The page cache is sized from the screen
+// resolution, so GPU and host memory do not depend on the size of the source map.
+
+#include <string>
+
+struct virtualTexture;
+
+// Open a tile file and create its page cache for a screen of the given size. NULL if the file cannot be opened.
+virtualTexture *createVirtualTexture(std::string fileName, int screenWidth, int screenHeight);
+void destroyVirtualTexture(virtualTexture *vt);
+
+// Draw a sphere of the given radius, textured the way gluSphere() textures one,
+// with the current modelview and projection. Returns the number of tiles the view
+// still waits for, which later frames will stream.
+int drawVirtualTexturedSphere(virtualTexture *vt, float radius);
+
+#endif
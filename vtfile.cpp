@@ -0,0 +1,183 @@
+// Reading and writing virtual texture tile files.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mipmap.h"
+#include "vtfile.h"
+
+static bool isPowerOfTwo(uint32_t v)
+{
+	return v && !(v & (v - 1));
+}
+
+bool openVTFile(std::string fileName, vtFile &file)
+{
+	memset(&file, 0, sizeof(file));
+
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(vtHeader))
+	{
+		std::cerr << fileName << ": not a tile file" << std::endl;
+		close(fd);
+		return false;
+	}
+
+	// Tiles are paged in as they are streamed, so host memory follows what is on screen.
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		std::cerr << fileName << ": cannot map tile file" << std::endl;
+		return false;
+	}
+
+	file.base = (const unsigned char *)base;
+	file.size = st.st_size;
+	file.header = (const vtHeader *)file.base;
+	file.levels = (const vtLevel *)(file.base + sizeof(vtHeader));
+
+	const vtHeader *h = file.header;
+	bool valid = memcmp(h->magic, VTFILE_MAGIC, 4) == 0 && h->version == VTFILE_VERSION &&
+				 isPowerOfTwo(h->tileSize) && h->tileSize <= 65536 && h->border < h->tileSize && isPowerOfTwo(h->width) &&
+				 isPowerOfTwo(h->height) && h->levels > 0 && h->levels <= VTFILE_MAX_LEVELS &&
+				 sizeof(vtHeader) + h->levels * sizeof(vtLevel) <= file.size;
+
+	// Every level as writeVTFile lays it out: each half the one before, its tiles following the one before's.
+	uint64_t tiles = 0;
+	for (uint32_t i = 0; valid && i < h->levels; i++)
+	{
+		const vtLevel &l = file.levels[i];
+		uint32_t width = i ? std::max(1u, file.levels[i - 1].width / 2) : h->width;
+		uint32_t height = i ? std::max(1u, file.levels[i - 1].height / 2) : h->height;
+		valid = l.width == width && l.height == height && l.firstTile == tiles &&
+				l.tilesX == (width > h->tileSize ? width / h->tileSize : 1) &&
+				l.tilesY == (height > h->tileSize ? height / h->tileSize : 1);
+		tiles += (uint64_t)l.tilesX * l.tilesY;
+	}
+	if (valid)
+	{
+		size_t side = h->tileSize + 2 * h->border;
+		file.tileBytes = 4 * side * side;
+		const vtLevel &last = file.levels[h->levels - 1];
+		valid = last.tilesX == 1 && last.tilesY == 1 && h->dataOffset <= file.size &&
+				tiles <= (file.size - h->dataOffset) / file.tileBytes;
+	}
+	if (!valid)
+	{
+		std::cerr << fileName << ": corrupt tile file" << std::endl;
+		closeVTFile(file);
+		return false;
+	}
+	return true;
+}
+
+void closeVTFile(vtFile &file)
+{
+	if (file.base)
+		munmap((void *)file.base, file.size);
+	memset(&file, 0, sizeof(file));
+}
+
+const unsigned char *vtTileData(const vtFile &file, uint32_t level, uint32_t tx, uint32_t ty)
+{
+	const vtLevel &l = file.levels[level];
+	uint64_t index = l.firstTile + (uint64_t)ty * l.tilesX + tx;
+	return file.base + file.header->dataOffset + index * file.tileBytes;
+}
+
+std::string vtFileName(std::string imageName)
+{
+	size_t dot = imageName.find_last_of('.');
+	size_t slash = imageName.find_last_of('/');
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		imageName.erase(dot);
+	return imageName + ".vtx";
+}
+
+bool writeVTFile(std::string fileName, const imageFile *image, uint32_t tileSize)
+{
+	if (!isPowerOfTwo(image->width) || !isPowerOfTwo(image->height) || !isPowerOfTwo(tileSize))
+	{
+		std::cerr << fileName << ": tile files need power-of-two image and tile sizes" << std::endl;
+		return false;
+	}
+
+	mipChain chain;
+	buildMipChain(image, chain);
+
+	// Keep levels down to the first one that fits in a single tile.
+	vtHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VTFILE_MAGIC, 4);
+	header.version = VTFILE_VERSION;
+	header.width = image->width;
+	header.height = image->height;
+	header.tileSize = tileSize;
+	header.border = 1;
+
+	std::vector<vtLevel> levels;
+	uint64_t tiles = 0;
+	for (size_t i = 0; i < chain.levels.size(); i++)
+	{
+		vtLevel level;
+		level.width = chain.levels[i].width;
+		level.height = chain.levels[i].height;
+		level.tilesX = level.width > tileSize ? level.width / tileSize : 1;
+		level.tilesY = level.height > tileSize ? level.height / tileSize : 1;
+		level.firstTile = tiles;
+		levels.push_back(level);
+		tiles += (uint64_t)level.tilesX * level.tilesY;
+		if (level.tilesX == 1 && level.tilesY == 1)
+			break;
+	}
+	header.levels = (uint32_t)levels.size();
+	header.dataOffset = (sizeof(header) + levels.size() * sizeof(vtLevel) + 4095) & ~(uint64_t)4095;
+
+	std::ofstream outFile(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	outFile.write((const char *)&header, sizeof(header));
+	outFile.write((const char *)levels.data(), levels.size() * sizeof(vtLevel));
+	std::vector<char> padding(header.dataOffset - (uint64_t)outFile.tellp(), 0);
+	outFile.write(padding.data(), padding.size());
+
+	int side = tileSize + 2 * header.border;
+	std::vector<unsigned char> tile(4 * (size_t)side * side);
+	for (size_t l = 0; l < levels.size(); l++)
+	{
+		const imageFile &src = chain.levels[l];
+		for (uint32_t ty = 0; ty < levels[l].tilesY; ty++)
+			for (uint32_t tx = 0; tx < levels[l].tilesX; tx++)
+			{
+				for (int j = 0; j < side; j++)
+				{
+					long y = (long)ty * tileSize + j - header.border;
+					y = y < 0 ? 0 : (y >= src.height ? src.height - 1 : y);
+					for (int i = 0; i < side; i++)
+					{
+						long x = ((long)tx * tileSize + i - header.border + src.width) % src.width;
+						memcpy(&tile[4 * ((size_t)j * side + i)], src.data + 4 * ((size_t)y * src.width + x), 4);
+					}
+				}
+				outFile.write((const char *)tile.data(), tile.size());
+			}
+	}
+	outFile.close();
+
+	if (!outFile)
+	{
+		std::cerr << fileName << ": write failed" << std::endl;
+		return false;
+	}
+	return true;
+}
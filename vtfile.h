@@ -0,0 +1,71 @@
+#ifndef VTFILE_H
+#define VTFILE_H
+
+// Tile file: a mip pyramid cut into fixed-size RGBA tiles for virtual texturing,
+// written offline by solaire-bake -t and memory-mapped by the viewer.
+//
+// Layout:
+//   vtHeader
+//   vtLevel[levels], finest level first
+//   tiles, from dataOffset; every tile is the same size, so tile i of the file
+//   starts at dataOffset + i * tileBytes
+//
+// Each tile holds tileSize x tileSize texels surrounded by a border of copied
+// neighbour texels (wrapping across the left/right edge, clamped at top and
+// bottom) so it can be sampled bilinearly on its own.
+
+#include <stdint.h>
+#include <string>
+
+#include "getBMP.h"
+
+#define VTFILE_MAGIC "SLVT"
+#define VTFILE_VERSION 1
+#define VTFILE_MAX_LEVELS 24
+
+struct vtHeader
+{
+	char magic[4]; // VTFILE_MAGIC.
+	uint32_t version; // VTFILE_VERSION.
+	uint32_t width; // Size of level 0 in texels, powers of two.
+	uint32_t height;
+	uint32_t tileSize; // Texels per tile side, excluding the border.
+	uint32_t border; // Border texels on each side of a tile.
+	uint32_t levels; // Number of levels; the last one is a single tile.
+	uint32_t reserved;
+	uint64_t dataOffset; // Byte offset of the first tile.
+};
+
+struct vtLevel
+{
+	uint32_t width; // Size of the level in texels.
+	uint32_t height;
+	uint32_t tilesX; // Tiles across and down.
+	uint32_t tilesY;
+	uint64_t firstTile; // Index of the level's first tile, tiles stored row by row.
+};
+
+// A tile file mapped into memory.
+struct vtFile
+{
+	const unsigned char *base; // Start of the mapping, NULL when not open.
+	size_t size; // Bytes mapped.
+	const vtHeader *header;
+	const vtLevel *levels;
+	size_t tileBytes; // Bytes of one tile including its border.
+};
+
+// Map a tile file and validate its header. Returns false (leaving file closed) on failure.
+bool openVTFile(std::string fileName, vtFile &file);
+void closeVTFile(vtFile &file);
+
+// Texels of one tile (RGBA, (tileSize + 2 * border) texels per row).
+const unsigned char *vtTileData(const vtFile &file, uint32_t level, uint32_t tx, uint32_t ty);
+
+// Name of the tile file baked from an image: the image's name with its extension replaced by .vtx.
+std::string vtFileName(std::string imageName);
+
+// Cut an RGBA image (power-of-two width and height) into a tile file. Returns false on failure.
+bool writeVTFile(std::string fileName, const imageFile *image, uint32_t tileSize);
+
+#endif
@@ -0,0 +1,64 @@
+// Directory watching on inotify, read without blocking.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+struct fileWatcher
+{
+	int fd;
+	std::string directory;
+};
+
+fileWatcher *createFileWatcher(std::string directory)
+{
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	// Editors either rewrite a file or write a new one and rename it over the old.
+	if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		std::cerr << directory << ": cannot watch for changes: " << strerror(errno) << std::endl;
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	fileWatcher *watcher = new fileWatcher;
+	watcher->fd = fd;
+	watcher->directory = directory;
+	return watcher;
+}
+
+void destroyFileWatcher(fileWatcher *watcher)
+{
+	close(watcher->fd);
+	delete watcher;
+}
+
+void pollFileWatcher(fileWatcher *watcher, std::vector<std::string> &changed)
+{
+	changed.clear();
+	alignas(inotify_event) char buffer[4096];
+	for (;;)
+	{
+		ssize_t n = read(watcher->fd, buffer, sizeof(buffer));
+		if (n <= 0)
+			break; // EAGAIN: nothing more to read.
+
+		for (char *p = buffer; p < buffer + n;)
+		{
+			const inotify_event *event = (const inotify_event *)p;
+			if (event->len > 0 && !(event->mask & IN_ISDIR))
+			{
+				std::string path = watcher->directory + "/" + event->name;
+				if (std::find(changed.begin(), changed.end(), path) == changed.end())
+					changed.push_back(path);
+			}
+			p += sizeof(inotify_event) + event->len;
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+// Watching a directory for changed files with inotify.
+
+#include <string>
+#include <vector>
+
+struct fileWatcher;
+
+// Watch a directory for files written to or moved into it. Returns NULL (after
+// reporting why) if it cannot be watched.
+fileWatcher *createFileWatcher(std::string directory);
+void destroyFileWatcher(fileWatcher *watcher);
+
+// Collect the paths (directory/name) of the files changed since the last call,
+// each once. Never blocks.
+void pollFileWatcher(fileWatcher *watcher, std::vector<std::string> &changed);
+
+#endif